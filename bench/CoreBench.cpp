@@ -0,0 +1,276 @@
+// Microbenchmarks of the building blocks of the request path: the cache under contention, the access log producer,
+// the rate limiter, the directory listing (what GetHTML used to render on every request) and FormatFileSize.
+
+#include "Cache.h"
+#include "Logger.h"
+#include "HttpUtils.h"
+#include "DirectoryListing.h"
+#include "DirectoryWatcher.h"
+#include "RateLimiter.h"
+#include "SingleFlight.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    constexpr size_t s_fileCount = 4096;
+
+    std::vector<fs::path> s_paths;
+    std::unique_ptr<MC::Cache> s_cache;
+
+    fs::path MakeTempDir()
+    {
+        fs::path dir = fs::temp_directory_path() / "mc_core_bench";
+        fs::create_directories(dir);
+        return dir;
+    }
+
+    MC::Cache::FilePtr MakeFile(size_t size)
+    {
+        return std::make_shared<MC::CachedFile>(std::string(size, 'x'));
+    }
+
+    void SetupCache(const benchmark::State&)
+    {
+        s_paths.clear();
+        for(size_t i = 0; i < s_fileCount; i++)
+            s_paths.emplace_back("content/file_" + std::to_string(i) + ".bin");
+
+        // Room for half of the files, so that the add benchmark keeps evicting
+        s_cache = std::make_unique<MC::Cache>();
+        s_cache->SetTTL(3600);
+        s_cache->SetCapacity(0, s_fileCount / 2);
+        for(size_t i = 0; i < s_fileCount / 2; i++)
+            s_cache->AddCachedFile(s_paths[i], MakeFile(1024));
+    }
+
+    void TeardownCache(const benchmark::State&)
+    {
+        s_cache.reset();
+    }
+
+    // Lookups of cached files, each thread walks the keys from its own offset
+    void BM_CacheGet(benchmark::State& state)
+    {
+        size_t index = static_cast<size_t>(state.thread_index()) * 97;
+        MC::Cache::FilePtr file;
+        for(auto _ : state)
+        {
+            benchmark::DoNotOptimize(s_cache->GetCachedFile(s_paths[index % (s_fileCount / 2)], file));
+            index++;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Insertions over the whole key space, with admission and eviction once the cache is full
+    void BM_CacheAdd(benchmark::State& state)
+    {
+        size_t index = static_cast<size_t>(state.thread_index()) * 97;
+        MC::Cache::FilePtr file = MakeFile(1024);
+        for(auto _ : state)
+        {
+            benchmark::DoNotOptimize(s_cache->AddCachedFile(s_paths[index % s_fileCount], file));
+            index++;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // 90% lookups and 10% insertions, the mix of a warm server
+    void BM_CacheMixed(benchmark::State& state)
+    {
+        size_t index = static_cast<size_t>(state.thread_index()) * 97;
+        MC::Cache::FilePtr file = MakeFile(1024);
+        MC::Cache::FilePtr found;
+        for(auto _ : state)
+        {
+            const fs::path& path = s_paths[(index * 31) % s_fileCount];
+            if(index % 10 == 0)
+                benchmark::DoNotOptimize(s_cache->AddCachedFile(path, file));
+            else
+                benchmark::DoNotOptimize(s_cache->GetCachedFile(path, found));
+            index++;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Files added with a one second TTL, then reclaimed by the expiry thread
+    void BM_CacheExpire(benchmark::State& state)
+    {
+        const size_t count = static_cast<size_t>(state.range(0));
+        MC::Cache::FilePtr file = MakeFile(64);
+        for(auto _ : state)
+        {
+            MC::Cache cache;
+            cache.SetTTL(1);
+            for(size_t i = 0; i < count; i++)
+                cache.AddCachedFile(s_paths[i % s_fileCount], file);
+
+            while(cache.GetStats().entries > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    void BM_LoggerLogRequest(benchmark::State& state)
+    {
+        static MC::Logger* s_logger = nullptr;
+        if(state.thread_index() == 0)
+        {
+            s_logger = new MC::Logger();
+            s_logger->SetLogFilePath(MakeTempDir() / "requests.txt");
+        }
+
+        const std::string line = "127.0.0.1 - - [17/Oct/2026:08:00:00 +0000] \"GET /file.bin HTTP/1.1\" 200 1024 \"-\" \"bench\" 120 HIT http";
+        for(auto _ : state)
+            s_logger->LogRequest(line);
+
+        state.SetItemsProcessed(state.iterations());
+        if(state.thread_index() == 0)
+        {
+            state.counters["dropped"] = static_cast<double>(s_logger->GetDroppedCount());
+            delete s_logger;
+            s_logger = nullptr;
+        }
+    }
+
+    std::unique_ptr<MC::RateLimiter> s_rateLimiter;
+    std::vector<std::string> s_addresses;
+
+    void SetupRateLimiter(const benchmark::State&)
+    {
+        // Rates high enough to never reject: the benchmark measures the admission itself, with per client and global buckets
+        MC::RateLimiter::Settings settings;
+        settings.clientRequestsPerSec = 1e9;
+        settings.clientBytesPerSec = 1e12;
+        settings.globalRequestsPerSec = 1e12;
+        s_rateLimiter = std::make_unique<MC::RateLimiter>(settings);
+
+        s_addresses.clear();
+        for(size_t i = 0; i < 4096; i++)
+            s_addresses.push_back("10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256));
+    }
+
+    void TeardownRateLimiter(const benchmark::State&)
+    {
+        s_rateLimiter.reset();
+    }
+
+    // Request admission of many clients, each thread walks the addresses from its own offset
+    void BM_RateLimiterAdmit(benchmark::State& state)
+    {
+        size_t index = static_cast<size_t>(state.thread_index()) * 97;
+        std::shared_ptr<MC::RateLimiter::Client> client;
+        std::chrono::nanoseconds retryAfter{};
+        for(auto _ : state)
+        {
+            benchmark::DoNotOptimize(s_rateLimiter->AdmitRequest(s_addresses[index % s_addresses.size()], client, retryAfter));
+            index++;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    MC::SingleFlight<std::string, std::shared_ptr<const std::string>> s_fileLoads;
+    std::atomic<uint64_t> s_diskReads{ 0 };
+
+    // Every thread misses the same file, whose read takes 1 ms: concurrent misses should share the read
+    void BM_SingleFlightMiss(benchmark::State& state)
+    {
+        if(state.thread_index() == 0)
+            s_diskReads = 0;
+
+        bool shared = false;
+        for(auto _ : state)
+        {
+            auto file = s_fileLoads.Do("hot.txt", []()
+                {
+                    s_diskReads++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    return std::make_shared<const std::string>(4096, 'x');
+                }, shared);
+            benchmark::DoNotOptimize(file);
+        }
+        state.SetItemsProcessed(state.iterations());
+        if(state.thread_index() == 0)
+            state.counters["reads"] = benchmark::Counter(static_cast<double>(s_diskReads.load()));
+    }
+
+    fs::path MakeListingDir(size_t entries)
+    {
+        fs::path dir = MakeTempDir() / ("listing_" + std::to_string(entries));
+        if(!fs::exists(dir))
+        {
+            fs::create_directories(dir);
+            for(size_t i = 0; i < entries; i++)
+                std::ofstream(dir / ("file_" + std::to_string(i) + ".txt")) << i;
+        }
+        return dir;
+    }
+
+    // First request of a directory: read it from disk and render the first page
+    void BM_ListingScanAndRender(benchmark::State& state)
+    {
+        fs::path dir = MakeListingDir(static_cast<size_t>(state.range(0)));
+        MC::DirectoryListing::FilePtr page;
+        for(auto _ : state)
+        {
+            MC::DirectoryListing listing(dir, 1000, false);
+            benchmark::DoNotOptimize(listing.GetPage(fs::path(), 0, MC::DirectoryListing::Format::Html, page));
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // A change in the directory: update one entry and render the page again
+    void BM_ListingUpdateAndRender(benchmark::State& state)
+    {
+        fs::path dir = MakeListingDir(static_cast<size_t>(state.range(0)));
+        MC::DirectoryListing listing(dir, 1000, false);
+        MC::DirectoryListing::FilePtr page;
+        listing.GetPage(fs::path(), 0, MC::DirectoryListing::Format::Html, page);
+
+        const MC::WatchEvent event{ MC::WatchEvent::Type::Changed, dir / "file_0.txt", false };
+        for(auto _ : state)
+        {
+            listing.OnWatchEvent(event);
+            benchmark::DoNotOptimize(listing.GetPage(fs::path(), 0, MC::DirectoryListing::Format::Html, page));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Steady state: the rendered page is reused
+    void BM_ListingCachedPage(benchmark::State& state)
+    {
+        fs::path dir = MakeListingDir(static_cast<size_t>(state.range(0)));
+        MC::DirectoryListing listing(dir, 1000, false);
+        MC::DirectoryListing::FilePtr page;
+        for(auto _ : state)
+            benchmark::DoNotOptimize(listing.GetPage(fs::path(), 0, MC::DirectoryListing::Format::Html, page));
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_FormatFileSize(benchmark::State& state)
+    {
+        uintmax_t size = 1;
+        for(auto _ : state)
+        {
+            benchmark::DoNotOptimize(MC::FormatFileSize(size));
+            size = size * 7 + 13;
+            if(size > (uintmax_t(1) << 44))
+                size = 1;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+}
+
+BENCHMARK(BM_CacheGet)->Setup(SetupCache)->Teardown(TeardownCache)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_CacheAdd)->Setup(SetupCache)->Teardown(TeardownCache)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_CacheMixed)->Setup(SetupCache)->Teardown(TeardownCache)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_CacheExpire)->Setup(SetupCache)->Teardown(TeardownCache)->Arg(1 << 12)->Arg(1 << 16)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoggerLogRequest)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_RateLimiterAdmit)->Setup(SetupRateLimiter)->Teardown(TeardownRateLimiter)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_SingleFlightMiss)->ThreadRange(1, 8)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ListingScanAndRender)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ListingUpdateAndRender)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ListingCachedPage)->Arg(10000);
+BENCHMARK(BM_FormatFileSize);
+
+BENCHMARK_MAIN();
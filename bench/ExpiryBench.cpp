@@ -0,0 +1,99 @@
+// Compares the cost of the Cache expiry engine (one timing wheel per shard) with the previous approach,
+// where every cached file registered its own CppTime::Timer event.
+
+#include "TimingWheel.h"
+#include "cpptime/cpptime.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<fs::path> MakePaths(size_t count)
+    {
+        std::vector<fs::path> paths;
+        paths.reserve(count);
+        for(size_t i = 0; i < count; i++)
+            paths.emplace_back("content/file_" + std::to_string(i) + ".bin");
+        return paths;
+    }
+
+    // Insert a batch of one hour timers and cancel them again
+    void BM_CppTimeInsertCancel(benchmark::State& state)
+    {
+        auto paths = MakePaths(static_cast<size_t>(state.range(0)));
+        std::vector<CppTime::timer_id> ids(paths.size());
+        CppTime::Timer timer;
+
+        for(auto _ : state)
+        {
+            for(size_t i = 0; i < paths.size(); i++)
+                ids[i] = timer.add(std::chrono::seconds(3600), [path = paths[i]](CppTime::timer_id) { benchmark::DoNotOptimize(path); });
+            for(CppTime::timer_id id : ids)
+                timer.remove(id);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void BM_TimingWheelInsertCancel(benchmark::State& state)
+    {
+        auto paths = MakePaths(static_cast<size_t>(state.range(0)));
+        std::vector<MC::TimingWheel<const fs::path*>::Handle> handles(paths.size());
+        MC::TimingWheel<const fs::path*> wheel;
+
+        for(auto _ : state)
+        {
+            Clock::time_point deadline = Clock::now() + std::chrono::seconds(3600);
+            for(size_t i = 0; i < paths.size(); i++)
+                handles[i] = wheel.Schedule(&paths[i], deadline);
+            for(auto& handle : handles)
+                wheel.Cancel(handle);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // Insert a batch of timers that are already due and wait until all of them have fired
+    void BM_CppTimeExpire(benchmark::State& state)
+    {
+        auto paths = MakePaths(static_cast<size_t>(state.range(0)));
+        CppTime::Timer timer;
+        std::atomic<size_t> fired{ 0 };
+
+        for(auto _ : state)
+        {
+            fired = 0;
+            for(const fs::path& path : paths)
+                timer.add(std::chrono::seconds(0), [&fired, path](CppTime::timer_id) { benchmark::DoNotOptimize(path); fired++; });
+            while(fired.load() < paths.size())
+                std::this_thread::yield();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void BM_TimingWheelExpire(benchmark::State& state)
+    {
+        auto paths = MakePaths(static_cast<size_t>(state.range(0)));
+        Clock::time_point start = Clock::now();
+        MC::TimingWheel<const fs::path*> wheel(std::chrono::seconds(1), 256, start);
+        std::chrono::seconds elapsed{ 0 };
+        size_t fired = 0;
+
+        for(auto _ : state)
+        {
+            // Drive the wheel with a simulated clock, one tick per iteration
+            for(const fs::path& path : paths)
+                wheel.Schedule(&path, start + elapsed);
+            elapsed += std::chrono::seconds(1);
+            wheel.Advance(start + elapsed, [&fired](const fs::path* path) { benchmark::DoNotOptimize(path); fired++; });
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK(BM_CppTimeInsertCancel)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TimingWheelInsertCancel)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CppTimeExpire)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TimingWheelExpire)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,230 @@
+// Self-contained load test: starts a server on localhost over a generated content tree and drives it with concurrent
+// keep-alive clients. The result is printed to stdout as a single JSON object, so that runs can be compared by scripts.
+//
+// Usage: LoadGenerator [--clients=N] [--duration=S] [--files=N] [--seed=N] [--port=N] [--warmup=S] [--io_model=threads|epoll]
+
+#include "Server.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+#include <random>
+
+namespace
+{
+    struct Options
+    {
+        size_t clients = 8;
+        double durationS = 10.0;
+        double warmupS = 1.0;
+        size_t files = 1000;
+        uint32_t seed = 42;
+        int port = 18100;
+        std::string ioModel = "threads";
+    };
+
+    struct ClientResult
+    {
+        std::vector<uint32_t> latenciesUs;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+    };
+
+    bool ParseOptions(int argc, char** argv, Options& outOptions)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            std::string_view arg = argv[i];
+            size_t separator = arg.find('=');
+            if(!arg.starts_with("--") || separator == std::string_view::npos)
+                return false;
+
+            std::string_view key = arg.substr(2, separator - 2);
+            std::string value(arg.substr(separator + 1));
+            try
+            {
+                if(key == "clients")
+                    outOptions.clients = std::max<size_t>(1, std::stoul(value));
+                else if(key == "duration")
+                    outOptions.durationS = std::stod(value);
+                else if(key == "warmup")
+                    outOptions.warmupS = std::stod(value);
+                else if(key == "files")
+                    outOptions.files = std::max<size_t>(1, std::stoul(value));
+                else if(key == "seed")
+                    outOptions.seed = static_cast<uint32_t>(std::stoul(value));
+                else if(key == "port")
+                    outOptions.port = std::stoi(value);
+                else if(key == "io_model")
+                    outOptions.ioModel = value;
+                else
+                    return false;
+            }
+            catch(const std::exception&)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Sizes of a typical static site: mostly small assets, some medium images, a few large downloads
+    size_t PickFileSize(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<double> bucket(0.0, 1.0);
+        double b = bucket(rng);
+        if(b < 0.80)
+            return std::uniform_int_distribution<size_t>(256, 16 * 1024)(rng);
+        if(b < 0.98)
+            return std::uniform_int_distribution<size_t>(16 * 1024, 512 * 1024)(rng);
+        return std::uniform_int_distribution<size_t>(512 * 1024, 8 * 1024 * 1024)(rng);
+    }
+
+    std::vector<std::string> GenerateContent(const fs::path& contentDir, const Options& options)
+    {
+        fs::remove_all(contentDir);
+        fs::create_directories(contentDir);
+
+        std::mt19937 rng(options.seed);
+        std::vector<std::string> targets;
+        targets.reserve(options.files);
+        for(size_t i = 0; i < options.files; i++)
+        {
+            std::string name = "file_" + std::to_string(i) + ".bin";
+            std::string data(PickFileSize(rng), '\0');
+            for(char& c : data)
+                c = static_cast<char>('a' + rng() % 26);
+
+            std::ofstream(contentDir / name, std::ios::binary) << data;
+            targets.push_back("/" + name);
+        }
+        return targets;
+    }
+
+    void RunClient(const Options& options, const std::vector<std::string>& targets, size_t clientIndex,
+        std::chrono::steady_clock::time_point measureStart, std::chrono::steady_clock::time_point end, ClientResult& outResult)
+    {
+        httplib::Client client("127.0.0.1", options.port);
+        client.set_keep_alive(true);
+        client.set_tcp_nodelay(true);
+
+        // Zipf-like popularity, a few files get most of the requests like on a real site
+        std::mt19937 rng(options.seed + static_cast<uint32_t>(clientIndex) + 1);
+        std::vector<double> weights(targets.size());
+        for(size_t i = 0; i < weights.size(); i++)
+            weights[i] = 1.0 / static_cast<double>(i + 1);
+        std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+        for(auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now())
+        {
+            auto res = client.Get(targets[pick(rng)]);
+            auto done = std::chrono::steady_clock::now();
+            if(now < measureStart)
+                continue;
+
+            if(!res || res->status != 200)
+            {
+                outResult.errors++;
+                continue;
+            }
+            outResult.bytes += res->body.size();
+            outResult.latenciesUs.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(done - now).count()));
+        }
+    }
+
+    uint32_t Percentile(const std::vector<uint32_t>& sorted, double p)
+    {
+        if(sorted.empty())
+            return 0;
+        size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if(!ParseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--clients=N] [--duration=S] [--files=N] [--seed=N] [--port=N] [--warmup=S] [--io_model=threads|epoll]" << std::endl;
+        return 1;
+    }
+
+    fs::path dir = fs::temp_directory_path() / "mc_load_generator";
+    std::vector<std::string> targets = GenerateContent(dir / "content", options);
+
+    fs::path configPath = dir / "config.ini";
+    std::ofstream(configPath) << "[server]\n"
+        << "listening_port=" << options.port << "\n"
+        << "content_directory=" << (dir / "content").string() << "\n"
+        << "cache_ttl=3600\n"
+        << "log_path=" << (dir / "server_log.txt").string() << "\n"
+        << "log_level=warn\n"
+        << "io_model=" << options.ioModel << "\n";
+
+    // The server prints its configuration, keep stdout for the JSON result
+    std::streambuf* previous = std::cout.rdbuf(std::cerr.rdbuf());
+    MC::Server server(configPath);
+    std::atomic<bool> serverExited{ false };
+    std::thread serverThread([&server, &serverExited]()
+        {
+            server.CreateServer();
+            serverExited = true;
+        });
+    while(!server.IsRunning() && !serverExited)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // CreateServer returns at once when it cannot start, e.g. when the port is taken
+    if(!server.IsRunning())
+    {
+        serverThread.join();
+        std::cout.rdbuf(previous);
+        std::cerr << "Failed to start the server on port " << options.port << ", see " << (dir / "server_log.txt").string() << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto measureStart = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.warmupS));
+    auto end = measureStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.durationS));
+
+    std::vector<ClientResult> results(options.clients);
+    std::vector<std::thread> clients;
+    for(size_t i = 0; i < options.clients; i++)
+        clients.emplace_back(RunClient, std::cref(options), std::cref(targets), i, measureStart, end, std::ref(results[i]));
+    for(std::thread& client : clients)
+        client.join();
+
+    server.Stop();
+    serverThread.join();
+    std::cout.rdbuf(previous);
+
+    std::vector<uint32_t> latencies;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    for(ClientResult& result : results)
+    {
+        latencies.insert(latencies.end(), result.latenciesUs.begin(), result.latenciesUs.end());
+        errors += result.errors;
+        bytes += result.bytes;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    const double seconds = options.durationS > 0.0 ? options.durationS : 1.0;
+    std::cout << std::fixed << std::setprecision(2)
+        << "{\"clients\":" << options.clients
+        << ",\"io_model\":\"" << options.ioModel << "\""
+        << ",\"files\":" << options.files
+        << ",\"seed\":" << options.seed
+        << ",\"duration_s\":" << options.durationS
+        << ",\"requests\":" << latencies.size()
+        << ",\"errors\":" << errors
+        << ",\"requests_per_s\":" << static_cast<double>(latencies.size()) / seconds
+        << ",\"mbytes_per_s\":" << static_cast<double>(bytes) / seconds / (1024.0 * 1024.0)
+        << ",\"latency_us\":{\"p50\":" << Percentile(latencies, 0.50)
+        << ",\"p99\":" << Percentile(latencies, 0.99)
+        << ",\"p999\":" << Percentile(latencies, 0.999)
+        << ",\"max\":" << (latencies.empty() ? 0 : latencies.back())
+        << "}}" << std::endl;
+
+    return errors == 0 ? 0 : 2;
+}
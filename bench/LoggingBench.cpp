@@ -0,0 +1,109 @@
+// Measures the cost of the diagnostic messages on the request path: the previous flushed std::cout writes,
+// a disabled MC_LOG statement, an enabled one, and the resulting requests per second of a local server.
+
+#include "Logger.h"
+#include "Server.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    const std::string s_path = "/some/requested/file.bin";
+
+    fs::path MakeTempDir()
+    {
+        fs::path dir = fs::temp_directory_path() / "mc_logging_bench";
+        fs::create_directories(dir / "content");
+        std::ofstream(dir / "content" / "file.txt") << "Hello from the logging benchmark!";
+        return dir;
+    }
+
+    // What the request handler used to do: synchronized, flushed console writes
+    void BM_CoutStatement(benchmark::State& state)
+    {
+        fs::path dir = MakeTempDir();
+        std::ofstream sink(dir / "cout.txt");
+        std::streambuf* previous = std::cout.rdbuf(sink.rdbuf());
+
+        for(auto _ : state)
+            std::cout << "File request: " << s_path << std::endl;
+
+        std::cout.rdbuf(previous);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_LogStatementDisabled(benchmark::State& state)
+    {
+        MC::Logger logger;
+        logger.SetLevel(MC::LogLevel::Warn);
+
+        for(auto _ : state)
+            MC_LOG_DEBUG(logger, "File request: ", s_path);
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_LogStatementEnabled(benchmark::State& state)
+    {
+        fs::path dir = MakeTempDir();
+        MC::Logger logger;
+        logger.SetLevel(MC::LogLevel::Debug);
+        logger.SetLogFilePath(dir / "enabled.txt");
+
+        for(auto _ : state)
+            MC_LOG_DEBUG(logger, "File request: ", s_path);
+
+        state.SetItemsProcessed(state.iterations());
+        state.counters["dropped"] = static_cast<double>(logger.GetDroppedCount());
+    }
+
+    // End to end: keep-alive GET requests against a local server, with every diagnostic message enabled or disabled
+    void BM_ServerRequests(benchmark::State& state)
+    {
+        MC::LogLevel level = static_cast<MC::LogLevel>(state.range(0));
+        int port = 18090 + static_cast<int>(state.range(0));
+
+        fs::path dir = MakeTempDir();
+        fs::path configPath = dir / ("config_" + std::to_string(state.range(0)) + ".ini");
+        std::ofstream(configPath) << "[server]\n"
+            << "listening_port=" << port << "\n"
+            << "content_directory=" << (dir / "content").string() << "\n"
+            << "cache_ttl=3600\n"
+            << "log_path=" << (dir / "server_log.txt").string() << "\n"
+            << "log_level=" << MC::GetLogLevelName(level) << "\n";
+
+        MC::Server server(configPath);
+        std::thread serverThread([&server]() { server.CreateServer(); });
+        while(!server.IsRunning())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        httplib::Client client("127.0.0.1", port);
+        client.set_keep_alive(true);
+        client.set_tcp_nodelay(true);
+
+        for(auto _ : state)
+        {
+            auto res = client.Get("/file.txt");
+            if(!res || res->status != 200)
+            {
+                state.SkipWithError("Request failed");
+                break;
+            }
+        }
+
+        server.Stop();
+        serverThread.join();
+        state.SetItemsProcessed(state.iterations());
+        state.SetLabel(MC::GetLogLevelName(level));
+    }
+}
+
+BENCHMARK(BM_CoutStatement);
+BENCHMARK(BM_LogStatementDisabled);
+BENCHMARK(BM_LogStatementEnabled);
+BENCHMARK(BM_ServerRequests)->Arg(static_cast<int>(MC::LogLevel::Trace))->Arg(static_cast<int>(MC::LogLevel::Warn))->UseRealTime();
+
+BENCHMARK_MAIN();
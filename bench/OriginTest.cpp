@@ -0,0 +1,224 @@
+// Self-contained test of the origin mode: an edge server pulls from a second server through its memory and disk caches.
+// The origin serves local files with validators and no Cache-Control; the responses with Cache-Control come from a small
+// upstream behind it, which it proxies in turn. Each step is checked on the responses and on the cache status of the edge access log.
+//
+// Usage: OriginTest [--port=N], the test uses the ports N to N+2
+
+#include "Server.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+namespace
+{
+    constexpr int s_edgeTtlS = 3;
+
+    int g_failures = 0;
+
+    void Check(bool condition, const std::string& what)
+    {
+        std::cout << (condition ? "[PASS] " : "[FAIL] ") << what << std::endl;
+        if(!condition)
+            g_failures++;
+    }
+
+    /// @brief Server running on its own thread, destroyed on Stop so that its logs are flushed
+    class RunningServer
+    {
+    public:
+        ~RunningServer() { this->Stop(); }
+
+        bool Start(const fs::path& configPath)
+        {
+            m_server = std::make_unique<MC::Server>(configPath);
+            m_exited = false;
+            m_thread = std::thread([this]()
+                {
+                    m_server->CreateServer();
+                    m_exited = true;
+                });
+            while(!m_server->IsRunning() && !m_exited)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            if(!m_server->IsRunning())
+            {
+                this->Stop();
+                return false;
+            }
+            return true;
+        }
+
+        void Stop()
+        {
+            if(!m_server)
+                return;
+
+            m_server->Stop();
+            m_thread.join();
+            m_server.reset();
+        }
+
+    private:
+        std::unique_ptr<MC::Server> m_server;
+        std::thread m_thread;
+        std::atomic<bool> m_exited{ false };
+    };
+
+    void WriteConfig(const fs::path& configPath, int port, const fs::path& contentDir, int originPort, const fs::path& diskCacheDir,
+        const fs::path& accessLogPath, const fs::path& logPath)
+    {
+        std::ofstream config(configPath);
+        config << "[server]\n"
+            << "listening_port=" << port << "\n"
+            << "content_directory=" << contentDir.string() << "\n"
+            << "cache_ttl=" << s_edgeTtlS << "\n"
+            << "origin_url=http://127.0.0.1:" << originPort << "\n"
+            << "origin_timeout_s=2\n"
+            << "log_path=" << logPath.string() << "\n"
+            << "log_level=warn\n";
+        if(!diskCacheDir.empty())
+            config << "disk_cache_directory=" << diskCacheDir.string() << "\n";
+        if(!accessLogPath.empty())
+            config << "access_log_path=" << accessLogPath.string() << "\n";
+    }
+
+    /// @brief Status and cache status of each request of a combined access log, e.g. "200 MISS"
+    std::vector<std::string> ReadAccessLog(const fs::path& accessLogPath)
+    {
+        std::vector<std::string> entries;
+        std::ifstream file(accessLogPath);
+        for(std::string line; std::getline(file, line);)
+        {
+            // ... "GET /path HTTP/1.1" status bytes "referer" "agent" latency cache scheme
+            size_t request = line.find("\" ");
+            std::istringstream fields(request != std::string::npos ? line.substr(request + 2) : std::string());
+            std::string status;
+            fields >> status;
+
+            std::vector<std::string> tail;
+            for(std::string field; fields >> field;)
+                tail.push_back(field);
+            entries.push_back(status + " " + (tail.size() >= 2 ? tail[tail.size() - 2] : std::string()));
+        }
+        return entries;
+    }
+
+    bool IsOk(const httplib::Result& res, const std::string& body)
+    {
+        return res && res->status == 200 && res->body == body;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int port = 18200;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if(!arg.starts_with("--port=") || std::from_chars(arg.data() + 7, arg.data() + arg.size(), port).ec != std::errc{})
+        {
+            std::cerr << "Usage: " << argv[0] << " [--port=N]" << std::endl;
+            return 1;
+        }
+    }
+    const int edgePort = port;
+    const int originPort = port + 1;
+    const int upstreamPort = port + 2;
+
+    fs::path dir = fs::temp_directory_path() / "mc_origin_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "origin_content");
+    fs::create_directories(dir / "edge_content");
+
+    const std::string helloBody = "Hello from the origin\n";
+    std::ofstream(dir / "origin_content" / "hello.txt", std::ios::binary) << helloBody;
+
+    // Upstream of the origin, for the directives a server of local files never sends
+    const std::string upstreamBody = "Not for shared caches\n";
+    std::atomic<int> upstreamRequests{ 0 };
+    httplib::Server upstream;
+    upstream.Get(R"(/(nostore|private)\.txt)", [&](const httplib::Request& req, httplib::Response& res)
+        {
+            upstreamRequests++;
+            res.set_header("Cache-Control", req.matches[1] == "nostore" ? "no-store" : "private, max-age=60");
+            res.set_content(upstreamBody, "text/plain");
+        });
+    if(!upstream.bind_to_port("127.0.0.1", upstreamPort))
+    {
+        std::cerr << "Failed to bind the upstream on port " << upstreamPort << std::endl;
+        return 1;
+    }
+    std::thread upstreamThread([&upstream]() { upstream.listen_after_bind(); });
+    upstream.wait_until_ready();
+
+    WriteConfig(dir / "origin.ini", originPort, dir / "origin_content", upstreamPort, {}, {}, dir / "origin_log.txt");
+    RunningServer origin;
+    if(!origin.Start(dir / "origin.ini"))
+    {
+        std::cerr << "Failed to start the origin on port " << originPort << ", see " << (dir / "origin_log.txt").string() << std::endl;
+        upstream.stop();
+        upstreamThread.join();
+        return 1;
+    }
+
+    httplib::Client client("127.0.0.1", edgePort);
+    RunningServer edge;
+    auto startEdge = [&](const std::string& name)
+        {
+            WriteConfig(dir / (name + ".ini"), edgePort, dir / "edge_content", originPort, dir / "edge_cache", dir / (name + "_access.txt"), dir / (name + "_log.txt"));
+            bool started = edge.Start(dir / (name + ".ini"));
+            Check(started, "edge " + name + " started");
+            return started;
+        };
+
+    std::vector<std::string> expected;
+    std::vector<std::string> accessLog;
+    if(startEdge("edge1"))
+    {
+        auto pulled = std::chrono::steady_clock::now();
+        Check(IsOk(client.Get("/hello.txt"), helloBody), "first request pulled from the origin");
+        Check(IsOk(client.Get("/hello.txt"), helloBody), "second request served from memory");
+        expected.insert(expected.end(), { "200 MISS", "200 HIT" });
+
+        // Not stored anywhere: every request reaches the upstream
+        Check(IsOk(client.Get("/nostore.txt"), upstreamBody) && IsOk(client.Get("/nostore.txt"), upstreamBody), "no-store served");
+        Check(IsOk(client.Get("/private.txt"), upstreamBody) && IsOk(client.Get("/private.txt"), upstreamBody), "private served");
+        Check(upstreamRequests == 4, "no-store and private not cached (" + std::to_string(upstreamRequests) + " upstream requests)");
+        expected.insert(expected.end(), { "200 MISS", "200 MISS", "200 MISS", "200 MISS" });
+
+        // A new edge has an empty memory cache, the object comes from the disk cache while it is fresh
+        edge.Stop();
+        accessLog = ReadAccessLog(dir / "edge1_access.txt");
+        if(startEdge("edge2"))
+        {
+            Check(IsOk(client.Get("/hello.txt"), helloBody), "request after restart served from disk");
+
+            // Expired: the stored copy is revalidated, the origin answers 304
+            std::this_thread::sleep_until(pulled + std::chrono::seconds(s_edgeTtlS + 1));
+            Check(IsOk(client.Get("/hello.txt"), helloBody), "expired object revalidated");
+
+            origin.Stop();
+            auto res = client.Get("/missing_on_edge.txt");
+            Check(res && res->status == 502, "502 when the origin is down");
+            expected.insert(expected.end(), { "200 DISK", "200 REVALIDATED", "502 -" });
+
+            edge.Stop();
+            std::vector<std::string> restarted = ReadAccessLog(dir / "edge2_access.txt");
+            accessLog.insert(accessLog.end(), restarted.begin(), restarted.end());
+        }
+    }
+
+    origin.Stop();
+    upstream.stop();
+    upstreamThread.join();
+
+    Check(accessLog == expected, "edge cache statuses");
+    if(accessLog != expected)
+    {
+        for(size_t i = 0; i < std::max(accessLog.size(), expected.size()); i++)
+            std::cout << "  expected '" << (i < expected.size() ? expected[i] : "") << "', got '" << (i < accessLog.size() ? accessLog[i] : "") << "'" << std::endl;
+    }
+
+    std::cout << (g_failures == 0 ? "All origin checks passed" : std::to_string(g_failures) + " origin check(s) failed") << std::endl;
+    return g_failures == 0 ? 0 : 1;
+}
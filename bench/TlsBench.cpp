@@ -0,0 +1,255 @@
+// Measures what TLS costs on top of plain HTTP: new connections with a full handshake, with a resumed session,
+// and the keep-alive transfer rate of a file streamed from disk, with and without kTLS.
+
+#include "Server.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    constexpr size_t s_largeFileSize = 8 * 1024 * 1024;
+
+    fs::path MakeTempDir()
+    {
+        fs::path dir = fs::temp_directory_path() / "mc_tls_bench";
+        fs::create_directories(dir / "content");
+        std::ofstream(dir / "content" / "small.txt") << "Hello from the TLS benchmark!";
+        if(!fs::exists(dir / "content" / "large.bin"))
+            std::ofstream(dir / "content" / "large.bin", std::ios::binary) << std::string(s_largeFileSize, 'x');
+        return dir;
+    }
+
+    /// @brief Writes a self-signed P-256 certificate for localhost and its key
+    bool MakeCertificate(const fs::path& certPath, const fs::path& keyPath)
+    {
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* cert = X509_new();
+        bool success = key && cert;
+        if(success)
+        {
+            X509_set_version(cert, 2);
+            ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+            X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+            X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+            X509_set_pubkey(cert, key);
+            X509_NAME* name = X509_get_subject_name(cert);
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+            X509_set_issuer_name(cert, name);
+            success = X509_sign(cert, key, EVP_sha256()) > 0;
+        }
+
+        if(success)
+        {
+            FILE* certFile = fopen(certPath.c_str(), "w");
+            FILE* keyFile = fopen(keyPath.c_str(), "w");
+            success = certFile && keyFile
+                && PEM_write_X509(certFile, cert) == 1
+                && PEM_write_PrivateKey(keyFile, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+            if(certFile)
+                fclose(certFile);
+            if(keyFile)
+                fclose(keyFile);
+        }
+
+        X509_free(cert);
+        EVP_PKEY_free(key);
+        return success;
+    }
+
+    /// @brief Server running on its own thread for the lifetime of the object
+    class LocalServer
+    {
+    public:
+        LocalServer(int port, bool tls, bool ktls)
+        {
+            fs::path dir = MakeTempDir();
+            fs::path configPath = dir / ("config_" + std::to_string(port) + ".ini");
+            std::ofstream config(configPath);
+            config << "[server]\n"
+                << "listening_port=" << port << "\n"
+                << "content_directory=" << (dir / "content").string() << "\n"
+                << "cache_ttl=3600\n"
+                << "stream_threshold_bytes=" << s_largeFileSize / 2 << "\n"
+                << "log_path=" << (dir / "server_log.txt").string() << "\n"
+                << "log_level=warn\n";
+            if(tls && MakeCertificate(dir / "cert.pem", dir / "key.pem"))
+            {
+                config << "certificate=" << (dir / "cert.pem").string() << "\n"
+                    << "certificate_key=" << (dir / "key.pem").string() << "\n"
+                    << "tls_ktls=" << (ktls ? "true" : "false") << "\n";
+            }
+            config.close();
+
+            m_server = std::make_unique<MC::Server>(configPath);
+            m_thread = std::thread([this]() { m_server->CreateServer(); });
+            while(!m_server->IsRunning())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        ~LocalServer()
+        {
+            m_server->Stop();
+            m_thread.join();
+        }
+
+    private:
+        std::unique_ptr<MC::Server> m_server;
+        std::thread m_thread;
+    };
+
+    int Connect(int port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        // Like browsers: the request must not wait behind the Finished message of a resumed handshake for a delayed ACK
+        int noDelay = 1;
+        if(fd >= 0)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    /// @brief Opens a connection, sends one request and reads the response until the server closes
+    /// @param ctx Client context, null for plain HTTP
+    /// @param session Session to resume, replaced by the session of this connection
+    /// @param outResumed Set when the server accepted the session
+    /// @return False if the request failed
+    bool FetchOnce(int port, SSL_CTX* ctx, SSL_SESSION*& session, bool& outResumed)
+    {
+        static const std::string s_request = "GET /small.txt HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+        int fd = Connect(port);
+        if(fd < 0)
+            return false;
+
+        char buffer[4096];
+        size_t received = 0;
+        bool success = true;
+        if(!ctx)
+        {
+            success = send(fd, s_request.data(), s_request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(s_request.size());
+            ssize_t count;
+            while(success && (count = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+                received += static_cast<size_t>(count);
+        }
+        else
+        {
+            SSL* ssl = SSL_new(ctx);
+            SSL_set_fd(ssl, fd);
+            if(session)
+                SSL_set_session(ssl, session);
+            success = SSL_connect(ssl) == 1 && SSL_write(ssl, s_request.data(), static_cast<int>(s_request.size())) > 0;
+            int count;
+            while(success && (count = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+                received += static_cast<size_t>(count);
+
+            // TLS 1.3 tickets arrive after the handshake, the session is only complete once the response was read
+            outResumed = SSL_session_reused(ssl) == 1;
+            if(success)
+            {
+                SSL_SESSION_free(session);
+                session = SSL_get1_session(ssl);
+            }
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+        }
+        close(fd);
+        return success && received > 0;
+    }
+
+    enum class Handshake { Plain, Full, Resumed };
+
+    // New connection per request: TCP only, TCP plus a full TLS handshake, TCP plus a resumed TLS session
+    void BM_NewConnection(benchmark::State& state)
+    {
+        Handshake handshake = static_cast<Handshake>(state.range(0));
+        int port = 18120 + static_cast<int>(state.range(0));
+        LocalServer server(port, handshake != Handshake::Plain, false);
+
+        SSL_CTX* ctx = nullptr;
+        if(handshake != Handshake::Plain)
+        {
+            ctx = SSL_CTX_new(TLS_client_method());
+            SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+        }
+
+        SSL_SESSION* session = nullptr;
+        size_t resumed = 0;
+        for(auto _ : state)
+        {
+            if(handshake == Handshake::Full)
+            {
+                SSL_SESSION_free(session);
+                session = nullptr;
+            }
+
+            bool wasResumed = false;
+            if(!FetchOnce(port, ctx, session, wasResumed))
+            {
+                state.SkipWithError("Request failed");
+                break;
+            }
+            resumed += wasResumed ? 1 : 0;
+        }
+
+        SSL_SESSION_free(session);
+        SSL_CTX_free(ctx);
+        state.SetItemsProcessed(state.iterations());
+        state.counters["resumed"] = benchmark::Counter(static_cast<double>(resumed), benchmark::Counter::kAvgIterations);
+        state.SetLabel(handshake == Handshake::Plain ? "plain" : handshake == Handshake::Full ? "tls_full" : "tls_resumed");
+    }
+
+    enum class Transport { Plain, Tls, Ktls };
+
+    // Keep-alive downloads of a file streamed from its memory mapping
+    void BM_Throughput(benchmark::State& state)
+    {
+        Transport transport = static_cast<Transport>(state.range(0));
+        int port = 18130 + static_cast<int>(state.range(0));
+        LocalServer server(port, transport != Transport::Plain, transport == Transport::Ktls);
+
+        std::unique_ptr<httplib::ClientImpl> client;
+        if(transport == Transport::Plain)
+            client = std::make_unique<httplib::ClientImpl>("127.0.0.1", port);
+        else
+        {
+            auto sslClient = std::make_unique<httplib::SSLClient>("127.0.0.1", port);
+            sslClient->enable_server_certificate_verification(false);
+            client = std::move(sslClient);
+        }
+        client->set_keep_alive(true);
+
+        size_t bytes = 0;
+        for(auto _ : state)
+        {
+            auto res = client->Get("/large.bin");
+            if(!res || res->status != 200)
+            {
+                state.SkipWithError("Request failed");
+                break;
+            }
+            bytes += res->body.size();
+        }
+
+        state.SetBytesProcessed(static_cast<int64_t>(bytes));
+        state.SetLabel(transport == Transport::Plain ? "plain" : transport == Transport::Tls ? "tls" : "tls_ktls");
+    }
+}
+
+BENCHMARK(BM_NewConnection)->DenseRange(0, 2)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Throughput)->DenseRange(0, 2)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
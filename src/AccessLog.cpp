@@ -0,0 +1,155 @@
+#include "AccessLog.h"
+
+namespace MC
+{
+    namespace
+    {
+        constexpr const char* s_cacheStatusNames[] = { "-", "HIT", "MISS", "STREAM", "STALE", "COALESCED", "DISK", "REVALIDATED" };
+
+        template<typename T>
+        void AppendNumber(std::string& out, T value)
+        {
+            char buf[24];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, end);
+        }
+
+        // Quoted fields: escape quotes, backslashes, control characters and non-ASCII bytes like NGINX does,
+        // the bytes are logged as sent so a JSON line stays valid whatever the encoding of the request
+        void AppendEscaped(std::string& out, std::string_view value, bool json)
+        {
+            static constexpr char hex[] = "0123456789abcdef";
+            for(char c : value)
+            {
+                unsigned char u = static_cast<unsigned char>(c);
+                if(c == '"' || c == '\\')
+                {
+                    out.push_back('\\');
+                    out.push_back(c);
+                }
+                else if(u < 0x20 || u >= 0x7f)
+                {
+                    out.append(json ? "\\u00" : "\\x");
+                    out.push_back(hex[u >> 4]);
+                    out.push_back(hex[u & 0xf]);
+                }
+                else
+                    out.push_back(c);
+            }
+        }
+
+        void AppendField(std::string& out, std::string_view value, bool json)
+        {
+            if(value.empty() && !json)
+                out.push_back('-');
+            else
+                AppendEscaped(out, value, json);
+        }
+
+        /// @brief Current time formatted for both layouts, refreshed at most once per second per thread
+        struct TimestampCache
+        {
+            time_t second = -1;
+            char combined[64] = {};
+            char iso[64] = {};
+
+            void Update()
+            {
+                time_t now = std::time(nullptr);
+                if(now == second)
+                    return;
+
+                second = now;
+                std::tm tm{};
+#ifdef _WIN32
+                gmtime_s(&tm, &now);
+#else
+                gmtime_r(&now, &tm);
+#endif
+                static constexpr const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+                snprintf(combined, sizeof(combined), "%02d/%s/%04d:%02d:%02d:%02d +0000",
+                    tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+                snprintf(iso, sizeof(iso), "%04d-%02d-%02dT%02d:%02d:%02dZ",
+                    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+            }
+        };
+    }
+
+    bool ParseAccessLogFormat(std::string_view name, AccessLogFormat& outFormat)
+    {
+        if(name == "combined")
+            outFormat = AccessLogFormat::Combined;
+        else if(name == "json")
+            outFormat = AccessLogFormat::Json;
+        else
+            return false;
+        return true;
+    }
+
+    std::string_view FormatAccessLog(AccessLogFormat format, const AccessLogEntry& entry)
+    {
+        thread_local std::string line;
+        thread_local TimestampCache timestamp;
+
+        line.clear();
+        timestamp.Update();
+        const char* cacheStatus = s_cacheStatusNames[static_cast<size_t>(entry.cacheStatus)];
+
+        if(format == AccessLogFormat::Combined)
+        {
+            // 127.0.0.1 - - [10/Oct/2000:13:55:36 +0000] "GET /a.txt HTTP/1.1" 200 2326 "-" "curl/8.0" 153 HIT https
+            AppendField(line, entry.remoteAddr, false);
+            line.append(" - - [");
+            line.append(timestamp.combined);
+            line.append("] \"");
+            AppendEscaped(line, entry.method, false);
+            line.push_back(' ');
+            AppendEscaped(line, entry.target, false);
+            line.push_back(' ');
+            AppendEscaped(line, entry.version, false);
+            line.append("\" ");
+            AppendNumber(line, entry.status);
+            line.push_back(' ');
+            AppendNumber(line, entry.bytesSent);
+            line.append(" \"");
+            AppendField(line, entry.referer, false);
+            line.append("\" \"");
+            AppendField(line, entry.userAgent, false);
+            line.append("\" ");
+            AppendNumber(line, entry.latencyUs);
+            line.push_back(' ');
+            line.append(cacheStatus);
+            line.append(entry.tls ? " https" : " http");
+        }
+        else
+        {
+            line.append("{\"time\":\"");
+            line.append(timestamp.iso);
+            line.append("\",\"remote_addr\":\"");
+            AppendField(line, entry.remoteAddr, true);
+            line.append("\",\"method\":\"");
+            AppendField(line, entry.method, true);
+            line.append("\",\"target\":\"");
+            AppendField(line, entry.target, true);
+            line.append("\",\"protocol\":\"");
+            AppendField(line, entry.version, true);
+            line.append("\",\"status\":");
+            AppendNumber(line, entry.status);
+            line.append(",\"bytes_sent\":");
+            AppendNumber(line, entry.bytesSent);
+            line.append(",\"latency_us\":");
+            AppendNumber(line, entry.latencyUs);
+            line.append(",\"cache\":\"");
+            line.append(cacheStatus);
+            line.append("\",\"tls\":");
+            line.append(entry.tls ? "true" : "false");
+            line.append(",\"referer\":\"");
+            AppendField(line, entry.referer, true);
+            line.append("\",\"user_agent\":\"");
+            AppendField(line, entry.userAgent, true);
+            line.append("\"}");
+        }
+
+        return line;
+    }
+}
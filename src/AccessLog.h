@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Layout of the access log lines
+    enum class AccessLogFormat
+    {
+        Combined,   // Apache/NGINX combined log format, followed by latency, cache status and scheme
+        Json        // One JSON object per line
+    };
+
+    /// @brief How the cache took part in a response
+    enum class CacheStatus
+    {
+        None,       // Not a file response
+        Hit,
+        Miss,
+        Stream,     // Streamed from disk without being cached
+        Stale,      // Expired but served while being refreshed in the background
+        Coalesced,  // Missed, got the file read by a concurrent request
+        Disk,       // Missed in memory, found in the disk cache of the origin mode
+        Revalidated // Expired copy confirmed by the origin with a 304
+    };
+
+    /// @brief Fields of one access log line. Views must stay valid until the line is formatted.
+    struct AccessLogEntry
+    {
+        std::string_view remoteAddr;
+        std::string_view method;
+        std::string_view target;
+        std::string_view version;
+        std::string_view referer;
+        std::string_view userAgent;
+        int status = 0;
+        uint64_t bytesSent = 0;
+        uint64_t latencyUs = 0;
+        CacheStatus cacheStatus = CacheStatus::None;
+        bool tls = false;
+    };
+
+    /// @brief Parses a format name (combined, json)
+    /// @param[in] name Format name
+    /// @param[out] outFormat Parsed format
+    /// @return Success
+    bool ParseAccessLogFormat(std::string_view name, AccessLogFormat& outFormat);
+
+    /// @brief Formats an access log line in a per-thread buffer. Once the buffer has grown to the longest line,
+    /// formatting does not allocate anymore.
+    /// @param format Layout of the line
+    /// @param entry Fields of the line
+    /// @return View on the line, valid until the next call on the same thread
+    std::string_view FormatAccessLog(AccessLogFormat format, const AccessLogEntry& entry);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Bounded lock-free multi producer / single consumer queue, based on the sequence numbered ring of Dmitry Vyukov.
+    /// Producers claim a slot with a single CAS and never wait for each other or for the consumer.
+    /// Slots are reused in place, so values that own memory (e.g. std::string) keep their capacity and stop allocating once warm.
+    /// @tparam T Slot type, must be default constructible
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        /// @brief Creates the queue
+        /// @param capacity Number of slots, rounded up to a power of two
+        BoundedQueue(size_t capacity)
+            : m_cells{ nullptr }
+            , m_mask{ std::bit_ceil(std::max<size_t>(capacity, 2)) - 1 }
+            , m_enqueuePos{ 0 }
+            , m_dequeuePos{ 0 }
+        {
+            m_cells = std::make_unique<Cell[]>(m_mask + 1);
+            for(size_t i = 0; i <= m_mask; i++)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        /// @brief Pushes a value, safe to call from any thread
+        /// @param writer Callback receiving the slot to fill, e.g. [&](std::string& slot) { slot.assign(msg); }
+        /// @return False if the queue is full
+        template<typename F>
+        bool TryPush(F&& writer)
+        {
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            Cell* cell = nullptr;
+            for(;;)
+            {
+                cell = &m_cells[pos & m_mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+                if(diff == 0)
+                {
+                    if(m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if(diff < 0)
+                    return false;
+                else
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+
+            writer(cell->value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// @brief Pops a value, must only be called by the consumer thread
+        /// @param reader Callback receiving the slot to consume, the slot is reused after the callback returns
+        /// @return False if the queue is empty
+        template<typename F>
+        bool TryPop(F&& reader)
+        {
+            size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+            Cell& cell = m_cells[pos & m_mask];
+            if(cell.sequence.load(std::memory_order_acquire) != pos + 1)
+                return false;
+
+            reader(cell.value);
+            cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+            m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /// @brief Approximate number of queued values
+        size_t Size() const
+        {
+            size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+            size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+
+        /// @brief Number of slots
+        size_t Capacity() const { return m_mask + 1; }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+
+        //! Producers and consumer positions live on separate cache lines to avoid false sharing
+        alignas(64) std::atomic<size_t> m_enqueuePos;
+        alignas(64) std::atomic<size_t> m_dequeuePos;
+    };
+}
@@ -1,31 +1,398 @@
 #include "Cache.h"
 
+#include "Logger.h"
+
 namespace MC
 {
-    Cache::Cache()
-        : m_cache{}
+    namespace
+    {
+        // Share of a shard reserved to the protected segment
+        constexpr size_t s_protectedPercent = 80;
+
+        // Resolution of the expiry engine, matches the granularity of the TTL setting
+        constexpr std::chrono::seconds s_expiryTick{ 1 };
+    }
+
+    Cache::Cache(size_t shardCount)
+        : m_shards{ nullptr }
+        , m_shardCount{ std::bit_ceil(std::max<size_t>(shardCount, 1)) }
+        , m_maxShardBytes{ 0 }
+        , m_maxShardEntries{ 0 }
         , m_ttl{ 3600 }
+        , m_staleWindow{ 0 }
+        , m_logger{ nullptr }
+        , m_expiryThread{}
+        , m_expiryMtx{}
+        , m_expiryCv{}
+        , m_shouldStop{ false }
+    {
+        m_shards = std::make_unique<Shard[]>(m_shardCount);
+        m_expiryThread = std::thread(&Cache::ExpireLoop, this);
+    }
+
+    Cache::~Cache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_expiryMtx);
+            m_shouldStop = true;
+        }
+        m_expiryCv.notify_one();
+        m_expiryThread.join();
+    }
+
+    void Cache::SetCapacity(size_t maxBytes, size_t maxEntries)
+    {
+        m_maxShardBytes = maxBytes / m_shardCount;
+        m_maxShardEntries = (maxEntries + m_shardCount - 1) / m_shardCount;
+
+        if(maxBytes > 0 && m_maxShardBytes == 0)
+            m_maxShardBytes = 1;
+
+        // The sketch must track more keys than the shard can hold, to remember the popularity of evicted files
+        size_t sketchWidth = m_maxShardEntries > 0 ? m_maxShardEntries * 4 : 1024;
+
+        for(size_t i = 0; i < m_shardCount; i++)
+        {
+            std::lock_guard<std::mutex> lock(m_shards[i].mtx);
+            m_shards[i].sketch = FrequencySketch(sketchWidth);
+        }
+    }
+
+    bool Cache::AddCachedFile(const fs::path& filePath, FilePtr fileData)
     {
+        return AddCachedFile(filePath, std::move(fileData), m_ttl, true);
     }
 
-    bool Cache::AddCachedFile(const fs::path& filePath, const std::string& fileData)
+    bool Cache::AddCachedFile(const fs::path& filePath, FilePtr fileData, int ttlSeconds, bool serveStale)
     {
-        if(m_cache.contains(filePath))
+        if(!fileData)
+            return false;
+
+        size_t hash = fs::hash_value(filePath);
+        Shard& shard = GetShard(hash);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.files.find(filePath);
+        if(m_maxShardBytes > 0 && fileData->GetTotalSize() > m_maxShardBytes)
+        {
+            // The new data does not fit anymore, drop the stale version
+            if(it != shard.files.end())
+            {
+                Erase(shard, it);
+                shard.stats.evictions++;
+            }
+            return false;
+        }
+
+        if(it != shard.files.end())
+        {
+            it->second.ttl = ttlSeconds;
+            it->second.serveStale = serveStale;
+            return Refresh(shard, it, std::move(fileData));
+        }
+
+        if(!MakeRoom(shard, hash, fileData->GetTotalSize()))
+        {
+            shard.stats.rejections++;
             return false;
+        }
 
-        m_cache[filePath] = fileData;
+        size_t size = fileData->GetTotalSize();
+        it = shard.files.try_emplace(filePath, Entry{ std::move(fileData), hash, Clock::time_point::max(), {}, Segment::Probation, {}, false, ttlSeconds, serveStale }).first;
 
-        m_timer.add(std::chrono::seconds(m_ttl), [this, filePath](CppTime::timer_id) { std::cout << "Erasing " << std::quoted(filePath.filename().string()) << " from cache\n"; m_cache.erase(filePath); });
+        Entry& entry = it->second;
+        shard.probation.push_front(&it->first);
+        entry.position = shard.probation.begin();
+        ScheduleExpiry(shard, it);
+        shard.bytes += size;
+        shard.stats.insertions++;
 
         return true;
     }
 
-    bool Cache::GetCachedFile(const fs::path& filePath, std::string& outData)
+    bool Cache::GetCachedFile(const fs::path& filePath, FilePtr& outData)
     {
-        if(!m_cache.contains(filePath))
+        bool stale = false;
+        bool refresh = false;
+        return GetCachedFile(filePath, outData, stale, refresh);
+    }
+
+    bool Cache::GetCachedFile(const fs::path& filePath, FilePtr& outData, bool& outStale, bool& outRefresh)
+    {
+        outStale = false;
+        outRefresh = false;
+
+        size_t hash = fs::hash_value(filePath);
+        Shard& shard = GetShard(hash);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        // Misses are recorded too, so that a file becomes admissible after being requested a few times
+        shard.sketch.Increment(hash);
+
+        auto it = shard.files.find(filePath);
+        if(it == shard.files.end())
+        {
+            shard.stats.misses++;
             return false;
+        }
+
+        Entry& entry = it->second;
+        Clock::time_point now = Clock::now();
+        if(entry.expiry <= now)
+        {
+            // Expire lazily, the expiry thread may not have reached this file yet
+            if(!entry.serveStale || entry.expiry + std::chrono::seconds(m_staleWindow) <= now)
+            {
+                Erase(shard, it);
+                shard.stats.expirations++;
+                shard.stats.misses++;
+                return false;
+            }
 
-        outData = m_cache[filePath];
+            // Still within the stale window: served as is, only the first lookup is asked to reload it
+            outStale = true;
+            outRefresh = !entry.refreshing;
+            entry.refreshing = true;
+            shard.stats.staleHits++;
+        }
+
+        Promote(shard, entry);
+        outData = entry.data;
+        shard.stats.hits++;
         return true;
     }
-}
\ No newline at end of file
+
+    bool Cache::RemoveCachedFile(const fs::path& filePath)
+    {
+        size_t hash = fs::hash_value(filePath);
+        Shard& shard = GetShard(hash);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.files.find(filePath);
+        if(it == shard.files.end())
+            return false;
+
+        Erase(shard, it);
+        shard.stats.invalidations++;
+        return true;
+    }
+
+    Cache::Stats Cache::GetStats() const
+    {
+        Stats total;
+        for(size_t i = 0; i < m_shardCount; i++)
+        {
+            Shard& shard = m_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            total.hits += shard.stats.hits;
+            total.misses += shard.stats.misses;
+            total.staleHits += shard.stats.staleHits;
+            total.insertions += shard.stats.insertions;
+            total.rejections += shard.stats.rejections;
+            total.evictions += shard.stats.evictions;
+            total.expirations += shard.stats.expirations;
+            total.invalidations += shard.stats.invalidations;
+            total.entries += shard.files.size();
+            total.bytes += shard.bytes;
+        }
+        return total;
+    }
+
+    std::vector<std::pair<fs::path, uint32_t>> Cache::GetHotFiles(size_t maxCount) const
+    {
+        std::vector<std::pair<fs::path, uint32_t>> files;
+        for(size_t i = 0; i < m_shardCount; i++)
+        {
+            Shard& shard = m_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            for(const auto& [filePath, entry] : shard.files)
+                files.emplace_back(filePath, shard.sketch.Frequency(entry.hash));
+        }
+
+        auto hottest = files.begin() + std::min(maxCount, files.size());
+        std::partial_sort(files.begin(), hottest, files.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        files.erase(hottest, files.end());
+        return files;
+    }
+
+    void Cache::RecordAccesses(const fs::path& filePath, uint32_t count)
+    {
+        size_t hash = fs::hash_value(filePath);
+        Shard& shard = GetShard(hash);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        // The counters saturate quickly, there is no point in replaying more requests
+        for(uint32_t i = 0; i < std::min<uint32_t>(count, 15); i++)
+            shard.sketch.Increment(hash);
+    }
+
+    Cache::Shard& Cache::GetShard(size_t hash) const
+    {
+        return m_shards[hash & (m_shardCount - 1)];
+    }
+
+    bool Cache::MakeRoom(Shard& shard, size_t hash, size_t size)
+    {
+        size_t excessBytes = (m_maxShardBytes > 0 && shard.bytes + size > m_maxShardBytes) ? shard.bytes + size - m_maxShardBytes : 0;
+        size_t excessEntries = (m_maxShardEntries > 0 && shard.files.size() + 1 > m_maxShardEntries) ? shard.files.size() + 1 - m_maxShardEntries : 0;
+
+        if(excessBytes == 0 && excessEntries == 0)
+            return true;
+
+        // Walk the eviction candidates, least valuable first, and reject the new file if any of them is at least as popular
+        uint8_t candidateFrequency = shard.sketch.Frequency(hash);
+        size_t victims = 0;
+        size_t freedBytes = 0;
+
+        auto visit = [&](const LruList& list)
+            {
+                for(auto it = list.rbegin(); it != list.rend() && (freedBytes < excessBytes || victims < excessEntries); ++it)
+                {
+                    const Entry& victim = shard.files.find(**it)->second;
+                    if(shard.sketch.Frequency(victim.hash) >= candidateFrequency)
+                        return false;
+
+                    freedBytes += victim.data->GetTotalSize();
+                    victims++;
+                }
+                return true;
+            };
+
+        if(!visit(shard.probation) || !visit(shard.protectedSegment))
+            return false;
+
+        for(; victims > 0; victims--)
+        {
+            LruList& list = shard.probation.empty() ? shard.protectedSegment : shard.probation;
+            Erase(shard, shard.files.find(*list.back()));
+            shard.stats.evictions++;
+        }
+
+        return true;
+    }
+
+    void Cache::Promote(Shard& shard, Entry& entry)
+    {
+        if(entry.segment == Segment::Protected)
+        {
+            shard.protectedSegment.splice(shard.protectedSegment.begin(), shard.protectedSegment, entry.position);
+            return;
+        }
+
+        shard.protectedSegment.splice(shard.protectedSegment.begin(), shard.probation, entry.position);
+        entry.segment = Segment::Protected;
+        shard.protectedBytes += entry.data->GetTotalSize();
+
+        // Demote the oldest protected files back to probation when the protected segment outgrows its share
+        size_t maxProtectedBytes = m_maxShardBytes * s_protectedPercent / 100;
+        size_t maxProtectedEntries = m_maxShardEntries * s_protectedPercent / 100;
+
+        while(shard.protectedSegment.size() > 1 &&
+            ((m_maxShardBytes > 0 && shard.protectedBytes > maxProtectedBytes) ||
+                (m_maxShardEntries > 0 && shard.protectedSegment.size() > maxProtectedEntries)))
+        {
+            auto oldest = std::prev(shard.protectedSegment.end());
+            Entry& demoted = shard.files.find(**oldest)->second;
+            shard.probation.splice(shard.probation.begin(), shard.protectedSegment, oldest);
+            demoted.segment = Segment::Probation;
+            shard.protectedBytes -= demoted.data->GetTotalSize();
+        }
+    }
+
+    bool Cache::Refresh(Shard& shard, std::unordered_map<fs::path, Entry>::iterator it, FilePtr fileData)
+    {
+        Entry& entry = it->second;
+        size_t oldSize = entry.data->GetTotalSize();
+        size_t newSize = fileData->GetTotalSize();
+
+        shard.bytes = shard.bytes - oldSize + newSize;
+        if(entry.segment == Segment::Protected)
+            shard.protectedBytes = shard.protectedBytes - oldSize + newSize;
+        entry.data = std::move(fileData);
+
+        shard.wheel.Cancel(entry.timer);
+        ScheduleExpiry(shard, it);
+
+        // Bigger data may overflow the shard, evict the least recently used files other than the refreshed one
+        auto oldestOther = [&](const LruList& list) -> const fs::path*
+            {
+                for(auto victim = list.rbegin(); victim != list.rend(); ++victim)
+                    if(*victim != &it->first)
+                        return *victim;
+                return nullptr;
+            };
+
+        while(m_maxShardBytes > 0 && shard.bytes > m_maxShardBytes)
+        {
+            const fs::path* victim = oldestOther(shard.probation);
+            if(!victim)
+                victim = oldestOther(shard.protectedSegment);
+            if(!victim)
+                break;
+            Erase(shard, shard.files.find(*victim));
+            shard.stats.evictions++;
+        }
+
+        return true;
+    }
+
+    void Cache::ScheduleExpiry(Shard& shard, std::unordered_map<fs::path, Entry>::iterator it)
+    {
+        // Without TTL files stay until evicted or invalidated
+        Entry& entry = it->second;
+        entry.refreshing = false;
+        if(entry.ttl <= 0)
+        {
+            entry.expiry = Clock::time_point::max();
+            return;
+        }
+
+        entry.expiry = Clock::now() + std::chrono::seconds(entry.ttl);
+        entry.timer = shard.wheel.Schedule(&it->first, entry.expiry + std::chrono::seconds(entry.serveStale ? m_staleWindow : 0));
+    }
+
+    void Cache::Erase(Shard& shard, std::unordered_map<fs::path, Entry>::iterator it)
+    {
+        Entry& entry = it->second;
+        size_t size = entry.data->GetTotalSize();
+
+        shard.wheel.Cancel(entry.timer);
+
+        if(entry.segment == Segment::Protected)
+        {
+            shard.protectedSegment.erase(entry.position);
+            shard.protectedBytes -= size;
+        }
+        else
+            shard.probation.erase(entry.position);
+
+        shard.bytes -= size;
+        shard.files.erase(it);
+    }
+
+    void Cache::ExpireLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_expiryMtx);
+        while(!m_expiryCv.wait_for(lock, s_expiryTick, [this]() { return m_shouldStop; }))
+        {
+            Clock::time_point now = Clock::now();
+            Logger* logger = m_logger.load();
+            for(size_t i = 0; i < m_shardCount; i++)
+            {
+                Shard& shard = m_shards[i];
+                std::lock_guard<std::mutex> shardLock(shard.mtx);
+                shard.wheel.Advance(now, [&](const fs::path* filePath)
+                    {
+                        auto it = shard.files.find(*filePath);
+                        if(logger)
+                            MC_LOG_DEBUG(*logger, "Erasing \"", filePath->filename(), "\" from cache");
+
+                        // The wheel already dropped the timer
+                        it->second.timer = {};
+                        Erase(shard, it);
+                        shard.stats.expirations++;
+                    });
+            }
+        }
+    }
+}
@@ -1,40 +1,184 @@
 #pragma once
 
 #include "Defines.h"
-#include "cpptime/cpptime.h"
+#include "CachedFile.h"
+#include "FrequencySketch.h"
+#include "TimingWheel.h"
 
 namespace MC
 {
-    /// @brief This class represets the server side file cache system. Files can be read from disk using a data stream and stored in a common std::string.
-    /// This class offers a simple TTL functionality to manage data lifetime.
+    class Logger;
+
+    /// @brief This class represets the server side file cache system. Files are stored as immutable, reference counted CachedFile objects,
+    /// holding every encoded variant of the file, so that a cache hit can be handed to the network layer without copying the file data.
+    /// The cache is split in independently locked shards, so that concurrent workers only contend when they touch the same shard.
+    /// Each shard is bounded in size and evicts with a segmented LRU policy, guarded by a TinyLFU admission filter so that
+    /// files requested only once cannot push hot files out of the cache.
+    /// This class also offers a TTL functionality to manage data lifetime: expired files are never returned, and a single
+    /// background thread reclaims them through a timing wheel per shard, so scheduling and cancelling an expiry is O(1).
+    /// An optional stale window keeps serving expired files for a while, so that the caller can refresh them in the background
+    /// instead of letting every request of a hot file miss at once.
     class Cache
     {
-        using FileData = std::string;
-
     public:
-        Cache();
-        ~Cache() = default;
+        using FilePtr = std::shared_ptr<const CachedFile>;
+
+        /// @brief Activity counters and current occupancy of the cache
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t staleHits = 0;         // Hits on expired files within the stale window, also counted in hits
+            uint64_t insertions = 0;
+            uint64_t rejections = 0;        // Files refused by the admission filter
+            uint64_t evictions = 0;         // Files dropped to make room
+            uint64_t expirations = 0;       // Files dropped by the TTL
+            uint64_t invalidations = 0;     // Files removed with RemoveCachedFile
+            size_t entries = 0;
+            size_t bytes = 0;
+        };
+
+        /// @brief Creates the cache
+        /// @param shardCount Number of independently locked shards, rounded up to a power of two
+        Cache(size_t shardCount = 16);
+        ~Cache();
 
         /// @brief Set the ttl for cached files
-        /// @param seconds time in seconds
+        /// @param seconds time in seconds, 0 disables the expiry (files then stay until evicted or removed)
         void SetTTL(int seconds) { m_ttl = seconds; }
 
-        /// @brief Add a file to the cache
+        /// @brief Set how long expired files keep being served while they are refreshed (stale-while-revalidate)
+        /// @param seconds time in seconds after the TTL, 0 expires files right at their TTL
+        void SetStaleWindow(int seconds) { m_staleWindow = seconds; }
+
+        /// @brief Set the logger used for diagnostic messages
+        /// @param logger Logger, may be null, must outlive the cache or be reset before being destroyed
+        void SetLogger(Logger* logger) { m_logger = logger; }
+
+        /// @brief Set the memory limits of the cache, all the variants of a file are accounted. The limits are split evenly between the shards,
+        /// so a single file larger than maxBytes / shard count is never cached.
+        /// @param maxBytes Maximum size of the cached data in bytes, 0 means unlimited
+        /// @param maxEntries Maximum number of cached files, 0 means unlimited
+        void SetCapacity(size_t maxBytes, size_t maxEntries);
+
+        /// @brief Add a file to the cache. When the cache is full, the file is only admitted if it has been requested
+        /// more often than the files it would evict. Adding a file that is already cached replaces its data and restarts its TTL.
         /// @param[in] filePath Path of the file on disk, used as key to store the data
-        /// @param[in] fileData Data stored in a std::string
+        /// @param[in] fileData Shared file content, with all its variants
         /// @return Success
-        bool AddCachedFile(const fs::path& filePath, const std::string& fileData);
+        bool AddCachedFile(const fs::path& filePath, FilePtr fileData);
+
+        /// @brief Add a file to the cache with its own lifetime instead of the TTL of the cache, e.g. as set by an origin
+        /// @param[in] filePath Path of the file, used as key to store the data
+        /// @param[in] fileData Shared file content, with all its variants
+        /// @param[in] ttlSeconds Time to live in seconds, 0 disables the expiry
+        /// @param[in] serveStale Whether the file may be served within the stale window once expired
+        /// @return Success
+        bool AddCachedFile(const fs::path& filePath, FilePtr fileData, int ttlSeconds, bool serveStale);
 
         /// @brief Gets a file from the cache, if present
         /// @param[in] filePath Path of the file on disk, used as key to store the data
-        /// @param[out] outData Output data stored in a std::string
+        /// @param[out] outData Shared file content, no data is copied
+        /// @return Success
+        bool GetCachedFile(const fs::path& filePath, FilePtr& outData);
+
+        /// @brief Gets a file from the cache, if present, including an expired file still within the stale window
+        /// @param[in] filePath Path of the file on disk, used as key to store the data
+        /// @param[out] outData Shared file content, no data is copied
+        /// @param[out] outStale Set when the file is past its TTL
+        /// @param[out] outRefresh Set for the first lookup of a stale file only: the caller is expected to reload it with AddCachedFile
         /// @return Success
-        bool GetCachedFile(const fs::path& filePath, std::string& outData);
+        bool GetCachedFile(const fs::path& filePath, FilePtr& outData, bool& outStale, bool& outRefresh);
+
+        /// @brief Removes a file from the cache, e.g. because it changed on disk
+        /// @param filePath Path of the file on disk, used as key to store the data
+        /// @return True if the file was cached
+        bool RemoveCachedFile(const fs::path& filePath);
+
+        /// @brief Sums the statistics of every shard. The counters live in the shards and are updated under their locks,
+        /// so the request path pays nothing extra for them.
+        /// @return Statistics
+        Stats GetStats() const;
+
+        /// @brief Lists the cached files with their estimated access frequency, most requested first
+        /// @param maxCount Maximum number of files returned
+        /// @return Paths and frequencies
+        std::vector<std::pair<fs::path, uint32_t>> GetHotFiles(size_t maxCount) const;
+
+        /// @brief Records past requests of a file, e.g. restored from a snapshot, so that the admission filter knows its popularity
+        /// @param filePath Path of the file on disk
+        /// @param count Number of requests to record
+        void RecordAccesses(const fs::path& filePath, uint32_t count);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        using LruList = std::list<const fs::path*>;
+        using ExpiryWheel = TimingWheel<const fs::path*>;
+
+        enum class Segment
+        {
+            Probation,
+            Protected
+        };
+
+        struct Entry
+        {
+            FilePtr data;
+            size_t hash;
+            Clock::time_point expiry;
+            ExpiryWheel::Handle timer;
+            Segment segment;
+            LruList::iterator position;
+            bool refreshing = false;    // A stale lookup already asked for a reload
+            int ttl = 0;
+            bool serveStale = true;
+        };
+
+        struct Shard
+        {
+            std::mutex mtx;
+            std::unordered_map<fs::path, Entry> files;
+            LruList probation;          // Files seen once since they were admitted, most recent first
+            LruList protectedSegment;   // Files hit at least twice, most recent first
+            size_t bytes = 0;
+            size_t protectedBytes = 0;
+            FrequencySketch sketch;
+            ExpiryWheel wheel;
+            Stats stats;
+        };
+
+        Shard& GetShard(size_t hash) const;
+
+        /// @brief Evicts enough files to make room for a new one, if the TinyLFU filter admits it
+        bool MakeRoom(Shard& shard, size_t hash, size_t size);
+
+        /// @brief Moves a file that got a hit to the front of the protected segment
+        void Promote(Shard& shard, Entry& entry);
+
+        /// @brief Replaces the data of a cached file and restarts its TTL
+        bool Refresh(Shard& shard, std::unordered_map<fs::path, Entry>::iterator it, FilePtr fileData);
+
+        /// @brief Sets the expiry of an entry from its TTL and schedules its timer at the end of the stale window
+        void ScheduleExpiry(Shard& shard, std::unordered_map<fs::path, Entry>::iterator it);
+
+        void Erase(Shard& shard, std::unordered_map<fs::path, Entry>::iterator it);
+
+        /// @brief Body of the expiry thread, advances the timing wheel of every shard once per tick
+        void ExpireLoop();
 
     private:
-        std::unordered_map<fs::path, FileData> m_cache;
+        std::unique_ptr<Shard[]> m_shards;
+        size_t m_shardCount;
+        size_t m_maxShardBytes;
+        size_t m_maxShardEntries;
         int m_ttl;
-        CppTime::Timer m_timer;
+        int m_staleWindow;
+        std::atomic<Logger*> m_logger;
+
+        std::thread m_expiryThread;
+        std::mutex m_expiryMtx;
+        std::condition_variable m_expiryCv;
+        bool m_shouldStop;
     };
 
-}
\ No newline at end of file
+}
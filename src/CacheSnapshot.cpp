@@ -0,0 +1,98 @@
+#include "CacheSnapshot.h"
+
+namespace MC
+{
+    namespace
+    {
+        constexpr char s_magic[4] = { 'M', 'C', 'S', 'N' };
+        constexpr uint32_t s_version = 1;
+
+        template<typename T>
+        void WriteValue(std::string& out, T value)
+        {
+            // Fixed little endian layout, so that a snapshot survives a move to another machine
+            for(size_t i = 0; i < sizeof(T); i++)
+                out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+
+        template<typename T>
+        bool ReadValue(std::string_view& in, T& value)
+        {
+            if(in.size() < sizeof(T))
+                return false;
+
+            value = 0;
+            for(size_t i = 0; i < sizeof(T); i++)
+                value |= static_cast<T>(static_cast<unsigned char>(in[i])) << (8 * i);
+            in.remove_prefix(sizeof(T));
+            return true;
+        }
+    }
+
+    bool SaveCacheSnapshot(const fs::path& snapshotPath, const std::vector<SnapshotEntry>& entries)
+    {
+        // The count is written once the entries with a path too long for the format have been skipped
+        std::string records;
+        uint32_t count = 0;
+        for(const SnapshotEntry& entry : entries)
+        {
+            if(entry.path.size() > std::numeric_limits<uint16_t>::max())
+                continue;
+
+            WriteValue(records, entry.frequency);
+            WriteValue(records, static_cast<uint16_t>(entry.path.size()));
+            records += entry.path;
+            count++;
+        }
+
+        std::string data(s_magic, sizeof(s_magic));
+        WriteValue(data, s_version);
+        WriteValue(data, count);
+        data += records;
+
+        fs::path tempPath = snapshotPath;
+        tempPath += ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if(!file.write(data.data(), static_cast<std::streamsize>(data.size())))
+                return false;
+        }
+
+        std::error_code ec;
+        fs::rename(tempPath, snapshotPath, ec);
+        return !ec;
+    }
+
+    bool LoadCacheSnapshot(const fs::path& snapshotPath, std::vector<SnapshotEntry>& outEntries)
+    {
+        std::ifstream file(snapshotPath, std::ios::binary);
+        if(!file)
+            return false;
+
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::string_view in(data);
+        if(in.size() < sizeof(s_magic) || in.substr(0, sizeof(s_magic)) != std::string_view(s_magic, sizeof(s_magic)))
+            return false;
+        in.remove_prefix(sizeof(s_magic));
+
+        uint32_t version = 0;
+        uint32_t count = 0;
+        if(!ReadValue(in, version) || version != s_version || !ReadValue(in, count))
+            return false;
+
+        outEntries.clear();
+        outEntries.reserve(std::min<size_t>(count, in.size() / 6));
+        for(uint32_t i = 0; i < count; i++)
+        {
+            SnapshotEntry entry;
+            uint16_t length = 0;
+            if(!ReadValue(in, entry.frequency) || !ReadValue(in, length) || in.size() < length)
+                return false;
+
+            entry.path.assign(in.substr(0, length));
+            in.remove_prefix(length);
+            outEntries.push_back(std::move(entry));
+        }
+        return true;
+    }
+}
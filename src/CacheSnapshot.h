@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Access frequency of a file, as recorded in a cache snapshot
+    struct SnapshotEntry
+    {
+        std::string path;       // Relative to the content directory, generic format
+        uint32_t frequency;
+    };
+
+    /// @brief Writes a cache snapshot, a compact binary manifest of the hottest files. The file is replaced atomically,
+    /// a crash while saving leaves the previous snapshot intact.
+    /// Layout (little endian): "MCSN", u32 version, u32 entry count, then per entry u32 frequency, u16 path length, path bytes.
+    /// @param snapshotPath Destination file
+    /// @param entries Entries, hottest first
+    /// @return Success
+    bool SaveCacheSnapshot(const fs::path& snapshotPath, const std::vector<SnapshotEntry>& entries);
+
+    /// @brief Reads a cache snapshot written by SaveCacheSnapshot
+    /// @param[in] snapshotPath Snapshot file
+    /// @param[out] outEntries Entries, hottest first
+    /// @return False if the file is missing or malformed
+    bool LoadCacheSnapshot(const fs::path& snapshotPath, std::vector<SnapshotEntry>& outEntries);
+}
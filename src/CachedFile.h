@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    struct FileMetadata;
+
+    /// @brief Content codings a file can be served with
+    enum class ContentEncoding : uint8_t
+    {
+        Identity,
+        Gzip,
+        Brotli,
+        Zstd,
+        Count
+    };
+
+    /// @brief Immutable content of a cached file: the identity data plus the encoded variants that were produced or found on disk
+    /// when the file was loaded. Variants are never computed on the request path.
+    class CachedFile
+    {
+    public:
+        /// @brief Creates the file with its identity data
+        /// @param identity Raw file content
+        explicit CachedFile(std::string identity)
+            : m_totalSize{ identity.size() }
+        {
+            m_variants[static_cast<size_t>(ContentEncoding::Identity)] = std::move(identity);
+        }
+
+        /// @brief Stores an encoded variant of the file, only meant to be called before the file is shared
+        /// @param encoding Content coding of the data
+        /// @param data Encoded data
+        void SetVariant(ContentEncoding encoding, std::string data)
+        {
+            std::optional<std::string>& variant = m_variants[static_cast<size_t>(encoding)];
+            m_totalSize -= variant ? variant->size() : 0;
+            m_totalSize += data.size();
+            variant = std::move(data);
+        }
+
+        /// @brief Gets an encoded variant of the file
+        /// @param encoding Content coding
+        /// @return The variant data, nullptr if the file is not available with this coding
+        const std::string* GetVariant(ContentEncoding encoding) const
+        {
+            const std::optional<std::string>& variant = m_variants[static_cast<size_t>(encoding)];
+            return variant ? &*variant : nullptr;
+        }
+
+        /// @brief Attaches the metadata of a file that is not in the index, such as an object pulled from the origin.
+        /// Only meant to be called before the file is shared.
+        /// @param metadata Size, content type and validators of the file
+        void SetMetadata(std::shared_ptr<const FileMetadata> metadata) { m_metadata = std::move(metadata); }
+
+        /// @brief Gets the metadata attached with SetMetadata
+        /// @return The metadata, nullptr for the files of the content directory, whose metadata is in the index
+        const std::shared_ptr<const FileMetadata>& GetMetadata() const { return m_metadata; }
+
+        /// @brief Checks if the file is available with any coding other than identity
+        /// @return Bool result
+        bool HasEncodedVariants() const
+        {
+            for(size_t i = static_cast<size_t>(ContentEncoding::Identity) + 1; i < static_cast<size_t>(ContentEncoding::Count); i++)
+                if(m_variants[i])
+                    return true;
+            return false;
+        }
+
+        /// @brief Size of the raw file content in bytes
+        size_t GetSize() const { return GetVariant(ContentEncoding::Identity)->size(); }
+
+        /// @brief Memory used by all the variants in bytes, used for the cache accounting
+        size_t GetTotalSize() const { return m_totalSize; }
+
+    private:
+        std::optional<std::string> m_variants[static_cast<size_t>(ContentEncoding::Count)];
+        size_t m_totalSize;
+        std::shared_ptr<const FileMetadata> m_metadata;
+    };
+}
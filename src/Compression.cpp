@@ -0,0 +1,167 @@
+#include "Compression.h"
+#include "HttpUtils.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+namespace MC
+{
+    namespace
+    {
+        struct EncodingInfo
+        {
+            const char* token;
+            const char* extension;
+        };
+
+        constexpr EncodingInfo s_encodings[] = {
+            { "identity", "" },
+            { "gzip", ".gz" },
+            { "br", ".br" },
+            { "zstd", ".zst" },
+        };
+        static_assert(std::size(s_encodings) == static_cast<size_t>(ContentEncoding::Count));
+
+        bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+        {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+                [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+        }
+    }
+
+    const char* GetEncodingToken(ContentEncoding encoding)
+    {
+        return s_encodings[static_cast<size_t>(encoding)].token;
+    }
+
+    const char* GetEncodingExtension(ContentEncoding encoding)
+    {
+        return s_encodings[static_cast<size_t>(encoding)].extension;
+    }
+
+    bool IsEncodingSupported(ContentEncoding encoding)
+    {
+        switch(encoding)
+        {
+        case ContentEncoding::Identity:
+            return true;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        case ContentEncoding::Gzip:
+            return true;
+#endif
+#ifdef CPPHTTPLIB_BROTLI_SUPPORT
+        case ContentEncoding::Brotli:
+            return true;
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+        case ContentEncoding::Zstd:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    bool IsCompressibleType(const std::string& contentType)
+    {
+        // Already compressed formats (images, videos, archives...) are left out by the list of httplib
+        return httplib::detail::can_compress_content_type(contentType);
+    }
+
+    bool Compress(ContentEncoding encoding, std::string_view data, std::string& outData)
+    {
+        std::unique_ptr<httplib::detail::compressor> compressor;
+
+        switch(encoding)
+        {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        case ContentEncoding::Gzip:
+            compressor = std::make_unique<httplib::detail::gzip_compressor>();
+            break;
+#endif
+#ifdef CPPHTTPLIB_BROTLI_SUPPORT
+        case ContentEncoding::Brotli:
+            compressor = std::make_unique<httplib::detail::brotli_compressor>();
+            break;
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+        case ContentEncoding::Zstd:
+            compressor = std::make_unique<httplib::detail::zstd_compressor>();
+            break;
+#endif
+        default:
+            return false;
+        }
+
+        outData.clear();
+        return compressor->compress(data.data(), data.size(), true,
+            [&outData](const char* chunk, size_t length)
+            {
+                outData.append(chunk, length);
+                return true;
+            });
+    }
+
+    ContentEncoding SelectEncoding(const std::string& acceptEncoding, const CachedFile& file)
+    {
+        // Quality of each coding listed by name, "*" covers the others: a coding listed with q=0 stays excluded
+        constexpr size_t encodingCount = static_cast<size_t>(ContentEncoding::Count);
+        std::array<std::optional<double>, encodingCount> listedQualities;
+        std::optional<double> otherQuality;
+
+        std::string_view list(acceptEncoding);
+        while(!list.empty())
+        {
+            size_t comma = list.find(',');
+            std::string_view item = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+
+            // Split "coding;q=0.5"
+            size_t semicolon = item.find(';');
+            std::string_view coding = Trim(item.substr(0, semicolon));
+            double quality = 1.0;
+            if(semicolon != std::string_view::npos)
+            {
+                std::string_view parameter = Trim(item.substr(semicolon + 1));
+                if(parameter.starts_with("q=") || parameter.starts_with("Q="))
+                    quality = std::strtod(std::string(parameter.substr(2)).c_str(), nullptr);
+            }
+
+            if(coding == "*")
+                otherQuality = quality;
+            for(size_t i = 0; i < encodingCount; i++)
+            {
+                if(EqualsIgnoreCase(coding, GetEncodingToken(static_cast<ContentEncoding>(i))))
+                    listedQualities[i] = quality;
+            }
+        }
+
+        auto getQuality = [&](ContentEncoding encoding)
+            {
+                const std::optional<double>& listed = listedQualities[static_cast<size_t>(encoding)];
+                return listed ? *listed : otherQuality.value_or(0.0);
+            };
+
+        // A variant must be preferred at least as much as identity, which stays the fallback even when the client excludes it
+        ContentEncoding selected = ContentEncoding::Identity;
+        double selectedQuality = getQuality(ContentEncoding::Identity);
+        size_t selectedSize = file.GetSize();
+        for(size_t i = static_cast<size_t>(ContentEncoding::Identity) + 1; i < encodingCount; i++)
+        {
+            ContentEncoding encoding = static_cast<ContentEncoding>(i);
+            const std::string* variant = file.GetVariant(encoding);
+            double quality = getQuality(encoding);
+            if(!variant || quality <= 0.0)
+                continue;
+
+            if(quality > selectedQuality || (quality == selectedQuality && variant->size() < selectedSize))
+            {
+                selected = encoding;
+                selectedQuality = quality;
+                selectedSize = variant->size();
+            }
+        }
+
+        return selected;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "CachedFile.h"
+
+namespace MC
+{
+    /// @brief Gets the HTTP content-coding token of an encoding, e.g. "gzip"
+    /// @param encoding Content coding
+    /// @return Token used in Accept-Encoding and Content-Encoding
+    const char* GetEncodingToken(ContentEncoding encoding);
+
+    /// @brief Gets the extension of the precompressed sibling files of an encoding, e.g. ".gz"
+    /// @param encoding Content coding
+    /// @return File extension, empty for identity
+    const char* GetEncodingExtension(ContentEncoding encoding);
+
+    /// @brief Checks if the server was built with a compressor for an encoding
+    /// @param encoding Content coding
+    /// @return Bool result
+    bool IsEncodingSupported(ContentEncoding encoding);
+
+    /// @brief Checks if a MIME type is worth compressing
+    /// @param contentType MIME type, e.g. "text/css"
+    /// @return Bool result
+    bool IsCompressibleType(const std::string& contentType);
+
+    /// @brief Compresses a buffer
+    /// @param[in] encoding Content coding, must be supported
+    /// @param[in] data Data to compress
+    /// @param[out] outData Compressed data
+    /// @return Success
+    bool Compress(ContentEncoding encoding, std::string_view data, std::string& outData);
+
+    /// @brief Chooses the variant of a file to send, following the client Accept-Encoding preferences (RFC 9110 12.5.3).
+    /// Codings listed with q=0 are never sent, "*" only covers the codings not listed, and a variant is only sent when its quality
+    /// is at least that of identity. Among the codings with the same quality value the smallest variant wins.
+    /// @param acceptEncoding Value of the Accept-Encoding header
+    /// @param file File with its available variants
+    /// @return Selected encoding, identity when no variant is acceptable
+    ContentEncoding SelectEncoding(const std::string& acceptEncoding, const CachedFile& file);
+}
@@ -9,9 +9,31 @@
 #include <fstream>
 #include <ostream>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
+#include <cctype>
+#include <map>
 #include <queue>
+#include <deque>
+#include <list>
+#include <vector>
+#include <array>
 #include <mutex>
+#include <shared_mutex>
 #include <atomic>
 #include <iomanip>
+#include <optional>
+#include <string_view>
+#include <charconv>
+#include <type_traits>
+#include <sstream>
+#include <ctime>
+#include <chrono>
+#include <limits>
+#include <bit>
+#include <condition_variable>
+#include <memory>
+#include <future>
 
 namespace fs = std::filesystem;
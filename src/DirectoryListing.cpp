@@ -0,0 +1,296 @@
+#include "DirectoryListing.h"
+#include "DirectoryWatcher.h"
+#include "Compression.h"
+#include "HttpUtils.h"
+
+namespace MC
+{
+    namespace
+    {
+        // Same limit as the files, smaller pages barely shrink
+        constexpr size_t s_minCompressSize = 256;
+
+        void AppendHtmlEscaped(std::string& out, std::string_view value)
+        {
+            for(char c : value)
+            {
+                switch(c)
+                {
+                case '&': out += "&amp;"; break;
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                case '"': out += "&quot;"; break;
+                case '\'': out += "&#39;"; break;
+                default: out += c; break;
+                }
+            }
+        }
+
+        void AppendJsonEscaped(std::string& out, std::string_view value)
+        {
+            static constexpr char s_hex[] = "0123456789abcdef";
+            for(char c : value)
+            {
+                unsigned char u = static_cast<unsigned char>(c);
+                if(c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if(u < 0x20)
+                {
+                    out += "\\u00";
+                    out += s_hex[u >> 4];
+                    out += s_hex[u & 0xF];
+                }
+                else
+                    out += c;
+            }
+        }
+    }
+
+    DirectoryListing::DirectoryListing(const fs::path& root, size_t pageSize, bool compress)
+        : m_root{ root }
+        , m_pageSize{ std::max<size_t>(pageSize, 1) }
+        , m_compress{ compress }
+    {
+    }
+
+    bool DirectoryListing::GetPage(const fs::path& relativeDir, size_t page, Format format, FilePtr& outPage)
+    {
+        const uint64_t key = GetPageKey(page, format);
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+        auto it = m_directories.find(relativeDir);
+        if(it == m_directories.end())
+        {
+            // First request of this directory, read it without blocking the other directories
+            lock.unlock();
+            Directory scanned;
+            if(!this->ScanDirectory(m_root / relativeDir, scanned))
+                return false;
+
+            lock.lock();
+            it = m_directories.try_emplace(relativeDir, std::move(scanned)).first;
+        }
+
+        Directory& directory = it->second;
+        auto pageIt = directory.pages.find(key);
+        if(pageIt != directory.pages.end())
+        {
+            outPage = pageIt->second;
+            return true;
+        }
+
+        const size_t totalEntries = directory.entries.size();
+        const size_t pageCount = std::max<size_t>((totalEntries + m_pageSize - 1) / m_pageSize, 1);
+        if(page >= pageCount)
+            return false;
+
+        // Copy the slice of the page, rendering and compressing happen outside the lock
+        std::vector<std::pair<std::string, Entry>> slice;
+        slice.reserve(std::min(m_pageSize, totalEntries - std::min(totalEntries, page * m_pageSize)));
+        auto entryIt = directory.entries.begin();
+        std::advance(entryIt, std::min(totalEntries, page * m_pageSize));
+        for(; entryIt != directory.entries.end() && slice.size() < m_pageSize; entryIt++)
+            slice.emplace_back(entryIt->first, entryIt->second);
+        const uint64_t generation = directory.generation;
+        lock.unlock();
+
+        outPage = this->RenderPage(relativeDir, slice, page, pageCount, totalEntries, format);
+
+        // The directory may have changed or been dropped meanwhile, the page is still fine for this request
+        lock.lock();
+        it = m_directories.find(relativeDir);
+        if(it != m_directories.end() && it->second.generation == generation)
+            it->second.pages[key] = outPage;
+
+        return true;
+    }
+
+    void DirectoryListing::OnWatchEvent(const WatchEvent& event)
+    {
+        fs::path relative;
+        if(!this->GetRelativePath(event.path, relative))
+            return;
+
+        if(event.type == WatchEvent::Type::Rescan)
+        {
+            // Drop everything below the path, directories are read again on their next request
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if(relative.empty())
+            {
+                m_directories.clear();
+                return;
+            }
+
+            for(auto it = m_directories.begin(); it != m_directories.end();)
+            {
+                auto [end, _] = std::mismatch(relative.begin(), relative.end(), it->first.begin(), it->first.end());
+                if(end == relative.end())
+                    it = m_directories.erase(it);
+                else
+                    it++;
+            }
+            return;
+        }
+
+        if(relative.empty())
+            return;
+
+        // Only the parent of a loaded directory needs the entry, avoid touching the disk otherwise
+        const fs::path parent = relative.parent_path();
+        const std::string name = relative.filename().string();
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if(event.type == WatchEvent::Type::Removed && event.isDirectory)
+                m_directories.erase(relative);
+            if(m_directories.find(parent) == m_directories.end())
+                return;
+        }
+
+        Entry entry{ event.isDirectory, 0 };
+        bool exists = event.type == WatchEvent::Type::Changed;
+        if(exists && !event.isDirectory)
+        {
+            std::error_code ec;
+            entry.size = fs::file_size(event.path, ec);
+            exists = !ec;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto it = m_directories.find(parent);
+        if(it == m_directories.end())
+            return;
+
+        Directory& directory = it->second;
+        if(exists)
+            directory.entries[name] = entry;
+        else
+            directory.entries.erase(name);
+        directory.pages.clear();
+        directory.generation++;
+    }
+
+    bool DirectoryListing::ScanDirectory(const fs::path& dir, Directory& outDirectory) const
+    {
+        std::error_code ec;
+        fs::directory_iterator it(dir, ec);
+        if(ec)
+            return false;
+
+        // One stat per entry, the cached directory entry type answers the rest
+        for(fs::directory_iterator end; !ec && it != end; it.increment(ec))
+        {
+            const fs::directory_entry& dirEntry = *it;
+            std::error_code entryEc;
+            if(dirEntry.is_directory(entryEc))
+                outDirectory.entries[dirEntry.path().filename().string()] = { true, 0 };
+            else if(dirEntry.is_regular_file(entryEc))
+            {
+                uintmax_t size = dirEntry.file_size(entryEc);
+                if(!entryEc)
+                    outDirectory.entries[dirEntry.path().filename().string()] = { false, size };
+            }
+        }
+        return true;
+    }
+
+    DirectoryListing::FilePtr DirectoryListing::RenderPage(const fs::path& relativeDir, const std::vector<std::pair<std::string, Entry>>& entries,
+        size_t page, size_t pageCount, size_t totalEntries, Format format) const
+    {
+        std::string base = "/";
+        if(!relativeDir.empty())
+            base += relativeDir.generic_string() + "/";
+
+        std::string body;
+        body.reserve(256 + entries.size() * 128);
+
+        if(format == Format::Json)
+        {
+            body += "{\"path\":\"";
+            AppendJsonEscaped(body, base);
+            body += "\",\"page\":" + std::to_string(page);
+            body += ",\"pages\":" + std::to_string(pageCount);
+            body += ",\"total\":" + std::to_string(totalEntries);
+            body += ",\"entries\":[";
+            for(size_t i = 0; i < entries.size(); i++)
+            {
+                const auto& [name, entry] = entries[i];
+                if(i > 0)
+                    body += ',';
+                body += "{\"name\":\"";
+                AppendJsonEscaped(body, name);
+                body += entry.isDirectory ? "\",\"type\":\"directory\"" : "\",\"type\":\"file\",\"size\":" + std::to_string(entry.size);
+                body += '}';
+            }
+            body += "]}";
+        }
+        else
+        {
+            body += "<html><head><title>Content Directory</title></head><body style=\"background-color:#248779\">";
+            body += "<h1>Content Directory: ";
+            AppendHtmlEscaped(body, (relativeDir.empty() ? m_root : m_root / relativeDir).string());
+            body += "</h1><ul>";
+
+            if(!relativeDir.empty())
+            {
+                body += "<li><a href=\"";
+                std::string parent = relativeDir.parent_path().generic_string();
+                AppendUrlEncodedPath(body, parent.empty() ? "/" : "/" + parent + "/");
+                body += "\">..</a></li>";
+            }
+
+            for(const auto& [name, entry] : entries)
+            {
+                body += "<li><a href=\"";
+                AppendUrlEncodedPath(body, base);
+                AppendUrlEncodedPath(body, name);
+                if(entry.isDirectory)
+                    body += '/';
+                body += "\">";
+                AppendHtmlEscaped(body, name);
+                if(entry.isDirectory)
+                    body += "/</a></li>";
+                else
+                    body += "</a> (" + FormatFileSize(entry.size) + ")</li>";
+            }
+            body += "</ul>";
+
+            if(pageCount > 1)
+            {
+                body += "<p>Page " + std::to_string(page + 1) + " of " + std::to_string(pageCount);
+                if(page > 0)
+                    body += " <a href=\"?page=" + std::to_string(page - 1) + "\">Previous</a>";
+                if(page + 1 < pageCount)
+                    body += " <a href=\"?page=" + std::to_string(page + 1) + "\">Next</a>";
+                body += "</p>";
+            }
+            body += "</body></html>";
+        }
+
+        auto file = std::make_shared<CachedFile>(std::move(body));
+        const std::string& identity = *file->GetVariant(ContentEncoding::Identity);
+        if(m_compress && identity.size() >= s_minCompressSize)
+        {
+            for(size_t i = static_cast<size_t>(ContentEncoding::Identity) + 1; i < static_cast<size_t>(ContentEncoding::Count); i++)
+            {
+                ContentEncoding encoding = static_cast<ContentEncoding>(i);
+                std::string variant;
+                if(IsEncodingSupported(encoding) && Compress(encoding, identity, variant) && variant.size() < identity.size())
+                    file->SetVariant(encoding, std::move(variant));
+            }
+        }
+        return file;
+    }
+
+    bool DirectoryListing::GetRelativePath(const fs::path& path, fs::path& outRelative) const
+    {
+        outRelative = path.lexically_relative(m_root);
+        if(outRelative.empty() || *outRelative.begin() == "..")
+            return false;
+        if(outRelative == ".")
+            outRelative.clear();
+        return true;
+    }
+}
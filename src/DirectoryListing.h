@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Defines.h"
+#include "CachedFile.h"
+
+namespace MC
+{
+    struct WatchEvent;
+
+    /// @brief Rendered listings of the directories of the content tree.
+    /// Each directory is read from disk once, on its first request, then kept current from DirectoryWatcher events:
+    /// a change only updates the affected entry and drops the rendered pages of its directory.
+    /// Pages are rendered on demand into immutable CachedFile objects, with their compressed variants, and reused until the next change.
+    class DirectoryListing
+    {
+    public:
+        using FilePtr = std::shared_ptr<const CachedFile>;
+
+        enum class Format : uint8_t
+        {
+            Html,
+            Json
+        };
+
+        /// @brief Creates the listing
+        /// @param root Root of the content tree
+        /// @param pageSize Entries per page, at least one
+        /// @param compress Prepare compressed variants of the rendered pages
+        DirectoryListing(const fs::path& root, size_t pageSize, bool compress);
+
+        /// @brief Renders a page of a directory listing, or returns the page rendered by a previous call
+        /// @param[in] relativeDir Directory, relative to the root, empty for the root itself
+        /// @param[in] page Zero based page index
+        /// @param[in] format Output format
+        /// @param[out] outPage Rendered page
+        /// @return False if the directory does not exist or the page is out of range
+        bool GetPage(const fs::path& relativeDir, size_t page, Format format, FilePtr& outPage);
+
+        /// @brief Applies a change of the content tree, to be registered as DirectoryWatcher listener
+        /// @param event Change
+        void OnWatchEvent(const WatchEvent& event);
+
+        size_t GetPageSize() const { return m_pageSize; }
+
+    private:
+        struct Entry
+        {
+            bool isDirectory;
+            uintmax_t size;
+        };
+
+        struct Directory
+        {
+            std::map<std::string, Entry> entries;       // Sorted by name, the listing order
+            std::unordered_map<uint64_t, FilePtr> pages;
+            uint64_t generation = 0;                    // Bumped at each change, a page rendered from an older generation is not stored
+        };
+
+        static uint64_t GetPageKey(size_t page, Format format) { return (static_cast<uint64_t>(page) << 1) | static_cast<uint64_t>(format); }
+
+        /// @brief Reads the entries of a directory from disk
+        /// @param[in] dir Absolute directory path
+        /// @param[out] outDirectory Directory to fill
+        /// @return False if the path is not a directory
+        bool ScanDirectory(const fs::path& dir, Directory& outDirectory) const;
+
+        /// @brief Renders a page from a slice of the entries, without holding the lock
+        FilePtr RenderPage(const fs::path& relativeDir, const std::vector<std::pair<std::string, Entry>>& entries,
+            size_t page, size_t pageCount, size_t totalEntries, Format format) const;
+
+        bool GetRelativePath(const fs::path& path, fs::path& outRelative) const;
+
+    private:
+        fs::path m_root;
+        size_t m_pageSize;
+        bool m_compress;
+
+        std::mutex m_mtx;
+        std::unordered_map<fs::path, Directory> m_directories;  // Keyed by path relative to the root
+    };
+}
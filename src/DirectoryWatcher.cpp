@@ -0,0 +1,216 @@
+#include "DirectoryWatcher.h"
+#include "Logger.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace MC
+{
+    namespace
+    {
+        // Upper bound of the time Stop waits for the inotify thread
+        constexpr int s_notifyPollMs = 250;
+
+#ifdef __linux__
+        constexpr uint32_t s_watchMask = IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+#endif
+    }
+
+    DirectoryWatcher::DirectoryWatcher(const fs::path& root, std::chrono::milliseconds pollInterval)
+        : m_root{ root }
+        , m_pollInterval{ pollInterval }
+        , m_logger{ nullptr }
+        , m_notifyFd{ -1 }
+        , m_shouldStop{ false }
+    {
+    }
+
+    DirectoryWatcher::~DirectoryWatcher()
+    {
+        Stop();
+    }
+
+    void DirectoryWatcher::AddListener(Listener listener)
+    {
+        m_listeners.push_back(std::move(listener));
+    }
+
+    void DirectoryWatcher::Start(bool usePolling)
+    {
+        if(m_thread.joinable())
+            return;
+
+        m_shouldStop = false;
+
+#ifdef __linux__
+        if(!usePolling)
+        {
+            m_notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if(m_notifyFd < 0 || !AddWatches(m_root, false))
+            {
+                if(m_logger)
+                    MC_LOG_WARN(*m_logger, "inotify not available for ", m_root, ", polling every ", m_pollInterval.count(), " ms");
+                CloseNotify();
+            }
+        }
+#endif
+
+        if(IsNotifying())
+            m_thread = std::thread(&DirectoryWatcher::NotifyLoop, this);
+        else
+            m_thread = std::thread(&DirectoryWatcher::PollLoop, this);
+    }
+
+    void DirectoryWatcher::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_stopMtx);
+            m_shouldStop = true;
+        }
+        m_stopCv.notify_one();
+
+        if(m_thread.joinable())
+            m_thread.join();
+
+        CloseNotify();
+    }
+
+    void DirectoryWatcher::Notify(const WatchEvent& event)
+    {
+        for(const Listener& listener : m_listeners)
+            listener(event);
+    }
+
+    bool DirectoryWatcher::AddWatches(const fs::path& dir, bool reportEntries)
+    {
+#ifdef __linux__
+        int wd = inotify_add_watch(m_notifyFd, dir.c_str(), s_watchMask);
+        if(wd < 0)
+            return errno == ENOENT || errno == ENOTDIR; // Already gone, a Removed event follows
+
+        m_watches[wd] = dir;
+
+        // Entries created before the watch existed produce no event, report them now
+        std::error_code ec;
+        for(fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            bool isDirectory = it->is_directory(ec);
+            if(isDirectory && !AddWatches(it->path(), reportEntries))
+                return false;
+            if(reportEntries)
+                Notify({ WatchEvent::Type::Changed, it->path(), isDirectory });
+        }
+        return true;
+#else
+        (void)dir;
+        (void)reportEntries;
+        return false;
+#endif
+    }
+
+    void DirectoryWatcher::CloseNotify()
+    {
+#ifdef __linux__
+        if(m_notifyFd >= 0)
+            close(m_notifyFd);
+#endif
+        m_notifyFd = -1;
+        m_watches.clear();
+    }
+
+    void DirectoryWatcher::NotifyLoop()
+    {
+#ifdef __linux__
+        alignas(inotify_event) char buffer[64 * 1024];
+
+        while(!m_shouldStop)
+        {
+            pollfd pfd{ m_notifyFd, POLLIN, 0 };
+            if(poll(&pfd, 1, s_notifyPollMs) <= 0)
+                continue;
+
+            ssize_t length = read(m_notifyFd, buffer, sizeof(buffer));
+            if(length <= 0)
+                continue;
+
+            for(ssize_t offset = 0; offset < length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                if(event->mask & IN_Q_OVERFLOW)
+                {
+                    if(m_logger)
+                        MC_LOG_WARN(*m_logger, "inotify queue overflow, rescanning ", m_root);
+                    Notify({ WatchEvent::Type::Rescan, m_root, true });
+                    continue;
+                }
+
+                if(event->mask & IN_IGNORED)
+                {
+                    m_watches.erase(event->wd);
+                    continue;
+                }
+
+                auto it = m_watches.find(event->wd);
+                if(it == m_watches.end() || event->len == 0)
+                    continue;
+
+                fs::path path = it->second / event->name;
+                bool isDirectory = (event->mask & IN_ISDIR) != 0;
+
+                if(event->mask & (IN_DELETE | IN_MOVED_FROM))
+                {
+                    // A directory moved away keeps its watches, they would report under the old path
+                    if(isDirectory && (event->mask & IN_MOVED_FROM))
+                    {
+                        const std::string prefix = path.string() + "/";
+                        for(auto watch = m_watches.begin(); watch != m_watches.end();)
+                        {
+                            if(watch->second == path || watch->second.string().starts_with(prefix))
+                            {
+                                inotify_rm_watch(m_notifyFd, watch->first);
+                                watch = m_watches.erase(watch);
+                            }
+                            else
+                                watch++;
+                        }
+                    }
+                    Notify({ WatchEvent::Type::Removed, path, isDirectory });
+                    continue;
+                }
+
+                // IN_CREATE of a file is followed by IN_CLOSE_WRITE, the content is only reported once written
+                if((event->mask & IN_CREATE) && !isDirectory)
+                    continue;
+
+                Notify({ WatchEvent::Type::Changed, path, isDirectory });
+
+                if(isDirectory && (event->mask & (IN_CREATE | IN_MOVED_TO)) && !AddWatches(path, true))
+                {
+                    if(m_logger)
+                        MC_LOG_WARN(*m_logger, "inotify watch limit reached, polling ", m_root, " every ", m_pollInterval.count(), " ms");
+                    CloseNotify();
+                    Notify({ WatchEvent::Type::Rescan, m_root, true });
+                    PollLoop();
+                    return;
+                }
+            }
+        }
+#endif
+    }
+
+    void DirectoryWatcher::PollLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_stopMtx);
+        while(!m_stopCv.wait_for(lock, m_pollInterval, [this]() { return m_shouldStop.load(); }))
+        {
+            lock.unlock();
+            Notify({ WatchEvent::Type::Rescan, m_root, true });
+            lock.lock();
+        }
+    }
+}
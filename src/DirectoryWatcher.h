@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    class Logger;
+
+    /// @brief Change notification emitted by the DirectoryWatcher
+    struct WatchEvent
+    {
+        enum class Type
+        {
+            Changed,    // Entry created, written or its attributes changed
+            Removed,    // Entry deleted or moved away
+            Rescan      // Changes may have been missed, everything under path must be considered stale
+        };
+
+        Type type;
+        fs::path path;          // Absolute path of the entry
+        bool isDirectory;
+    };
+
+    /// @brief Watches a directory tree and reports changes to its listeners from a single background thread.
+    /// On Linux every directory of the tree gets an inotify watch, directories created later are watched as they appear.
+    /// When inotify is not available (other platforms, watch limit reached) the watcher falls back to polling:
+    /// listeners then receive a Rescan event of the root at each poll interval.
+    class DirectoryWatcher
+    {
+    public:
+        using Listener = std::function<void(const WatchEvent&)>;
+
+        /// @brief Creates the watcher, nothing is watched until Start
+        /// @param root Directory to watch, recursively
+        /// @param pollInterval Interval of the polling fallback
+        DirectoryWatcher(const fs::path& root, std::chrono::milliseconds pollInterval);
+        ~DirectoryWatcher();
+
+        DirectoryWatcher(const DirectoryWatcher&) = delete;
+        DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+        /// @brief Set the logger used for diagnostic messages
+        /// @param logger Logger, may be null, must outlive the watcher
+        void SetLogger(Logger* logger) { m_logger = logger; }
+
+        /// @brief Registers a listener, must be called before Start. Listeners run on the watcher thread.
+        /// @param listener Callback
+        void AddListener(Listener listener);
+
+        /// @brief Starts watching
+        /// @param usePolling Skip inotify and always poll
+        void Start(bool usePolling);
+
+        /// @brief Stops the watcher thread, no listener is called after this returns
+        void Stop();
+
+        /// @brief Tells whether changes are reported by inotify rather than by polling
+        bool IsNotifying() const { return m_notifyFd >= 0; }
+
+        const fs::path& GetRoot() const { return m_root; }
+
+    private:
+        void Notify(const WatchEvent& event);
+        bool AddWatches(const fs::path& dir, bool reportEntries);
+        void CloseNotify();
+        void NotifyLoop();
+        void PollLoop();
+
+    private:
+        fs::path m_root;
+        std::chrono::milliseconds m_pollInterval;
+        Logger* m_logger;
+
+        std::vector<Listener> m_listeners;
+
+        int m_notifyFd;
+        std::unordered_map<int, fs::path> m_watches;
+
+        std::mutex m_stopMtx;
+        std::condition_variable m_stopCv;
+        std::atomic<bool> m_shouldStop;
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,405 @@
+#include "DiskCache.h"
+
+namespace MC
+{
+    namespace
+    {
+        constexpr char s_magic[4] = { 'M', 'C', 'D', 'C' };
+        constexpr uint32_t s_version = 2;
+
+        // Object files are named after the 16 hexadecimal digits of their key hash
+        constexpr size_t s_fileNameLength = 16;
+        constexpr std::string_view s_tempSuffix = ".tmp";
+
+        // Bound of the headers and variant table, read before the size of the body is known: the key and the headers are
+        // limited by the HTTP parser far below it
+        constexpr uint64_t s_maxHeaderBytes = 64 * 1024;
+        constexpr size_t s_copyBufferSize = 64 * 1024;
+
+        template<typename T>
+        void WriteValue(std::string& out, T value)
+        {
+            for(size_t i = 0; i < sizeof(T); i++)
+                out += static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xFF);
+        }
+
+        template<typename T>
+        bool ReadValue(std::string_view& in, T& value)
+        {
+            if(in.size() < sizeof(T))
+                return false;
+
+            uint64_t raw = 0;
+            for(size_t i = 0; i < sizeof(T); i++)
+                raw |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+            value = static_cast<T>(raw);
+            in.remove_prefix(sizeof(T));
+            return true;
+        }
+
+        void WriteString(std::string& out, std::string_view value)
+        {
+            WriteValue(out, static_cast<uint32_t>(value.size()));
+            out += value;
+        }
+
+        bool ReadString(std::string_view& in, std::string& value)
+        {
+            uint32_t size = 0;
+            if(!ReadValue(in, size) || in.size() < size)
+                return false;
+
+            value.assign(in.substr(0, size));
+            in.remove_prefix(size);
+            return true;
+        }
+    }
+
+    DiskCache::DiskCache(const fs::path& directory, uint64_t maxBytes)
+        : m_directory{ directory }
+        , m_maxBytes{ maxBytes }
+        , m_bytes{ 0 }
+        , m_tempCounter{ 0 }
+        , m_hits{ 0 }
+        , m_misses{ 0 }
+        , m_writes{ 0 }
+        , m_evictions{ 0 }
+    {
+    }
+
+    bool DiskCache::Open(std::string& outError)
+    {
+        std::error_code ec;
+        fs::create_directories(m_directory, ec);
+        if(ec || !fs::is_directory(m_directory, ec))
+        {
+            outError = "cannot create the disk cache directory " + m_directory.string();
+            return false;
+        }
+
+        struct StoredFile
+        {
+            uint64_t hash;
+            uint64_t size;
+            fs::file_time_type lastWriteTime;
+        };
+
+        std::vector<StoredFile> files;
+        for(fs::directory_iterator it(m_directory, ec), end; !ec && it != end; it.increment(ec))
+        {
+            const fs::path& filePath = it->path();
+            std::string name = filePath.filename().string();
+            if(name.find(s_tempSuffix) != std::string::npos)
+            {
+                // Left by a write interrupted by a crash
+                fs::remove(filePath, ec);
+                ec.clear();
+                continue;
+            }
+
+            uint64_t hash = 0;
+            auto [last, error] = std::from_chars(name.data(), name.data() + name.size(), hash, 16);
+            if(name.size() != s_fileNameLength || error != std::errc{} || last != name.data() + name.size() || !it->is_regular_file(ec))
+                continue;
+
+            files.push_back({ hash, static_cast<uint64_t>(it->file_size(ec)), it->last_write_time(ec) });
+            ec.clear();
+        }
+
+        if(ec)
+        {
+            outError = "cannot read the disk cache directory " + m_directory.string() + ": " + ec.message();
+            return false;
+        }
+
+        // Oldest first, so that the most recently written object ends up at the front of the LRU list
+        std::sort(files.begin(), files.end(), [](const StoredFile& a, const StoredFile& b) { return a.lastWriteTime < b.lastWriteTime; });
+        for(const StoredFile& file : files)
+            this->Insert(file.hash, file.size);
+
+        return true;
+    }
+
+    bool DiskCache::Get(const std::string& key, Object& outObject, uint64_t maxBodyBytes)
+    {
+        uint64_t hash = Hash(key);
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            auto it = m_records.find(hash);
+            if(it == m_records.end())
+            {
+                m_misses.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+        }
+
+        // The file may be replaced or evicted meanwhile, the open descriptor still reads a complete object.
+        // The headers come first, the rest is only read once the size of the body is known.
+        fs::path path = GetObjectPath(hash);
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        uint64_t fileSize = file ? static_cast<uint64_t>(file.tellg()) : 0;
+        std::string data(static_cast<size_t>(std::min<uint64_t>(fileSize, s_maxHeaderBytes)), '\0');
+        bool valid = file.seekg(0) && file.read(data.data(), static_cast<std::streamsize>(data.size()));
+
+        std::string_view in(data);
+        uint32_t version = 0;
+        int64_t expires = 0;
+        int64_t fetchTime = 0;
+        std::string storedKey;
+        valid = valid && in.size() >= sizeof(s_magic) && in.substr(0, sizeof(s_magic)) == std::string_view(s_magic, sizeof(s_magic));
+        if(valid)
+        {
+            in.remove_prefix(sizeof(s_magic));
+            valid = ReadValue(in, version) && version == s_version
+                && ReadValue(in, expires)
+                && ReadValue(in, fetchTime)
+                && ReadString(in, storedKey) && storedKey == key // Two keys may share a hash
+                && ReadString(in, outObject.contentType)
+                && ReadString(in, outObject.etag)
+                && ReadString(in, outObject.lastModified)
+                && ReadString(in, outObject.cacheControl);
+        }
+
+        uint8_t variantCount = 0;
+        valid = valid && ReadValue(in, variantCount);
+        std::vector<uint64_t> variantSizes(variantCount);
+        uint64_t variantsSize = 0;
+        outObject.variants.clear();
+        for(uint8_t i = 0; valid && i < variantCount; i++)
+        {
+            uint8_t encoding = 0;
+            valid = ReadValue(in, encoding) && encoding > static_cast<uint8_t>(ContentEncoding::Identity) && encoding < static_cast<uint8_t>(ContentEncoding::Count)
+                && ReadValue(in, variantSizes[i]) && variantSizes[i] <= fileSize;
+            if(valid)
+            {
+                outObject.variants.emplace_back(static_cast<ContentEncoding>(encoding), std::string());
+                variantsSize += variantSizes[i];
+            }
+        }
+
+        uint64_t headerSize = data.size() - in.size();
+        valid = valid && headerSize + variantsSize <= fileSize;
+        if(!valid)
+        {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        outObject.expires = static_cast<time_t>(expires);
+        outObject.fetchTime = static_cast<time_t>(fetchTime);
+        outObject.path = path;
+        outObject.bodyOffset = headerSize + variantsSize;
+        outObject.bodySize = fileSize - outObject.bodyOffset;
+        outObject.body.clear();
+        if(outObject.bodySize > maxBodyBytes)
+        {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        size_t readSize = data.size();
+        data.resize(static_cast<size_t>(fileSize));
+        if(!file.read(data.data() + readSize, static_cast<std::streamsize>(data.size() - readSize)))
+        {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        in = std::string_view(data).substr(static_cast<size_t>(headerSize));
+        for(uint8_t i = 0; i < variantCount; i++)
+        {
+            outObject.variants[i].second.assign(in.substr(0, static_cast<size_t>(variantSizes[i])));
+            in.remove_prefix(static_cast<size_t>(variantSizes[i]));
+        }
+
+        data.erase(0, static_cast<size_t>(outObject.bodyOffset));
+        outObject.body = std::move(data);
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool DiskCache::Put(const std::string& key, const Object& object)
+    {
+        std::unique_ptr<Writer> writer = this->BeginPut(key, object);
+        return writer && writer->Close() && writer->Commit();
+    }
+
+    std::unique_ptr<DiskCache::Writer> DiskCache::BeginPut(const std::string& key, const Object& object)
+    {
+        std::string data(s_magic, sizeof(s_magic));
+        WriteValue(data, s_version);
+        WriteValue(data, static_cast<int64_t>(object.expires));
+        WriteValue(data, static_cast<int64_t>(object.fetchTime));
+        WriteString(data, key);
+        WriteString(data, object.contentType);
+        WriteString(data, object.etag);
+        WriteString(data, object.lastModified);
+        WriteString(data, object.cacheControl);
+        WriteValue(data, static_cast<uint8_t>(object.variants.size()));
+        for(const auto& [encoding, variant] : object.variants)
+        {
+            WriteValue(data, static_cast<uint8_t>(encoding));
+            WriteValue(data, static_cast<uint64_t>(variant.size()));
+        }
+        for(const auto& [encoding, variant] : object.variants)
+            data += variant;
+
+        // Concurrent writes of the same key each use their own temporary file, the last rename wins
+        uint64_t hash = Hash(key);
+        fs::path tempPath = GetObjectPath(hash);
+        tempPath += std::string(s_tempSuffix) + "." + std::to_string(m_tempCounter.fetch_add(1, std::memory_order_relaxed));
+
+        std::unique_ptr<Writer> writer(new Writer(*this, hash, tempPath));
+        if(!writer->Write(data))
+            return nullptr;
+        writer->m_bodyOffset = writer->m_size;
+
+        if(!object.body.empty() || object.path.empty())
+            return writer->Write(object.body) ? std::move(writer) : nullptr;
+
+        // Body left on disk by Get
+        std::ifstream source(object.path, std::ios::binary);
+        source.seekg(static_cast<std::streamoff>(object.bodyOffset));
+        std::string buffer(s_copyBufferSize, '\0');
+        for(uint64_t remaining = object.bodySize; remaining > 0;)
+        {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            if(!source.read(buffer.data(), static_cast<std::streamsize>(chunk)) || !writer->Write(std::string_view(buffer.data(), chunk)))
+                return nullptr;
+            remaining -= chunk;
+        }
+        return writer;
+    }
+
+    DiskCache::Writer::Writer(DiskCache& cache, uint64_t hash, fs::path tempPath)
+        : m_cache{ cache }
+        , m_hash{ hash }
+        , m_tempPath{ std::move(tempPath) }
+        , m_file{ m_tempPath, std::ios::binary | std::ios::trunc }
+        , m_size{ 0 }
+        , m_bodyOffset{ 0 }
+        , m_committed{ false }
+    {
+    }
+
+    DiskCache::Writer::~Writer()
+    {
+        if(!m_committed)
+        {
+            m_file.close();
+            std::error_code ec;
+            fs::remove(m_tempPath, ec);
+        }
+    }
+
+    bool DiskCache::Writer::Write(std::string_view data)
+    {
+        if(!m_file.write(data.data(), static_cast<std::streamsize>(data.size())))
+            return false;
+
+        m_size += data.size();
+        return true;
+    }
+
+    bool DiskCache::Writer::Close()
+    {
+        if(!m_file.is_open())
+            return true;
+
+        bool written = static_cast<bool>(m_file.flush());
+        m_file.close();
+        return written;
+    }
+
+    bool DiskCache::Writer::Commit()
+    {
+        if(m_committed || !this->Close() || (m_cache.m_maxBytes > 0 && m_size > m_cache.m_maxBytes))
+            return false;
+
+        std::error_code ec;
+        fs::rename(m_tempPath, m_cache.GetObjectPath(m_hash), ec);
+        if(ec)
+            return false;
+
+        m_committed = true;
+        m_cache.Insert(m_hash, m_size);
+        m_cache.m_writes.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool DiskCache::Remove(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto it = m_records.find(Hash(key));
+        if(it == m_records.end())
+            return false;
+
+        this->Erase(it);
+        return true;
+    }
+
+    DiskCache::Stats DiskCache::GetStats() const
+    {
+        Stats stats;
+        stats.hits = m_hits.load(std::memory_order_relaxed);
+        stats.misses = m_misses.load(std::memory_order_relaxed);
+        stats.writes = m_writes.load(std::memory_order_relaxed);
+        stats.evictions = m_evictions.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(m_mtx);
+        stats.entries = m_records.size();
+        stats.bytes = m_bytes;
+        return stats;
+    }
+
+    uint64_t DiskCache::Hash(std::string_view key)
+    {
+        // FNV-1a, stable across builds and platforms unlike std::hash, since the names outlive the process
+        uint64_t hash = 14695981039346656037ull;
+        for(char c : key)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    fs::path DiskCache::GetObjectPath(uint64_t hash) const
+    {
+        char name[s_fileNameLength + 1];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        return m_directory / name;
+    }
+
+    void DiskCache::Insert(uint64_t hash, uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto [it, inserted] = m_records.try_emplace(hash, Record{ 0, {} });
+        if(!inserted)
+        {
+            m_bytes -= it->second.size;
+            m_lru.erase(it->second.position);
+        }
+
+        m_lru.push_front(hash);
+        it->second = { size, m_lru.begin() };
+        m_bytes += size;
+
+        while(m_maxBytes > 0 && m_bytes > m_maxBytes && m_lru.size() > 1)
+        {
+            this->Erase(m_records.find(m_lru.back()));
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void DiskCache::Erase(std::unordered_map<uint64_t, Record>::iterator it)
+    {
+        std::error_code ec;
+        fs::remove(GetObjectPath(it->first), ec);
+
+        m_bytes -= it->second.size;
+        m_lru.erase(it->second.position);
+        m_records.erase(it);
+    }
+}
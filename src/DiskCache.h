@@ -0,0 +1,167 @@
+#pragma once
+
+#include "Defines.h"
+#include "CachedFile.h"
+
+namespace MC
+{
+    /// @brief Second cache tier on local disk, for the objects pulled from the origin. It outlives restarts and holds far more
+    /// than the memory cache: each object is one file named after the hash of its key, written to a temporary file and renamed
+    /// into place so that a reader never sees a partial object. The directory is bounded in size and evicts the least recently used
+    /// objects, their order is kept in memory and rebuilt from the modification times when the cache is opened.
+    /// Layout of an object file (little endian): "MCDC", u32 version, i64 expiry, i64 fetch time, then u32 length and bytes of the key,
+    /// the content type, the entity tag, the last modification date and the Cache-Control header, then u8 number of encoded variants
+    /// and u8 content coding plus u64 size of each, then the data of the variants, then the body up to the end of the file.
+    class DiskCache
+    {
+    public:
+        /// @brief Stored response of the origin
+        struct Object
+        {
+            std::string contentType;
+            std::string etag;
+            std::string lastModified;
+            std::string cacheControl;   // As sent by the origin, to apply its directives again when the object is read back
+            time_t expires = 0;         // Seconds since epoch after which the object must be revalidated, 0 never expires
+            time_t fetchTime = 0;       // Seconds since epoch when the origin sent or revalidated the object, minus the Age it already had
+            std::string body;
+            std::vector<std::pair<ContentEncoding, std::string>> variants;  // Compressed once, so that a disk hit is served as it was stored
+
+            // Set by Get: location of the body in the object file, which is all a body left on disk can be served from
+            fs::path path;
+            uint64_t bodyOffset = 0;
+            uint64_t bodySize = 0;
+        };
+
+        /// @brief Object written piece by piece, for a body too large to be held in memory. Get does not see it before Commit,
+        /// and a writer destroyed before that removes its temporary file.
+        class Writer
+        {
+        public:
+            ~Writer();
+
+            Writer(const Writer&) = delete;
+            Writer& operator=(const Writer&) = delete;
+
+            /// @brief Appends data to the body
+            /// @param data Data
+            /// @return False if the file could not be written
+            bool Write(std::string_view data);
+
+            /// @brief Flushes the object, its file can then be read from GetPath until Commit moves it
+            /// @return False if the file could not be written
+            bool Close();
+
+            /// @brief Renames the object into place and records it, evicting the oldest objects over the size limit
+            /// @return False if the object is larger than the cache or could not be renamed, its file is then removed
+            bool Commit();
+
+            /// @brief Path of the object file until Commit
+            const fs::path& GetPath() const { return m_tempPath; }
+
+            /// @brief Position of the body in the object file
+            uint64_t GetBodyOffset() const { return m_bodyOffset; }
+
+            /// @brief Size of the body written so far
+            uint64_t GetBodySize() const { return m_size - m_bodyOffset; }
+
+        private:
+            friend class DiskCache;
+            Writer(DiskCache& cache, uint64_t hash, fs::path tempPath);
+
+        private:
+            DiskCache& m_cache;
+            uint64_t m_hash;
+            fs::path m_tempPath;
+            std::ofstream m_file;
+            uint64_t m_size;
+            uint64_t m_bodyOffset;
+            bool m_committed;
+        };
+
+        /// @brief Activity counters and current occupancy of the cache
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t writes = 0;
+            uint64_t evictions = 0;
+            size_t entries = 0;
+            uint64_t bytes = 0;
+        };
+
+        /// @brief Creates the cache, Open must be called before use
+        /// @param directory Directory of the object files, created if missing
+        /// @param maxBytes Maximum size of the object files, 0 means unlimited
+        DiskCache(const fs::path& directory, uint64_t maxBytes);
+
+        DiskCache(const DiskCache&) = delete;
+        DiskCache& operator=(const DiskCache&) = delete;
+
+        /// @brief Creates the directory and indexes the objects left by a previous run, removing the interrupted writes
+        /// @param[out] outError Reason of the failure
+        /// @return Success
+        bool Open(std::string& outError);
+
+        /// @brief Reads an object, expired or not
+        /// @param[in] key Key of the object
+        /// @param[out] outObject Object
+        /// @param[in] maxBodyBytes Largest body read in memory, a larger one is left on disk with the variants: the body of the object
+        /// stays empty and its location is given by path, bodyOffset and bodySize
+        /// @return False if the object is not stored or could not be read
+        bool Get(const std::string& key, Object& outObject, uint64_t maxBodyBytes = std::numeric_limits<uint64_t>::max());
+
+        /// @brief Stores an object, replacing the previous one with the same key, and evicts the oldest objects over the size limit
+        /// @param key Key of the object
+        /// @param object Object, a body left on disk by Get is copied from its file
+        /// @return False if the object is larger than the cache or could not be written
+        bool Put(const std::string& key, const Object& object);
+
+        /// @brief Starts writing an object whose body is appended with the writer, see Put for the rest
+        /// @param key Key of the object
+        /// @param object Headers, variants and first part of the body, a body left on disk by Get is copied from its file
+        /// @return The writer, nullptr if the file could not be written
+        std::unique_ptr<Writer> BeginPut(const std::string& key, const Object& object);
+
+        /// @brief Removes an object
+        /// @param key Key of the object
+        /// @return True if the object was stored
+        bool Remove(const std::string& key);
+
+        /// @brief Gets the activity counters and the occupancy
+        /// @return Statistics
+        Stats GetStats() const;
+
+    private:
+        struct Record
+        {
+            uint64_t size;
+            std::list<uint64_t>::iterator position;
+        };
+
+        static uint64_t Hash(std::string_view key);
+
+        fs::path GetObjectPath(uint64_t hash) const;
+
+        /// @brief Records an object file as the most recently used one and evicts the oldest ones while the cache is over its limit
+        void Insert(uint64_t hash, uint64_t size);
+
+        void Erase(std::unordered_map<uint64_t, Record>::iterator it);
+
+    private:
+        fs::path m_directory;
+        uint64_t m_maxBytes;
+
+        // Object files by key hash, the files themselves are read and written outside of the lock
+        mutable std::mutex m_mtx;
+        std::unordered_map<uint64_t, Record> m_records;
+        std::list<uint64_t> m_lru;      // Most recently used first
+        uint64_t m_bytes;
+
+        std::atomic<uint64_t> m_tempCounter;
+        std::atomic<uint64_t> m_hits;
+        std::atomic<uint64_t> m_misses;
+        std::atomic<uint64_t> m_writes;
+        std::atomic<uint64_t> m_evictions;
+    };
+}
@@ -0,0 +1,819 @@
+#include "EventLoopServer.h"
+#include "Logger.h"
+#include "RequestContext.h"
+#include "WorkerPool.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#endif
+
+namespace MC
+{
+    namespace
+    {
+        constexpr size_t s_readChunk = 16 * 1024;
+        constexpr size_t s_maxEvents = 256;
+        constexpr int s_sweepIntervalMs = 1000;
+
+        // Same limits as httplib, a client gets the same answers from both backends
+        constexpr size_t s_maxHeaderBytes = CPPHTTPLIB_HEADER_MAX_LENGTH;
+        constexpr size_t s_maxTargetLength = CPPHTTPLIB_REQUEST_URI_MAX_LENGTH;
+
+        // Static content needs no request body, small ones are accepted and ignored like with httplib
+        constexpr size_t s_maxBodyBytes = 1024 * 1024;
+
+        // Largest chunk given to a single sendfile call, so that one big file does not hold the loop
+        constexpr size_t s_maxSendfileChunk = 1024 * 1024;
+
+        bool IsKnownMethod(std::string_view method)
+        {
+            for(std::string_view known : { "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH" })
+                if(method == known)
+                    return true;
+            return false;
+        }
+
+        /// @brief Parses the request line and the headers
+        /// @param[in] head Bytes up to, and excluding, the empty line ending the headers
+        /// @param[out] outReq Request to fill
+        /// @return 0 on success, otherwise the error status to answer
+        int ParseRequestHead(std::string_view head, httplib::Request& outReq)
+        {
+            size_t lineEnd = head.find("\r\n");
+            std::string_view line = head.substr(0, lineEnd);
+
+            size_t first = line.find(' ');
+            size_t second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+            if(second == std::string_view::npos || line.find(' ', second + 1) != std::string_view::npos)
+                return 400;
+
+            outReq.method = line.substr(0, first);
+            outReq.target = line.substr(first + 1, second - first - 1);
+            outReq.version = line.substr(second + 1);
+            if(!IsKnownMethod(outReq.method) || (outReq.version != "HTTP/1.1" && outReq.version != "HTTP/1.0"))
+                return 400;
+            if(outReq.target.size() > s_maxTargetLength)
+                return 414;
+
+            // The fragment is not part of the resource, then the path is split from the query
+            std::string_view target = outReq.target;
+            target = target.substr(0, target.find('#'));
+            size_t query = target.find('?');
+            outReq.path = httplib::detail::decode_url(std::string(target.substr(0, query)), false);
+            if(query != std::string_view::npos)
+                httplib::detail::parse_query_text(target.data() + query + 1, target.size() - query - 1, outReq.params);
+
+            for(size_t begin = lineEnd; begin != std::string_view::npos && begin + 2 < head.size();)
+            {
+                begin += 2;
+                size_t end = head.find("\r\n", begin);
+                std::string_view header = head.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+                begin = end;
+
+                if(!httplib::detail::parse_header(header.data(), header.data() + header.size(),
+                    [&outReq](const std::string& key, const std::string& value) { outReq.headers.emplace(key, value); }))
+                    return 400;
+            }
+
+            if(outReq.has_header("Range") && !httplib::detail::parse_range_header(outReq.get_header_value("Range"), outReq.ranges))
+                return 416;
+
+            return 0;
+        }
+
+        /// @brief Resolves a single byte range against the content length, the same way httplib does
+        /// @return False if the range is not satisfiable
+        bool ResolveRange(httplib::Range range, uint64_t length, uint64_t& outOffset, uint64_t& outCount)
+        {
+            int64_t size = static_cast<int64_t>(length);
+            int64_t firstPos = range.first;
+            int64_t lastPos = range.second;
+
+            if(firstPos == -1)
+            {
+                firstPos = size - lastPos;
+                lastPos = size - 1;
+            }
+            if(lastPos == -1 || lastPos >= size)
+                lastPos = size - 1;
+            if(firstPos < 0 || firstPos > lastPos)
+                return false;
+
+            outOffset = static_cast<uint64_t>(firstPos);
+            outCount = static_cast<uint64_t>(lastPos - firstPos + 1);
+            return true;
+        }
+    }
+
+    struct EventLoopServer::Connection
+    {
+        int fd = -1;
+        std::string remoteAddr;
+        int remotePort = 0;
+
+        std::string input;                      // Received bytes not consumed by a request yet
+        bool readClosed = false;                // The client shut down its side, the buffered requests are still answered
+        size_t requestCount = 0;
+        std::chrono::steady_clock::time_point deadline;
+
+        // Response in flight, kept until it has been sent for the completion handler
+        bool responding = false;
+        bool keepAlive = true;
+        httplib::Request req;
+        httplib::Response res;
+        ZeroCopyBody body;
+        RequestContext context;
+
+        std::string head;                       // Status line and headers
+        size_t headOffset = 0;
+        const char* bodyData = nullptr;         // Buffer body: the shared buffer or the body of the httplib::Response
+        uint64_t bodyOffset = 0;
+        uint64_t bodyEnd = 0;
+        int fileFd = -1;                        // File body, sent with sendfile
+        off_t fileOffset = 0;
+        uint64_t fileEnd = 0;
+    };
+
+    struct EventLoopServer::Loop
+    {
+        int epollFd = -1;
+        int listenFd = -1;
+        int wakeFd = -1;
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        std::chrono::steady_clock::time_point lastSweep;
+        bool acceptPaused = false;              // Out of descriptors, the listening socket is not polled
+        std::chrono::steady_clock::time_point lastAcceptWarning;
+
+        ~Loop()
+        {
+#ifdef __linux__
+            for(int fd : { epollFd, listenFd, wakeFd })
+                if(fd >= 0)
+                    close(fd);
+#endif
+        }
+    };
+
+    EventLoopServer::EventLoopServer(const Settings& settings, RequestHandler handler, CompletionHandler completion)
+        : m_settings{ settings }
+        , m_handler{ std::move(handler) }
+        , m_completion{ std::move(completion) }
+        , m_running{ false }
+        , m_stopping{ false }
+        , m_connectionCount{ 0 }
+    {
+        m_settings.threadCount = std::max<size_t>(m_settings.threadCount, 1);
+        m_settings.keepAliveMaxCount = std::max<size_t>(m_settings.keepAliveMaxCount, 1);
+    }
+
+    EventLoopServer::~EventLoopServer()
+    {
+        Stop();
+    }
+
+    bool EventLoopServer::IsSupported()
+    {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+#ifdef __linux__
+
+    bool EventLoopServer::Listen(const std::string& address, int port)
+    {
+        return this->Bind(address, port) && this->Run();
+    }
+
+    bool EventLoopServer::Bind(const std::string& address, int port)
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+            return false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_loopsMtx);
+            if(m_stopping)
+                return false;
+
+            // One listening socket per loop, bound to the same port: the kernel balances the connections between them
+            for(size_t i = 0; i < m_settings.threadCount; i++)
+            {
+                auto loop = std::make_unique<Loop>();
+                loop->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+                loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if(loop->listenFd < 0 || loop->epollFd < 0 || loop->wakeFd < 0)
+                {
+                    m_loops.clear();
+                    return false;
+                }
+
+                int yes = 1;
+                setsockopt(loop->listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                setsockopt(loop->listenFd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+
+                // Buffer sizes set on the listening socket are inherited by the accepted connections
+                if(m_settings.sendBuffer > 0)
+                    setsockopt(loop->listenFd, SOL_SOCKET, SO_SNDBUF, &m_settings.sendBuffer, sizeof(m_settings.sendBuffer));
+                if(m_settings.receiveBuffer > 0)
+                    setsockopt(loop->listenFd, SOL_SOCKET, SO_RCVBUF, &m_settings.receiveBuffer, sizeof(m_settings.receiveBuffer));
+
+                if(bind(loop->listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(loop->listenFd, SOMAXCONN) != 0)
+                {
+                    m_loops.clear();
+                    return false;
+                }
+
+                // The listener and the wake-up descriptor are told apart from the connections by their tag
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.ptr = nullptr;
+                epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &event);
+                event.data.ptr = loop.get();
+                epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &event);
+
+                m_loops.push_back(std::move(loop));
+            }
+            m_running = true;
+        }
+        return true;
+    }
+
+    bool EventLoopServer::Run()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_loopsMtx);
+            if(m_loops.empty())
+                return false;
+        }
+
+        std::vector<std::thread> threads;
+        for(size_t i = 1; i < m_loops.size(); i++)
+            threads.emplace_back(&EventLoopServer::RunLoop, this, std::ref(*m_loops[i]), i);
+        this->RunLoop(*m_loops[0], 0);
+
+        for(std::thread& thread : threads)
+            thread.join();
+
+        std::lock_guard<std::mutex> lock(m_loopsMtx);
+        m_running = false;
+        m_stopping = false;
+        m_loops.clear();
+        return true;
+    }
+
+    void EventLoopServer::Stop()
+    {
+        std::lock_guard<std::mutex> lock(m_loopsMtx);
+        m_stopping = true;
+        for(const std::unique_ptr<Loop>& loop : m_loops)
+        {
+            uint64_t one = 1;
+            (void)!write(loop->wakeFd, &one, sizeof(one));
+        }
+    }
+
+    void EventLoopServer::RunLoop(Loop& loop, size_t index)
+    {
+        if(m_settings.pinThreads)
+            PinCurrentThread(index);
+
+        //! sendfile raises SIGPIPE when the client is gone, blocked here it stays pending on this thread and EPIPE is returned instead
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        std::array<epoll_event, s_maxEvents> events;
+        loop.lastSweep = std::chrono::steady_clock::now();
+
+        while(!m_stopping)
+        {
+            int count = epoll_wait(loop.epollFd, events.data(), static_cast<int>(events.size()), s_sweepIntervalMs);
+            for(int i = 0; i < count; i++)
+            {
+                void* tag = events[i].data.ptr;
+                if(tag == nullptr)
+                    this->Accept(loop);
+                else if(tag != &loop)
+                    this->OnEvent(loop, *static_cast<Connection*>(tag), events[i].events);
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if(now - loop.lastSweep >= std::chrono::milliseconds(s_sweepIntervalMs))
+            {
+                loop.lastSweep = now;
+                this->CloseExpired(loop);
+
+                // Descriptors may have been freed elsewhere in the process
+                if(loop.acceptPaused)
+                    this->ResumeAccept(loop);
+            }
+        }
+
+        while(!loop.connections.empty())
+            this->CloseConnection(loop, *loop.connections.begin()->second);
+    }
+
+    void EventLoopServer::Accept(Loop& loop)
+    {
+        while(true)
+        {
+            sockaddr_storage addr{};
+            socklen_t addrLength = sizeof(addr);
+            int fd = accept4(loop.listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0)
+            {
+                if(errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                    this->PauseAccept(loop);
+                return; // EAGAIN: backlog drained
+            }
+
+            //! Headers and body are written separately, with Nagle's algorithm the body waits for the delayed ACK of the client (~40 ms)
+            if(m_settings.tcpNoDelay)
+            {
+                int yes = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            }
+
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            connection->deadline = std::chrono::steady_clock::now() + m_settings.keepAliveTimeout;
+            char host[INET6_ADDRSTRLEN] = {};
+            if(addr.ss_family == AF_INET)
+            {
+                const sockaddr_in& in = reinterpret_cast<const sockaddr_in&>(addr);
+                inet_ntop(AF_INET, &in.sin_addr, host, sizeof(host));
+                connection->remotePort = ntohs(in.sin_port);
+            }
+            connection->remoteAddr = host;
+
+            // Edge-triggered: one notification per state change, the handlers read and write until EAGAIN
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = connection.get();
+            if(epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                close(fd);
+                continue;
+            }
+
+            loop.connections.emplace(fd, std::move(connection));
+            m_connectionCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void EventLoopServer::PauseAccept(Loop& loop)
+    {
+        // Resumed when one of the connections of the loop closes, or at the next sweep. The pending connections wait in the backlog.
+        int error = errno;
+        epoll_event event{};
+        event.events = 0;
+        event.data.ptr = nullptr;
+        epoll_ctl(loop.epollFd, EPOLL_CTL_MOD, loop.listenFd, &event);
+        loop.acceptPaused = true;
+
+        auto now = std::chrono::steady_clock::now();
+        if(m_settings.logger && now - loop.lastAcceptWarning >= std::chrono::milliseconds(s_sweepIntervalMs))
+        {
+            loop.lastAcceptWarning = now;
+            MC_LOG_WARN(*m_settings.logger, "Cannot accept connections (", std::strerror(error), "), ", loop.connections.size(), " open on this loop, retrying once one closes");
+        }
+    }
+
+    void EventLoopServer::ResumeAccept(Loop& loop)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(loop.epollFd, EPOLL_CTL_MOD, loop.listenFd, &event);
+        loop.acceptPaused = false;
+    }
+
+    void EventLoopServer::OnEvent(Loop& loop, Connection& connection, uint32_t events)
+    {
+        if(events & EPOLLERR)
+        {
+            this->CloseConnection(loop, connection);
+            return;
+        }
+
+        if(events & (EPOLLIN | EPOLLRDHUP))
+        {
+            char buffer[s_readChunk];
+            while(true)
+            {
+                ssize_t length = recv(connection.fd, buffer, sizeof(buffer), 0);
+                if(length > 0)
+                {
+                    // A client sending faster than it reads its responses is only buffered up to one full request
+                    connection.input.append(buffer, static_cast<size_t>(length));
+                    if(connection.input.size() > s_maxHeaderBytes + s_maxBodyBytes)
+                    {
+                        this->CloseConnection(loop, connection);
+                        return;
+                    }
+                }
+                else if(length < 0 && errno == EINTR)
+                    continue;
+                else if(length < 0 && errno == EAGAIN)
+                    break;
+                else if(length == 0)
+                {
+                    // Half-closed by the client (shutdown(SHUT_WR)): it still waits for the answers to what it sent
+                    connection.readClosed = true;
+                    break;
+                }
+                else
+                {
+                    this->CloseConnection(loop, connection);
+                    return;
+                }
+            }
+        }
+
+        this->Drive(loop, connection);
+    }
+
+    void EventLoopServer::Drive(Loop& loop, Connection& connection)
+    {
+        while(true)
+        {
+            if(connection.responding)
+            {
+                if(!this->Flush(connection))
+                {
+                    this->CloseConnection(loop, connection);
+                    return;
+                }
+
+                // The socket buffer is full, EPOLLOUT resumes the response
+                if(connection.responding)
+                {
+                    connection.deadline = std::chrono::steady_clock::now() + m_settings.writeTimeout;
+                    return;
+                }
+
+                if(!connection.keepAlive)
+                {
+                    this->CloseConnection(loop, connection);
+                    return;
+                }
+            }
+
+            // Pipelined requests are answered one after the other
+            this->ProcessRequest(connection);
+
+            if(!connection.responding)
+            {
+                // Nothing more can come from a half-closed client once its complete requests are answered
+                if(connection.readClosed)
+                {
+                    this->CloseConnection(loop, connection);
+                    return;
+                }
+
+                // Idle between requests, or waiting for the rest of one
+                auto timeout = connection.input.empty() ? m_settings.keepAliveTimeout : m_settings.readTimeout;
+                connection.deadline = std::chrono::steady_clock::now() + timeout;
+                return;
+            }
+        }
+    }
+
+    void EventLoopServer::ProcessRequest(Connection& connection)
+    {
+        size_t headEnd = connection.input.find("\r\n\r\n");
+        if(headEnd == std::string::npos)
+        {
+            if(connection.input.size() <= s_maxHeaderBytes)
+                return;
+
+            connection.req = {};
+            connection.res = {};
+            connection.res.status = 431;
+            connection.input.clear();
+            this->PrepareResponse(connection, false);
+            return;
+        }
+
+        connection.req = {};
+        connection.res = {};
+        connection.body = {};
+        connection.context = {};
+        httplib::Request& req = connection.req;
+        httplib::Response& res = connection.res;
+        req.remote_addr = connection.remoteAddr;
+        req.remote_port = connection.remotePort;
+
+        int error = headEnd > s_maxHeaderBytes ? 431 : ParseRequestHead(std::string_view(connection.input).substr(0, headEnd), req);
+
+        size_t consumed = headEnd + 4;
+        if(error == 0 && req.has_header("Transfer-Encoding"))
+            error = 411;    // Chunked uploads are of no use to a static server
+        else if(error == 0 && req.has_header("Content-Length"))
+        {
+            std::string contentLength = req.get_header_value("Content-Length");
+            uint64_t bodyLength = 0;
+            if(std::from_chars(contentLength.data(), contentLength.data() + contentLength.size(), bodyLength).ec != std::errc{})
+                error = 400;
+            else if(bodyLength > s_maxBodyBytes)
+                error = 413;
+            else if(connection.input.size() < consumed + bodyLength)
+                return; // Wait for the rest of the body
+            else
+            {
+                req.body = connection.input.substr(consumed, static_cast<size_t>(bodyLength));
+                consumed += static_cast<size_t>(bodyLength);
+            }
+        }
+
+        if(error != 0)
+        {
+            // The rest of the input cannot be trusted to start at a request boundary
+            connection.input.clear();
+            res.status = error;
+            res.set_content(std::string(httplib::status_message(error)), "text/plain");
+            this->PrepareResponse(connection, false);
+            return;
+        }
+
+        connection.input.erase(0, consumed);
+        connection.requestCount++;
+
+        // Same keep-alive rules as httplib
+        bool keepAlive = !m_stopping && connection.requestCount < m_settings.keepAliveMaxCount
+            && req.get_header_value("Connection") != "close"
+            && (req.version != "HTTP/1.0" || req.get_header_value("Connection") == "Keep-Alive");
+
+        // Same answer as httplib when a handler throws, the zero copy body may point to anything by then
+        std::optional<std::string> failure;
+        try
+        {
+            m_handler(req, res, connection.body, connection.context);
+        }
+        catch(const std::exception& e)
+        {
+            failure = e.what();
+        }
+        catch(...)
+        {
+            failure = "unknown exception";
+        }
+
+        if(failure)
+        {
+            if(m_settings.logger)
+                MC_LOG_ERROR(*m_settings.logger, "Request handler failed for ", req.path, ": ", *failure);
+            res = {};
+            res.status = 500;
+            res.set_content(std::string(httplib::status_message(500)), "text/plain");
+            connection.body = {};
+        }
+
+        this->PrepareResponse(connection, keepAlive);
+    }
+
+    void EventLoopServer::PrepareResponse(Connection& connection, bool keepAlive)
+    {
+        httplib::Request& req = connection.req;
+        httplib::Response& res = connection.res;
+        ZeroCopyBody& body = connection.body;
+
+        if(res.status == -1)
+            res.status = req.ranges.empty() ? 200 : 206;
+
+        if(!body.buffer && !body.filePath.empty())
+        {
+            connection.fileFd = open(body.filePath.c_str(), O_RDONLY | O_CLOEXEC);
+            if(connection.fileFd < 0)
+            {
+                body = {};
+                res.status = 500;
+                res.set_content("Failed to open file", "text/plain");
+            }
+        }
+
+        uint64_t length = body.buffer ? body.buffer->size() : connection.fileFd >= 0 ? body.fileSize : res.body.size();
+        uint64_t offset = 0;
+
+        // A single range is sliced here, several ranges get the whole content (RFC 9110 lets a server ignore Range)
+        if(res.status == 206)
+        {
+            uint64_t count = 0;
+            if(req.ranges.size() != 1)
+                res.status = 200;
+            else if(ResolveRange(req.ranges[0], length, offset, count))
+            {
+                res.set_header("Content-Range", "bytes " + std::to_string(offset) + "-" + std::to_string(offset + count - 1) + "/" + std::to_string(length));
+                length = count;
+            }
+            else
+            {
+                res.status = 416;
+                res.set_header("Content-Range", "bytes */" + std::to_string(length));
+                res.body.clear();
+                body = {};
+                length = 0;
+                offset = 0;
+                if(connection.fileFd >= 0)
+                {
+                    close(connection.fileFd);
+                    connection.fileFd = -1;
+                }
+            }
+        }
+
+        if(!keepAlive)
+            res.set_header("Connection", "close");
+        else
+            res.set_header("Keep-Alive", "timeout=" + std::to_string(m_settings.keepAliveTimeout.count()) + ", max=" + std::to_string(m_settings.keepAliveMaxCount));
+
+        if(length > 0 && !res.has_header("Content-Type"))
+            res.set_header("Content-Type", "text/plain");
+        if(req.method == "HEAD" && !res.has_header("Accept-Ranges"))
+            res.set_header("Accept-Ranges", "bytes");
+        res.set_header("Content-Length", std::to_string(length));
+
+        std::string& head = connection.head;
+        head.clear();
+        head.reserve(256);
+        head.append("HTTP/1.1 ").append(std::to_string(res.status)).append(" ").append(httplib::status_message(res.status)).append("\r\n");
+        for(const auto& [key, value] : res.headers)
+            head.append(key).append(": ").append(value).append("\r\n");
+        head.append("\r\n");
+        connection.headOffset = 0;
+
+        // Bodies are not sent for HEAD and 304, the headers still describe them
+        bool sendBody = req.method != "HEAD" && res.status != 304 && res.status != 204 && length > 0;
+        connection.bodyData = nullptr;
+        connection.bodyOffset = 0;
+        connection.bodyEnd = 0;
+        if(sendBody && connection.fileFd >= 0)
+        {
+            connection.fileOffset = static_cast<off_t>(offset);
+            connection.fileEnd = offset + length;
+        }
+        else if(sendBody)
+        {
+            connection.bodyData = body.buffer ? body.buffer->data() : res.body.data();
+            connection.bodyOffset = offset;
+            connection.bodyEnd = offset + length;
+        }
+
+        if(!sendBody && connection.fileFd >= 0)
+        {
+            close(connection.fileFd);
+            connection.fileFd = -1;
+        }
+
+        connection.keepAlive = keepAlive;
+        connection.responding = true;
+    }
+
+    bool EventLoopServer::Flush(Connection& connection)
+    {
+        while(true)
+        {
+            // Headers and buffer body leave with a single system call, straight from the shared cache buffer
+            size_t headLeft = connection.head.size() - connection.headOffset;
+            uint64_t bodyLeft = connection.bodyEnd - connection.bodyOffset;
+            if(headLeft > 0 || bodyLeft > 0)
+            {
+                iovec iov[2];
+                int iovCount = 0;
+                if(headLeft > 0)
+                    iov[iovCount++] = { connection.head.data() + connection.headOffset, headLeft };
+                if(bodyLeft > 0)
+                    iov[iovCount++] = { const_cast<char*>(connection.bodyData) + connection.bodyOffset, static_cast<size_t>(bodyLeft) };
+
+                msghdr message{};
+                message.msg_iov = iov;
+                message.msg_iovlen = static_cast<size_t>(iovCount);
+                ssize_t written = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+                if(written < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+                    return errno == EAGAIN;
+                }
+
+                size_t fromHead = std::min(static_cast<size_t>(written), headLeft);
+                connection.headOffset += fromHead;
+                connection.bodyOffset += static_cast<uint64_t>(written) - fromHead;
+                continue;
+            }
+
+            // Large files go from the page cache to the socket without passing through user space
+            if(connection.fileFd >= 0 && static_cast<uint64_t>(connection.fileOffset) < connection.fileEnd)
+            {
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(connection.fileEnd - static_cast<uint64_t>(connection.fileOffset), s_maxSendfileChunk));
+                ssize_t written = sendfile(connection.fd, connection.fileFd, &connection.fileOffset, chunk);
+                if(written < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+                    return errno == EAGAIN;
+                }
+                if(written == 0)
+                    return false; // The file was truncated after the headers announced its length
+                continue;
+            }
+
+            this->Complete(connection);
+            return true;
+        }
+    }
+
+    void EventLoopServer::Complete(Connection& connection)
+    {
+        if(connection.fileFd >= 0)
+        {
+            close(connection.fileFd);
+            connection.fileFd = -1;
+        }
+        connection.responding = false;
+
+        m_completion(connection.req, connection.res, connection.context);
+
+        // Release the cached buffer before the connection goes idle
+        connection.body = {};
+        connection.res = {};
+    }
+
+    void EventLoopServer::CloseConnection(Loop& loop, Connection& connection)
+    {
+        // An interrupted response is still logged, like httplib does when a write fails
+        if(connection.responding)
+            this->Complete(connection);
+
+        int fd = connection.fd;
+        epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        loop.connections.erase(fd);
+        m_connectionCount.fetch_sub(1, std::memory_order_relaxed);
+
+        // A descriptor is free again for the connections waiting in the backlog
+        if(loop.acceptPaused && !m_stopping)
+            this->ResumeAccept(loop);
+    }
+
+    void EventLoopServer::CloseExpired(Loop& loop)
+    {
+        auto now = std::chrono::steady_clock::now();
+        for(auto it = loop.connections.begin(); it != loop.connections.end();)
+        {
+            Connection& connection = *(it++)->second;
+            if(connection.deadline <= now)
+                this->CloseConnection(loop, connection);
+        }
+    }
+
+#else
+
+    bool EventLoopServer::Listen(const std::string& address, int port)
+    {
+        return this->Bind(address, port) && this->Run();
+    }
+
+    bool EventLoopServer::Bind(const std::string& address, int port)
+    {
+        (void)address;
+        (void)port;
+        return false;
+    }
+
+    bool EventLoopServer::Run()
+    {
+        return false;
+    }
+
+    void EventLoopServer::Stop()
+    {
+    }
+
+#endif
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace httplib
+{
+    struct Request;
+    struct Response;
+}
+
+namespace MC
+{
+    class Logger;
+    struct RequestContext;
+
+    /// @brief Response body handed to the event loop beside httplib::Response, so that it is sent without being copied.
+    /// When neither a buffer nor a file is set, the body of the httplib::Response is sent.
+    struct ZeroCopyBody
+    {
+        std::shared_ptr<const std::string> buffer;  // Shared data, sent with writev right after the headers
+        fs::path filePath;                          // File sent with sendfile, when no buffer is set
+        uint64_t fileSize = 0;
+    };
+
+    /// @brief HTTP/1.1 server built on one edge-triggered epoll loop per thread.
+    /// Every loop owns its own SO_REUSEPORT listening socket, the kernel spreads the new connections between them,
+    /// and a connection then stays on the loop that accepted it. Sockets are non-blocking: an idle keep-alive connection
+    /// only costs its buffers, not a thread. Handlers run on the loop thread and must not block for long.
+    /// Only available on Linux, see IsSupported.
+    class EventLoopServer
+    {
+    public:
+        /// @brief Produces the response of a request, runs on a loop thread
+        using RequestHandler = std::function<void(const httplib::Request& req, httplib::Response& res, ZeroCopyBody& body, RequestContext& context)>;
+
+        /// @brief Called once the response has been sent, or the connection lost, with the context filled by the request handler
+        using CompletionHandler = std::function<void(const httplib::Request& req, const httplib::Response& res, const RequestContext& context)>;
+
+        struct Settings
+        {
+            size_t threadCount = 1;
+            bool pinThreads = false;
+            size_t keepAliveMaxCount = 100;
+            std::chrono::seconds keepAliveTimeout{ 60 };
+            std::chrono::seconds readTimeout{ 5 };
+            std::chrono::seconds writeTimeout{ 5 };
+            bool tcpNoDelay = true;
+            int sendBuffer = 0;                     // SO_SNDBUF of the connections, 0 keeps the system default
+            int receiveBuffer = 0;                  // SO_RCVBUF of the connections, 0 keeps the system default
+            Logger* logger = nullptr;               // Failed handlers and exhausted descriptors, not logged when null
+        };
+
+        /// @brief Creates the server, nothing listens until Listen
+        /// @param settings Threads, keep-alive, timeouts and socket options
+        /// @param handler Request handler
+        /// @param completion Completion handler
+        EventLoopServer(const Settings& settings, RequestHandler handler, CompletionHandler completion);
+        ~EventLoopServer();
+
+        EventLoopServer(const EventLoopServer&) = delete;
+        EventLoopServer& operator=(const EventLoopServer&) = delete;
+
+        /// @brief Tells whether the platform provides what the event loops need (epoll, SO_REUSEPORT, sendfile)
+        static bool IsSupported();
+
+        /// @brief Binds the listening sockets and runs the loops until Stop (blocking call)
+        /// @param address IPv4 address to bind
+        /// @param port Port to bind
+        /// @return False if the sockets could not be bound
+        bool Listen(const std::string& address, int port);
+
+        /// @brief Binds the listening sockets without running the loops, connections wait in the backlog until Run
+        /// @param address IPv4 address to bind
+        /// @param port Port to bind
+        /// @return False if the sockets could not be bound
+        bool Bind(const std::string& address, int port);
+
+        /// @brief Runs the loops on the sockets bound by Bind until Stop (blocking call)
+        /// @return False if nothing was bound
+        bool Run();
+
+        /// @brief Stops the loops, safe to call from any thread. Open connections are closed, Listen returns once every loop has exited.
+        void Stop();
+
+        /// @brief Checks if the loops are accepting connections
+        bool IsRunning() const { return m_running.load(); }
+
+        /// @brief Number of open client connections, over all loops
+        size_t GetConnectionCount() const { return m_connectionCount.load(std::memory_order_relaxed); }
+
+    private:
+        struct Loop;
+        struct Connection;
+
+        void RunLoop(Loop& loop, size_t index);
+        void Accept(Loop& loop);
+
+        /// @brief Stops polling the listening socket while no descriptor is left to accept with, or polls it again.
+        /// The socket is level-triggered: left armed, a full backlog would wake the loop again and again.
+        void PauseAccept(Loop& loop);
+        void ResumeAccept(Loop& loop);
+        void OnEvent(Loop& loop, Connection& connection, uint32_t events);
+
+        /// @brief Moves a connection forward: sends its pending response, then answers its buffered requests until it has to wait
+        void Drive(Loop& loop, Connection& connection);
+
+        /// @brief Parses the buffered request of a connection, if complete, and prepares its response.
+        /// An exception of the request handler is answered with 500.
+        void ProcessRequest(Connection& connection);
+
+        /// @brief Fills the output of a connection with the status line, headers and body of its response
+        void PrepareResponse(Connection& connection, bool keepAlive);
+
+        /// @brief Writes as much of the pending response as the socket accepts
+        /// @return False if the connection must be closed
+        bool Flush(Connection& connection);
+
+        /// @brief Ends the response in flight and calls the completion handler
+        void Complete(Connection& connection);
+
+        void CloseConnection(Loop& loop, Connection& connection);
+        void CloseExpired(Loop& loop);
+
+    private:
+        Settings m_settings;
+        RequestHandler m_handler;
+        CompletionHandler m_completion;
+
+        std::vector<std::unique_ptr<Loop>> m_loops;
+        std::mutex m_loopsMtx;
+        std::atomic<bool> m_running;
+        std::atomic<bool> m_stopping;
+        std::atomic<size_t> m_connectionCount;
+    };
+}
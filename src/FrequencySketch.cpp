@@ -0,0 +1,58 @@
+#include "FrequencySketch.h"
+
+namespace MC
+{
+    FrequencySketch::FrequencySketch(size_t width)
+        : m_table{}
+        , m_mask{ 0 }
+        , m_additions{ 0 }
+        , m_sampleSize{ 0 }
+    {
+        width = std::bit_ceil(std::max<size_t>(width, 16));
+        m_table.assign(width * s_rows, 0);
+        m_mask = width - 1;
+        m_sampleSize = width * 10;
+    }
+
+    void FrequencySketch::Increment(size_t hash)
+    {
+        bool added = false;
+        for(size_t row = 0; row < s_rows; row++)
+        {
+            uint8_t& counter = m_table[row * (m_mask + 1) + Index(hash, row)];
+            if(counter < s_maxCount)
+            {
+                counter++;
+                added = true;
+            }
+        }
+
+        if(added && ++m_additions >= m_sampleSize)
+            Reset();
+    }
+
+    uint8_t FrequencySketch::Frequency(size_t hash) const
+    {
+        uint8_t frequency = s_maxCount;
+        for(size_t row = 0; row < s_rows; row++)
+            frequency = std::min(frequency, m_table[row * (m_mask + 1) + Index(hash, row)]);
+        return frequency;
+    }
+
+    size_t FrequencySketch::Index(size_t hash, size_t row) const
+    {
+        // Derive an independent hash per row by remixing the key hash with a different odd seed
+        static constexpr uint64_t seeds[s_rows] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull };
+        uint64_t h = (static_cast<uint64_t>(hash) + row) * seeds[row];
+        h ^= h >> 32;
+        return static_cast<size_t>(h) & m_mask;
+    }
+
+    void FrequencySketch::Reset()
+    {
+        // Aging: halve every counter so that old popularity fades away
+        for(uint8_t& counter : m_table)
+            counter >>= 1;
+        m_additions /= 2;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Count-min sketch that estimates how often a key has been seen recently, used by the cache as TinyLFU admission filter.
+    /// Counters saturate at 15 and are periodically halved, so the estimate follows the recent popularity of a key instead of its lifetime total.
+    /// This class is not thread safe, the owner is expected to serialize the access.
+    class FrequencySketch
+    {
+    public:
+        /// @brief Creates the sketch
+        /// @param width Number of counters per row, rounded up to a power of two
+        FrequencySketch(size_t width = 1024);
+
+        /// @brief Records one occurrence of a key
+        /// @param hash Hash of the key
+        void Increment(size_t hash);
+
+        /// @brief Estimates the recent frequency of a key
+        /// @param hash Hash of the key
+        /// @return Estimated frequency, between 0 and 15
+        uint8_t Frequency(size_t hash) const;
+
+    private:
+        size_t Index(size_t hash, size_t row) const;
+        void Reset();
+
+    private:
+        static constexpr size_t s_rows = 4;
+        static constexpr uint8_t s_maxCount = 15;
+
+        std::vector<uint8_t> m_table;
+        size_t m_mask;
+        size_t m_additions;
+        size_t m_sampleSize;
+    };
+}
@@ -0,0 +1,216 @@
+#include "HttpUtils.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+namespace MC
+{
+    namespace
+    {
+        constexpr const char* s_httpDateFormat = "%a, %d %b %Y %H:%M:%S GMT";
+    }
+
+    FileValidators MakeValidators(uintmax_t fileSize, fs::file_time_type lastWriteTime)
+    {
+        auto systemTime = std::chrono::file_clock::to_sys(lastWriteTime);
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(systemTime.time_since_epoch()).count();
+
+        FileValidators validators;
+        validators.mtime = std::chrono::system_clock::to_time_t(std::chrono::floor<std::chrono::seconds>(systemTime));
+        validators.lastModified = FormatHttpDate(validators.mtime);
+
+        // Nanosecond modification time and size, so that a rewrite within the same second still changes the tag
+        char etag[48];
+        snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(nanoseconds), static_cast<unsigned long long>(fileSize));
+        validators.etag = etag;
+
+        return validators;
+    }
+
+    std::string_view Trim(std::string_view value)
+    {
+        while(!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        while(!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+            value.remove_suffix(1);
+        return value;
+    }
+
+    std::string FormatHttpDate(time_t time)
+    {
+        std::tm tm{};
+#ifdef _WIN32
+        gmtime_s(&tm, &time);
+#else
+        gmtime_r(&time, &tm);
+#endif
+        // strftime would use the global locale, build the date with the classic one
+        std::ostringstream ss;
+        ss.imbue(std::locale::classic());
+        ss << std::put_time(&tm, s_httpDateFormat);
+        return ss.str();
+    }
+
+    bool ParseHttpDate(const std::string& date, time_t& outTime)
+    {
+        std::tm tm{};
+        std::istringstream ss(date);
+        ss.imbue(std::locale::classic());
+        ss >> std::get_time(&tm, s_httpDateFormat);
+        if(ss.fail())
+            return false;
+
+#ifdef _WIN32
+        outTime = _mkgmtime(&tm);
+#else
+        outTime = timegm(&tm);
+#endif
+        return outTime != static_cast<time_t>(-1);
+    }
+
+    CacheControl ParseCacheControl(std::string_view value)
+    {
+        CacheControl directives;
+        long maxAge = -1;
+        long sharedMaxAge = -1;
+        while(!value.empty())
+        {
+            size_t comma = value.find(',');
+            std::string_view directive = Trim(value.substr(0, comma));
+            value = comma == std::string_view::npos ? std::string_view{} : value.substr(comma + 1);
+
+            std::string_view argument;
+            if(size_t equal = directive.find('='); equal != std::string_view::npos)
+            {
+                argument = Trim(directive.substr(equal + 1));
+                directive = Trim(directive.substr(0, equal));
+                if(argument.size() >= 2 && argument.front() == '"' && argument.back() == '"')
+                    argument = argument.substr(1, argument.size() - 2);
+            }
+
+            auto is = [directive](std::string_view name)
+                {
+                    return std::equal(directive.begin(), directive.end(), name.begin(), name.end(),
+                        [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+                };
+            auto parseSeconds = [argument](long& outSeconds)
+                {
+                    long seconds = 0;
+                    auto [end, error] = std::from_chars(argument.data(), argument.data() + argument.size(), seconds);
+                    if(error == std::errc{} && end == argument.data() + argument.size() && seconds >= 0)
+                        outSeconds = seconds;
+                };
+
+            if(is("no-store") || is("private"))
+                directives.noStore = true;
+            else if(is("no-cache"))
+                directives.noCache = true;
+            else if(is("must-revalidate") || is("proxy-revalidate"))
+                directives.mustRevalidate = true;
+            else if(is("max-age"))
+                parseSeconds(maxAge);
+            else if(is("s-maxage"))
+                parseSeconds(sharedMaxAge);
+        }
+
+        // s-maxage is meant for shared caches such as this one, and implies proxy-revalidate
+        directives.maxAge = sharedMaxAge >= 0 ? sharedMaxAge : maxAge;
+        directives.mustRevalidate = directives.mustRevalidate || sharedMaxAge >= 0;
+        return directives;
+    }
+
+    bool MatchesETag(const std::string& tagList, const std::string& etag, bool weak)
+    {
+        std::string_view list(tagList);
+        if(Trim(list) == "*")
+            return true;
+
+        std::string_view target(etag);
+        if(weak && target.starts_with("W/"))
+            target.remove_prefix(2);
+
+        while(!list.empty())
+        {
+            size_t comma = list.find(',');
+            std::string_view tag = Trim(list.substr(0, comma));
+            list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+
+            if(tag.starts_with("W/"))
+            {
+                // Weak tags never match with the strong comparison
+                if(!weak)
+                    continue;
+                tag.remove_prefix(2);
+            }
+
+            if(tag == target)
+                return true;
+        }
+
+        return false;
+    }
+
+    bool IsNotModified(const httplib::Request& req, const FileValidators& validators)
+    {
+        if(req.method != "GET" && req.method != "HEAD")
+            return false;
+
+        // If-None-Match takes precedence, If-Modified-Since is ignored when both are present
+        if(req.has_header("If-None-Match"))
+            return MatchesETag(req.get_header_value("If-None-Match"), validators.etag, true);
+
+        // A representation without modification date, e.g. from an origin that sent none, is never considered unmodified by date
+        time_t since = 0;
+        if(!validators.lastModified.empty() && req.has_header("If-Modified-Since") && ParseHttpDate(req.get_header_value("If-Modified-Since"), since))
+            return validators.mtime <= since;
+
+        return false;
+    }
+
+    bool IsRangeApplicable(const httplib::Request& req, const FileValidators& validators)
+    {
+        if(!req.has_header("If-Range"))
+            return true;
+
+        std::string condition = req.get_header_value("If-Range");
+        if(condition.starts_with("\"") || condition.starts_with("W/"))
+            return MatchesETag(condition, validators.etag, false);
+
+        // A date validator only matches the exact modification time
+        time_t date = 0;
+        return !validators.lastModified.empty() && ParseHttpDate(condition, date) && date == validators.mtime;
+    }
+
+    void AppendUrlEncodedPath(std::string& out, std::string_view path)
+    {
+        static constexpr char s_hex[] = "0123456789ABCDEF";
+        for(char c : path)
+        {
+            unsigned char u = static_cast<unsigned char>(c);
+            if(std::isalnum(u) || c == '-' || c == '.' || c == '_' || c == '~' || c == '/')
+                out += c;
+            else
+            {
+                out += '%';
+                out += s_hex[u >> 4];
+                out += s_hex[u & 0xF];
+            }
+        }
+    }
+
+    std::string FormatFileSize(uintmax_t bytes)
+    {
+        const char* suffix[] = { "B", "KB", "MB", "GB", "TB" };
+        double size = static_cast<double>(bytes);
+        int i = 0;
+        while(size >= 1024 && i < 4)
+        {
+            size /= 1024;
+            i++;
+        }
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2) << size << " " << suffix[i];
+        return ss.str();
+    }
+}
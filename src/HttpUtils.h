@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace httplib
+{
+    struct Request;
+}
+
+namespace MC
+{
+    /// @brief Validators of a file representation, used for conditional and range requests
+    struct FileValidators
+    {
+        std::string etag;           // Strong entity tag, quoted
+        std::string lastModified;   // IMF-fixdate, empty when unknown
+        time_t mtime = 0;           // Modification time in seconds since epoch
+    };
+
+    /// @brief Directives of a Cache-Control response header that a shared cache has to honor
+    struct CacheControl
+    {
+        bool noStore = false;           // no-store, or private which keeps the response out of shared caches
+        bool noCache = false;           // Stored, but revalidated with the origin before every use
+        bool mustRevalidate = false;    // must-revalidate or proxy-revalidate: never served stale
+        long maxAge = -1;               // s-maxage when present, otherwise max-age, -1 when neither is set
+    };
+
+    /// @brief Builds the validators of a file from its metadata
+    /// @param fileSize Size of the file in bytes
+    /// @param lastWriteTime Modification time of the file
+    /// @return File validators
+    FileValidators MakeValidators(uintmax_t fileSize, fs::file_time_type lastWriteTime);
+
+    /// @brief Removes the optional whitespace (spaces and tabs) around an element of a header value
+    /// @param value Element
+    /// @return Trimmed view of the element
+    std::string_view Trim(std::string_view value);
+
+    /// @brief Formats a time point as HTTP date (IMF-fixdate), e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    /// @param time Seconds since epoch
+    /// @return Formatted date
+    std::string FormatHttpDate(time_t time);
+
+    /// @brief Parses an HTTP date in IMF-fixdate format
+    /// @param[in] date Date string
+    /// @param[out] outTime Seconds since epoch
+    /// @return Success
+    bool ParseHttpDate(const std::string& date, time_t& outTime);
+
+    /// @brief Parses the directives of a Cache-Control header, unknown directives are ignored
+    /// @param value Header value
+    /// @return Directives
+    CacheControl ParseCacheControl(std::string_view value);
+
+    /// @brief Checks if an entity tag appears in a comma separated list of entity tags, as found in If-None-Match and If-Match
+    /// @param tagList Header value, "*" matches any tag
+    /// @param etag Quoted entity tag of the representation
+    /// @param weak Use weak comparison, ignoring the W/ prefix
+    /// @return Bool result
+    bool MatchesETag(const std::string& tagList, const std::string& etag, bool weak);
+
+    /// @brief Evaluates If-None-Match and If-Modified-Since (RFC 9110 13.2.2)
+    /// @param req Request
+    /// @param validators Validators of the selected representation
+    /// @return True if the client copy is still fresh and a 304 should be sent
+    bool IsNotModified(const httplib::Request& req, const FileValidators& validators);
+
+    /// @brief Evaluates If-Range (RFC 9110 13.1.5)
+    /// @param req Request
+    /// @param validators Validators of the selected representation
+    /// @return True if the Range header must be honored, false if the whole representation must be sent
+    bool IsRangeApplicable(const httplib::Request& req, const FileValidators& validators);
+
+    /// @brief Percent-encodes a path for a URL, keeping the separators
+    /// @param[out] out String to append to
+    /// @param[in] path Decoded path
+    void AppendUrlEncodedPath(std::string& out, std::string_view path);
+
+    /// @brief Obtain a more readable string that represents the file size
+    /// @param bytes File size in bytes count
+    /// @return Formatted string, e.g. "1.50 KB"
+    std::string FormatFileSize(uintmax_t bytes);
+}
@@ -2,67 +2,262 @@
 
 namespace MC
 {
-    Logger::Logger()
-        : m_logFilePath{ }
-        , m_logQueue{}
-        , m_logThread{ nullptr }
-        , m_mtx{}
-        , m_shouldStop{ false }
+    namespace
     {
-        m_logThread = std::make_unique<std::thread>([&]()
-            {
+        constexpr const char* s_levelNames[] = { "trace", "debug", "info", "warn", "error", "off" };
+        constexpr const char* s_levelPrefixes[] = { "[TRACE] ", "[DEBUG] ", "[INFO] ", "[WARN] ", "[ERROR] ", "" };
+    }
 
-                while(!m_shouldStop)
-                {
-                    std::lock_guard<std::mutex> lock(m_mtx);
-                    if(!m_logQueue.empty())
-                    {
-                        // Read the message
-                        std::string req = m_logQueue.front(); 
-                        m_logQueue.pop();
-
-                        // Write to file
-                        if(!m_logFilePath.empty())
-                        {
-                            std::ofstream logFile(m_logFilePath, std::ios::app);
-                            if(logFile.is_open())
-                            {
-                                logFile << req << std::endl;
-                                logFile.close();
-                            }
-                            else
-                            {
-                                std::cerr << "Failed to open log file: " << m_logFilePath.string() << " probably the log folder does not exist" << std::endl;
-                            }
-                        }
-                        else
-                        {
-                            // If no log file path is set, just print to console
-                            std::cout << req << std::endl;
-                        }
-                    }
-                    else
-                    {
-                        // Sleep for a short duration to avoid busy waiting
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    }
-                }
-
-                std::cout << "Logger thread stopping..." << std::endl;
+    bool ParseLogLevel(std::string_view name, LogLevel& outLevel)
+    {
+        for(size_t i = 0; i < std::size(s_levelNames); i++)
+        {
+            std::string_view levelName = s_levelNames[i];
+            if(name.size() == levelName.size() && std::equal(name.begin(), name.end(), levelName.begin(),
+                [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; }))
+            {
+                outLevel = static_cast<LogLevel>(i);
+                return true;
             }
-        );
+        }
+        return false;
+    }
+
+    const char* GetLogLevelName(LogLevel level)
+    {
+        return s_levelNames[static_cast<size_t>(level)];
+    }
+
+    Logger::Logger(size_t queueCapacity)
+        : m_logQueue{ queueCapacity }
+        , m_level{ LogLevel::Info }
+        , m_overflowPolicy{ OverflowPolicy::Drop }
+        , m_dropped{ 0 }
+        , m_flushBytes{ 64 * 1024 }
+        , m_flushIntervalMs{ 200 }
+        , m_rotateBytes{ 0 }
+        , m_rotateIntervalSec{ 0 }
+        , m_rotateKeep{ 5 }
+        , m_pathMtx{}
+        , m_logFilePath{}
+        , m_pathChanged{ false }
+        , m_currentPath{}
+        , m_logFile{}
+        , m_fileSize{ 0 }
+        , m_fileOpened{}
+        , m_writeBuffer{}
+        , m_wakeMtx{}
+        , m_wakeCv{}
+        , m_writerSleeping{ false }
+        , m_shouldStop{ false }
+        , m_logThread{ nullptr }
+    {
+        m_logThread = std::make_unique<std::thread>(&Logger::WriteLoop, this);
     }
 
     Logger::~Logger()
     {
         m_shouldStop = true;
+        m_wakeCv.notify_one();
         m_logThread->join();
     }
 
-    void Logger::LogRequest(const std::string& req)
+    void Logger::SetLogFilePath(const fs::path& logFilePath)
+    {
+        std::lock_guard<std::mutex> lock(m_pathMtx);
+        m_logFilePath = logFilePath;
+        m_pathChanged = true;
+    }
+
+    void Logger::SetFlushThresholds(size_t bytes, std::chrono::milliseconds interval)
+    {
+        m_flushBytes = bytes;
+        m_flushIntervalMs = std::max<int64_t>(interval.count(), 1);
+    }
+
+    void Logger::SetRotation(uint64_t maxBytes, std::chrono::seconds interval, size_t keepFiles)
+    {
+        m_rotateBytes = maxBytes;
+        m_rotateIntervalSec = interval.count();
+        m_rotateKeep = keepFiles;
+    }
+
+    void Logger::Log(LogLevel level, std::string_view msg)
+    {
+        Push(s_levelPrefixes[static_cast<size_t>(level)], msg);
+    }
+
+    void Logger::LogRequest(std::string_view req)
+    {
+        Push({}, req);
+    }
+
+    void Logger::Push(std::string_view prefix, std::string_view msg)
+    {
+        // Copy into the slot string, which keeps its capacity from the previous use
+        auto write = [prefix, msg](std::string& slot)
+            {
+                slot.assign(prefix);
+                slot.append(msg);
+            };
+
+        while(!m_logQueue.TryPush(write))
+        {
+            if(m_overflowPolicy.load(std::memory_order_relaxed) == OverflowPolicy::Drop || m_shouldStop)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            m_wakeCv.notify_one();
+            std::this_thread::yield();
+        }
+
+        //! Only notify a sleeping writer, so that producers don't pay a syscall per message.
+        //! A notification racing with the writer falling asleep is not lost for long: the writer wakes up at every flush interval anyway.
+        if(m_writerSleeping.load(std::memory_order_relaxed))
+            m_wakeCv.notify_one();
+    }
+
+    void Logger::WriteLoop()
     {
-        std::lock_guard<std::mutex> lock(m_mtx);
+        auto lastFlush = std::chrono::steady_clock::now();
+
+        for(;;)
+        {
+            ReopenIfNeeded();
+
+            // Drain a batch into the write buffer
+            bool drained = false;
+            while(m_writeBuffer.size() < m_flushBytes && m_logQueue.TryPop([this](std::string& msg)
+                {
+                    m_writeBuffer.append(msg);
+                    m_writeBuffer.push_back('\n');
+                }))
+                drained = true;
+
+            auto now = std::chrono::steady_clock::now();
+            bool stopping = m_shouldStop;
+            if(m_writeBuffer.size() >= m_flushBytes || (!m_writeBuffer.empty() && now - lastFlush >= std::chrono::milliseconds(m_flushIntervalMs)) || (stopping && !drained))
+            {
+                Flush();
+                lastFlush = now;
+            }
+
+            // Shutdown only completes once every pending message has been written
+            if(stopping && !drained && m_logQueue.Size() == 0)
+                break;
+
+            if(!drained)
+            {
+                std::unique_lock<std::mutex> lock(m_wakeMtx);
+                m_writerSleeping = true;
+                if(m_logQueue.Size() == 0 && !m_shouldStop)
+                    m_wakeCv.wait_for(lock, std::chrono::milliseconds(m_flushIntervalMs));
+                m_writerSleeping = false;
+            }
+        }
+
+        Flush();
+    }
+
+    void Logger::ReopenIfNeeded()
+    {
+        if(!m_pathChanged.exchange(false))
+            return;
+
+        // Messages queued before the change still belong to the previous output
+        Flush();
+
+        {
+            std::lock_guard<std::mutex> lock(m_pathMtx);
+            m_currentPath = m_logFilePath;
+        }
+
+        OpenLogFile(std::ios::app);
+    }
+
+    void Logger::OpenLogFile(std::ios::openmode mode)
+    {
+        if(m_logFile.is_open())
+            m_logFile.close();
+
+        m_fileSize = 0;
+        m_fileOpened = std::chrono::steady_clock::now();
+
+        if(m_currentPath.empty())
+            return;
+
+        m_logFile.open(m_currentPath, mode | std::ios::out | std::ios::binary);
+        if(!m_logFile.is_open())
+        {
+            std::cerr << "Failed to open log file: " << m_currentPath.string() << " probably the log folder does not exist" << std::endl;
+            return;
+        }
+
+        std::error_code ec;
+        uintmax_t size = fs::file_size(m_currentPath, ec);
+        m_fileSize = ec ? 0 : size;
+    }
+
+    void Logger::RotateIfNeeded(size_t pendingBytes)
+    {
+        if(!m_logFile.is_open())
+            return;
+
+        uint64_t maxBytes = m_rotateBytes.load(std::memory_order_relaxed);
+        int64_t maxAge = m_rotateIntervalSec.load(std::memory_order_relaxed);
+
+        bool tooBig = maxBytes > 0 && m_fileSize > 0 && m_fileSize + pendingBytes > maxBytes;
+        bool tooOld = maxAge > 0 && std::chrono::steady_clock::now() - m_fileOpened >= std::chrono::seconds(maxAge);
+        if(!tooBig && !tooOld)
+            return;
+
+        m_logFile.close();
+
+        // log.txt -> log.txt.1 -> log.txt.2 ... the oldest one is overwritten
+        auto numbered = [this](size_t i)
+            {
+                fs::path path = m_currentPath;
+                path += "." + std::to_string(i);
+                return path;
+            };
+
+        std::error_code ec;
+        size_t keep = m_rotateKeep.load(std::memory_order_relaxed);
+        if(keep == 0)
+            fs::remove(m_currentPath, ec);
+        else
+        {
+            for(size_t i = keep - 1; i >= 1; i--)
+                if(fs::exists(numbered(i), ec))
+                    fs::rename(numbered(i), numbered(i + 1), ec);
+            fs::rename(m_currentPath, numbered(1), ec);
+        }
+
+        OpenLogFile(std::ios::trunc);
+    }
+
+    void Logger::Flush()
+    {
+        if(m_writeBuffer.empty())
+            return;
+
+        RotateIfNeeded(m_writeBuffer.size());
+
+        if(m_logFile.is_open())
+        {
+            m_logFile.write(m_writeBuffer.data(), static_cast<std::streamsize>(m_writeBuffer.size()));
+            m_logFile.flush();
+            m_fileSize += m_writeBuffer.size();
+        }
+        else
+        {
+            // If no log file is open, just print to console
+            std::cout.write(m_writeBuffer.data(), static_cast<std::streamsize>(m_writeBuffer.size()));
+            std::cout.flush();
+        }
 
-        m_logQueue.push(req);
+        m_writeBuffer.clear();
     }
-}
\ No newline at end of file
+}
@@ -1,30 +1,195 @@
 #pragma once
 
 #include "Defines.h"
+#include "BoundedQueue.h"
+
+//! Minimum level compiled in, statements below it are removed by the compiler (0 = trace ... 4 = error, 5 = off)
+#ifndef MC_LOG_COMPILE_LEVEL
+#define MC_LOG_COMPILE_LEVEL 0
+#endif
+
+/// @brief Logs a message built from the concatenation of the arguments. The arguments are only evaluated and formatted
+/// when the level is both compiled in and enabled at runtime, so a disabled statement costs a single relaxed atomic load.
+#define MC_LOG(logger, level, ...)                                                                  \
+    do                                                                                              \
+    {                                                                                               \
+        if constexpr(static_cast<int>(level) >= MC_LOG_COMPILE_LEVEL)                               \
+        {                                                                                           \
+            if((logger).IsEnabled(level))                                                           \
+                (logger).Log(level, MC::FormatLogMessage(__VA_ARGS__));                             \
+        }                                                                                           \
+    } while(0)
+
+#define MC_LOG_TRACE(logger, ...) MC_LOG(logger, MC::LogLevel::Trace, __VA_ARGS__)
+#define MC_LOG_DEBUG(logger, ...) MC_LOG(logger, MC::LogLevel::Debug, __VA_ARGS__)
+#define MC_LOG_INFO(logger, ...) MC_LOG(logger, MC::LogLevel::Info, __VA_ARGS__)
+#define MC_LOG_WARN(logger, ...) MC_LOG(logger, MC::LogLevel::Warn, __VA_ARGS__)
+#define MC_LOG_ERROR(logger, ...) MC_LOG(logger, MC::LogLevel::Error, __VA_ARGS__)
 
 namespace MC
 {
-    /// @brief Simple logger class that manages two things: a main thread log queue and a logging thread that deals with I/O write operations. 
+    /// @brief Severity of an application log message
+    enum class LogLevel
+    {
+        Trace,
+        Debug,
+        Info,
+        Warn,
+        Error,
+        Off
+    };
+
+    /// @brief Parses a level name (trace, debug, info, warn, error, off)
+    /// @param[in] name Level name, case insensitive
+    /// @param[out] outLevel Parsed level
+    /// @return Success
+    bool ParseLogLevel(std::string_view name, LogLevel& outLevel);
+
+    /// @brief Gets the name of a level, as written in the log
+    const char* GetLogLevelName(LogLevel level);
+
+    namespace detail
+    {
+        inline void AppendLogArgument(std::string& out, std::string_view value) { out.append(value); }
+        inline void AppendLogArgument(std::string& out, const char* value) { out.append(value); }
+        inline void AppendLogArgument(std::string& out, const std::string& value) { out.append(value); }
+        inline void AppendLogArgument(std::string& out, const fs::path& value) { out.append(value.string()); }
+        inline void AppendLogArgument(std::string& out, char value) { out.push_back(value); }
+        inline void AppendLogArgument(std::string& out, bool value) { out.append(value ? "true" : "false"); }
+
+        template<typename T> requires std::is_arithmetic_v<T>
+        void AppendLogArgument(std::string& out, T value)
+        {
+            char buf[32];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, end);
+        }
+    }
+
+    /// @brief Concatenates the arguments in a per-thread buffer, reused by every message of the thread
+    /// @return View on the buffer, valid until the next call on the same thread
+    template<typename... Args>
+    std::string_view FormatLogMessage(const Args&... args)
+    {
+        thread_local std::string buffer;
+        buffer.clear();
+        (detail::AppendLogArgument(buffer, args), ...);
+        return buffer;
+    }
+
+    /// @brief Asynchronous logger: producers push messages into a lock-free bounded queue and never wait for I/O,
+    /// a dedicated logging thread drains the queue in batches and writes them to a log file that stays open.
     class Logger
     {
     public:
-        Logger();
+        /// @brief What producers do when the queue is full
+        enum class OverflowPolicy
+        {
+            Drop,   // The message is discarded and counted
+            Block   // The producer waits until the logging thread frees a slot
+        };
+
+        /// @brief Creates the logger and starts the logging thread
+        /// @param queueCapacity Maximum number of pending messages, rounded up to a power of two
+        Logger(size_t queueCapacity = 8192);
         ~Logger();
 
-        /// @brief Set the log file for this session
-        /// @param logFilePath Path where the log file will be created / overwritten
-        void SetLogFilePath(const fs::path& logFilePath) { m_logFilePath = logFilePath; }
+        /// @brief Set the log file for this session. The file is opened in append mode by the logging thread.
+        /// @param logFilePath Path where the log file will be created / appended, the console is used when empty
+        void SetLogFilePath(const fs::path& logFilePath);
+
+        /// @brief Set what happens when the queue is full
+        /// @param policy Overflow policy
+        void SetOverflowPolicy(OverflowPolicy policy) { m_overflowPolicy = policy; }
+
+        /// @brief Set when buffered messages are written to the file, whichever threshold comes first
+        /// @param bytes Size of the write buffer that triggers a flush
+        /// @param interval Maximum time a message stays buffered
+        void SetFlushThresholds(size_t bytes, std::chrono::milliseconds interval);
+
+        /// @brief Set when the log file is rotated, the rotation is done by the logging thread.
+        /// The current file is renamed with the suffix ".1", older files are shifted up to keepFiles.
+        /// @param maxBytes Size that triggers a rotation, 0 disables it
+        /// @param interval Age of the file that triggers a rotation, 0 disables it
+        /// @param keepFiles Number of rotated files kept
+        void SetRotation(uint64_t maxBytes, std::chrono::seconds interval, size_t keepFiles);
+
+        /// @brief Set the minimum level of the application messages
+        /// @param level Messages below this level are discarded before being formatted
+        void SetLevel(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
 
-        /// @brief Queue a message to the logger thread
+        /// @brief Checks if messages of a level are written, use the MC_LOG macros instead of calling Log directly
+        /// @param level Message level
+        /// @return Bool result
+        bool IsEnabled(LogLevel level) const { return level >= m_level.load(std::memory_order_relaxed); }
+
+        /// @brief Queue an application message, prefixed with its level
+        /// @param level Message level
+        /// @param msg Message
+        void Log(LogLevel level, std::string_view msg);
+
+        /// @brief Queue a message to the logger thread, without blocking unless the queue is full and the policy is Block
         /// @param req Request message
-        void LogRequest(const std::string& req);
+        void LogRequest(std::string_view req);
+
+        /// @brief Number of messages discarded because the queue was full
+        uint64_t GetDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+        /// @brief Approximate number of messages waiting in the queue
+        size_t GetQueueDepth() const { return m_logQueue.Size(); }
+
+    private:
+        /// @brief Pushes a message, made of a prefix and a body, into the queue
+        void Push(std::string_view prefix, std::string_view msg);
+
+        /// @brief Body of the logging thread
+        void WriteLoop();
+
+        /// @brief Opens the log file if the path changed
+        void ReopenIfNeeded();
+
+        /// @brief Opens the current log file
+        void OpenLogFile(std::ios::openmode mode);
+
+        /// @brief Rotates the log file if writing the pending bytes would exceed the limits
+        void RotateIfNeeded(size_t pendingBytes);
+
+        /// @brief Writes the buffered messages to the output
+        void Flush();
 
     private:
+        BoundedQueue<std::string> m_logQueue;
+        std::atomic<LogLevel> m_level;
+        std::atomic<OverflowPolicy> m_overflowPolicy;
+        std::atomic<uint64_t> m_dropped;
+
+        // Flush thresholds
+        std::atomic<size_t> m_flushBytes;
+        std::atomic<int64_t> m_flushIntervalMs;
 
+        // Rotation thresholds
+        std::atomic<uint64_t> m_rotateBytes;
+        std::atomic<int64_t> m_rotateIntervalSec;
+        std::atomic<size_t> m_rotateKeep;
+
+        // Requested output
+        std::mutex m_pathMtx;
         fs::path m_logFilePath;
-        std::queue<std::string> m_logQueue;
-        std::unique_ptr<std::thread> m_logThread;
-        std::mutex m_mtx;
+        std::atomic_bool m_pathChanged;
+
+        // Current output, only touched by the logging thread
+        fs::path m_currentPath;
+        std::ofstream m_logFile;
+        uint64_t m_fileSize;
+        std::chrono::steady_clock::time_point m_fileOpened;
+        std::string m_writeBuffer;
+
+        // Wake up of the logging thread
+        std::mutex m_wakeMtx;
+        std::condition_variable m_wakeCv;
+        std::atomic_bool m_writerSleeping;
+
         std::atomic_bool m_shouldStop;
+        std::unique_ptr<std::thread> m_logThread;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,192 @@
+#include "MetadataIndex.h"
+#include "DirectoryWatcher.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace MC
+{
+    namespace
+    {
+        bool IsSameFile(const FileMetadata& a, const FileMetadata& b)
+        {
+            return a.size == b.size && a.lastWriteTime == b.lastWriteTime && a.inode == b.inode;
+        }
+
+        bool IsBelow(const fs::path& path, const fs::path& dir)
+        {
+            auto [end, _] = std::mismatch(dir.begin(), dir.end(), path.begin(), path.end());
+            return end == dir.end();
+        }
+    }
+
+    MetadataIndex::MetadataIndex(const fs::path& root)
+        : m_root{ root }
+    {
+    }
+
+    void MetadataIndex::Build()
+    {
+        std::lock_guard<std::mutex> updateLock(m_updateMtx);
+
+        FileMap files;
+        DirectorySet directories;
+        this->Scan(m_root, files, directories);
+
+        // Files that changed while nobody was watching are stale too
+        std::vector<fs::path> stalePaths;
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mtx);
+            for(const auto& [path, metadata] : m_files)
+            {
+                auto it = files.find(path);
+                if(it == files.end() || !IsSameFile(*metadata, *it->second))
+                    stalePaths.push_back(path);
+            }
+            m_files.swap(files);
+            m_directories.swap(directories);
+        }
+
+        this->NotifyStale(stalePaths);
+    }
+
+    void MetadataIndex::OnWatchEvent(const WatchEvent& event)
+    {
+        if(event.type == WatchEvent::Type::Rescan)
+        {
+            this->Build();
+            return;
+        }
+
+        std::lock_guard<std::mutex> updateLock(m_updateMtx);
+        std::vector<fs::path> stalePaths;
+
+        if(event.type == WatchEvent::Type::Removed)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mtx);
+            if(m_files.erase(event.path) > 0)
+                stalePaths.push_back(event.path);
+            else
+                this->EraseTree(event.path, stalePaths);
+        }
+        else if(event.isDirectory)
+        {
+            // Only the directory itself, its entries get their own events as the watcher discovers them
+            std::unique_lock<std::shared_mutex> lock(m_mtx);
+            m_directories.insert(event.path);
+        }
+        else
+        {
+            MetadataPtr metadata = StatFile(event.path);
+
+            std::unique_lock<std::shared_mutex> lock(m_mtx);
+            auto it = m_files.find(event.path);
+            if(it != m_files.end() && metadata && IsSameFile(*it->second, *metadata))
+                return; // e.g. a chmod, the content did not change
+
+            if(it != m_files.end())
+                stalePaths.push_back(event.path);
+
+            if(metadata)
+                m_files[event.path] = std::move(metadata);
+            else if(it != m_files.end())
+                m_files.erase(it);
+        }
+
+        this->NotifyStale(stalePaths);
+    }
+
+    MetadataIndex::MetadataPtr MetadataIndex::FindFile(const fs::path& filePath) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mtx);
+        auto it = m_files.find(filePath);
+        return it != m_files.end() ? it->second : nullptr;
+    }
+
+    bool MetadataIndex::IsDirectory(const fs::path& dirPath) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mtx);
+        return m_directories.find(dirPath) != m_directories.end();
+    }
+
+    size_t MetadataIndex::GetFileCount() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mtx);
+        return m_files.size();
+    }
+
+    MetadataIndex::MetadataPtr MetadataIndex::StatFile(const fs::path& filePath)
+    {
+        std::error_code ec;
+        if(!fs::is_regular_file(filePath, ec))
+            return nullptr;
+
+        auto metadata = std::make_shared<FileMetadata>();
+        metadata->size = fs::file_size(filePath, ec);
+        if(ec)
+            return nullptr;
+        metadata->lastWriteTime = fs::last_write_time(filePath, ec);
+        if(ec)
+            return nullptr;
+
+#ifndef _WIN32
+        // A file replaced by a rename may keep its size and time, the inode tells them apart
+        struct stat st;
+        if(stat(filePath.c_str(), &st) == 0)
+            metadata->inode = static_cast<uint64_t>(st.st_ino);
+#endif
+
+        metadata->contentType = httplib::detail::find_content_type(filePath.string(), {}, "application/octet-stream");
+        metadata->validators = MakeValidators(metadata->size, metadata->lastWriteTime);
+        return metadata;
+    }
+
+    void MetadataIndex::Scan(const fs::path& dir, FileMap& outFiles, DirectorySet& outDirectories) const
+    {
+        std::error_code ec;
+        if(!fs::is_directory(dir, ec))
+            return;
+
+        outDirectories.insert(dir);
+        for(fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code entryEc;
+            if(it->is_directory(entryEc))
+                outDirectories.insert(it->path());
+            else if(MetadataPtr metadata = StatFile(it->path()))
+                outFiles.emplace(it->path(), std::move(metadata));
+        }
+    }
+
+    void MetadataIndex::EraseTree(const fs::path& dir, std::vector<fs::path>& outStale)
+    {
+        if(m_directories.erase(dir) == 0)
+            return;
+
+        for(auto it = m_files.begin(); it != m_files.end();)
+        {
+            if(IsBelow(it->first, dir))
+            {
+                outStale.push_back(it->first);
+                it = m_files.erase(it);
+            }
+            else
+                it++;
+        }
+
+        std::erase_if(m_directories, [&](const fs::path& path) { return IsBelow(path, dir); });
+    }
+
+    void MetadataIndex::NotifyStale(const std::vector<fs::path>& stalePaths) const
+    {
+        if(!m_staleListener)
+            return;
+
+        for(const fs::path& path : stalePaths)
+            m_staleListener(path);
+    }
+}
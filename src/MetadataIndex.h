@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Defines.h"
+#include "HttpUtils.h"
+
+namespace MC
+{
+    struct WatchEvent;
+
+    /// @brief Metadata of a regular file of the content tree, or of an object pulled from the origin
+    struct FileMetadata
+    {
+        uintmax_t size = 0;
+        fs::file_time_type lastWriteTime{};
+        uint64_t inode = 0;
+        std::string contentType;
+        FileValidators validators;
+        std::string cacheControl;   // Origin objects: Cache-Control of the origin, forwarded to the clients
+        time_t fetchTime = 0;       // Origin objects: when the origin sent or revalidated the object, minus the Age it already had
+    };
+
+    /// @brief In-memory index of the files and directories of the content tree, so that serving a request needs no filesystem call.
+    /// The index is built once with Build, then kept current from DirectoryWatcher events. Each change is reported to the
+    /// stale listener, once the index already holds the new state, so that caches can drop the old content.
+    class MetadataIndex
+    {
+    public:
+        using MetadataPtr = std::shared_ptr<const FileMetadata>;
+        using StaleListener = std::function<void(const fs::path&)>;
+
+        /// @brief Creates an empty index
+        /// @param root Root of the content tree, the paths of the index start with it
+        MetadataIndex(const fs::path& root);
+
+        /// @brief Set the callback receiving the paths of the files that changed or disappeared, called from the watcher thread
+        /// @param listener Callback
+        void SetStaleListener(StaleListener listener) { m_staleListener = std::move(listener); }
+
+        /// @brief Reads the whole content tree, replacing the current index
+        void Build();
+
+        /// @brief Applies a change of the content tree, to be registered as DirectoryWatcher listener
+        /// @param event Change
+        void OnWatchEvent(const WatchEvent& event);
+
+        /// @brief Gets the metadata of a regular file
+        /// @param filePath Path of the file, starting with the root
+        /// @return The metadata, nullptr if the file is not in the index
+        MetadataPtr FindFile(const fs::path& filePath) const;
+
+        /// @brief Tells whether a directory is in the index
+        /// @param dirPath Path of the directory, starting with the root
+        bool IsDirectory(const fs::path& dirPath) const;
+
+        /// @brief Number of indexed files
+        size_t GetFileCount() const;
+
+    private:
+        using FileMap = std::unordered_map<fs::path, MetadataPtr>;
+        using DirectorySet = std::unordered_set<fs::path>;
+
+        /// @brief Reads the metadata of one file
+        /// @return nullptr if the path is not a regular file
+        static MetadataPtr StatFile(const fs::path& filePath);
+
+        /// @brief Reads a subtree of the content tree
+        void Scan(const fs::path& dir, FileMap& outFiles, DirectorySet& outDirectories) const;
+
+        /// @brief Removes a directory and everything below it
+        void EraseTree(const fs::path& dir, std::vector<fs::path>& outStale);
+
+        void NotifyStale(const std::vector<fs::path>& stalePaths) const;
+
+    private:
+        fs::path m_root;
+        StaleListener m_staleListener;
+
+        std::mutex m_updateMtx;             // Serializes Build and the watcher events
+        mutable std::shared_mutex m_mtx;    // Guards the maps, taken shared by the request path
+        FileMap m_files;
+        DirectorySet m_directories;
+    };
+}
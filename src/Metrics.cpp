@@ -0,0 +1,116 @@
+#include "Metrics.h"
+
+namespace MC
+{
+    namespace
+    {
+        constexpr std::array<std::string_view, static_cast<size_t>(MetricsRoute::Count)> s_routeNames = { "file", "listing", "metrics", "other" };
+
+        std::atomic<size_t> s_nextShard{ 0 };
+
+        void AppendSeconds(std::string& out, uint64_t microseconds)
+        {
+            // Fixed point keeps every microsecond, %g would round long durations to six significant digits
+            char buffer[32];
+            int length = snprintf(buffer, sizeof(buffer), "%llu.%06llu",
+                static_cast<unsigned long long>(microseconds / 1000000), static_cast<unsigned long long>(microseconds % 1000000));
+            out.append(buffer, static_cast<size_t>(length));
+        }
+    }
+
+    Metrics::Metrics(size_t shardCount)
+        : m_shards{ nullptr }
+        , m_shardCount{ std::bit_ceil(std::max<size_t>(shardCount, 1)) }
+    {
+        m_shards = std::make_unique<Shard[]>(m_shardCount);
+    }
+
+    void Metrics::RecordRequest(MetricsRoute route, int status, uint64_t bytesSent, uint64_t latencyUs)
+    {
+        Shard& shard = GetLocalShard();
+
+        size_t statusIndex = status > 0 && static_cast<size_t>(status) < s_maxStatus ? static_cast<size_t>(status) : 0;
+        shard.statusCounts[statusIndex].fetch_add(1, std::memory_order_relaxed);
+        shard.bytesSent.fetch_add(bytesSent, std::memory_order_relaxed);
+
+        Histogram& histogram = shard.latency[static_cast<size_t>(route)];
+        size_t bucket = std::lower_bound(s_latencyBoundsUs.begin(), s_latencyBoundsUs.end(), latencyUs) - s_latencyBoundsUs.begin();
+        histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        histogram.sumUs.fetch_add(latencyUs, std::memory_order_relaxed);
+    }
+
+    void Metrics::AppendPrometheus(std::string& out) const
+    {
+        // Requests by status, a status outside of the valid range is reported as 0
+        out += "# HELP mc_http_requests_total Responses sent, by status code\n";
+        out += "# TYPE mc_http_requests_total counter\n";
+        for(size_t status = 0; status < s_maxStatus; status++)
+        {
+            uint64_t count = 0;
+            for(size_t i = 0; i < m_shardCount; i++)
+                count += m_shards[i].statusCounts[status].load(std::memory_order_relaxed);
+            if(count > 0)
+                out += "mc_http_requests_total{code=\"" + std::to_string(status) + "\"} " + std::to_string(count) + "\n";
+        }
+
+        uint64_t bytesSent = 0;
+        for(size_t i = 0; i < m_shardCount; i++)
+            bytesSent += m_shards[i].bytesSent.load(std::memory_order_relaxed);
+        AppendMetric(out, "mc_http_response_bytes_total", "counter", "Body bytes sent", bytesSent);
+
+        out += "# HELP mc_http_request_duration_seconds Time from the request line to the end of the response, by route\n";
+        out += "# TYPE mc_http_request_duration_seconds histogram\n";
+        for(size_t route = 0; route < s_routeCount; route++)
+        {
+            std::array<uint64_t, s_bucketCount> buckets{};
+            uint64_t sumUs = 0;
+            for(size_t i = 0; i < m_shardCount; i++)
+            {
+                const Histogram& histogram = m_shards[i].latency[route];
+                for(size_t b = 0; b < s_bucketCount; b++)
+                    buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+                sumUs += histogram.sumUs.load(std::memory_order_relaxed);
+            }
+
+            const std::string labels = std::string("route=\"") + std::string(s_routeNames[route]) + "\"";
+            uint64_t cumulative = 0;
+            for(size_t b = 0; b < s_bucketCount; b++)
+            {
+                cumulative += buckets[b];
+                out += "mc_http_request_duration_seconds_bucket{" + labels + ",le=\"";
+                if(b < s_latencyBoundsUs.size())
+                    AppendSeconds(out, s_latencyBoundsUs[b]);
+                else
+                    out += "+Inf";
+                out += "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += "mc_http_request_duration_seconds_sum{" + labels + "} ";
+            AppendSeconds(out, sumUs);
+            out += "\nmc_http_request_duration_seconds_count{" + labels + "} " + std::to_string(cumulative) + "\n";
+        }
+    }
+
+    void Metrics::AppendMetric(std::string& out, std::string_view name, std::string_view type, std::string_view help, uint64_t value)
+    {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+        out += name;
+        out += ' ';
+        out += std::to_string(value);
+        out += '\n';
+    }
+
+    Metrics::Shard& Metrics::GetLocalShard() const
+    {
+        // Threads keep their slot for their whole life, shared by every Metrics instance
+        thread_local size_t t_shard = s_nextShard.fetch_add(1, std::memory_order_relaxed);
+        return m_shards[t_shard & (m_shardCount - 1)];
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Routes with their own request counters and latency histogram
+    enum class MetricsRoute : uint8_t
+    {
+        File,
+        Listing,
+        Metrics,
+        Other,
+        Count
+    };
+
+    /// @brief Request metrics of the server, exposed in the Prometheus text format.
+    /// Every thread writes to its own shard (assigned round robin on first use), each shard sits on its own cache lines,
+    /// so recording a request is a handful of uncontended relaxed atomic adds. Reading sums the shards.
+    class Metrics
+    {
+    public:
+        /// @brief Upper bounds of the latency histogram buckets, in microseconds (the last bucket is +Inf)
+        static constexpr std::array<uint64_t, 15> s_latencyBoundsUs = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+            50000, 100000, 250000, 500000, 1000000, 2500000, 5000000 };
+
+        /// @brief Creates the metrics
+        /// @param shardCount Number of shards, rounded up to a power of two
+        Metrics(size_t shardCount = 16);
+
+        /// @brief Records a served request, called once per response
+        /// @param route Route that handled the request
+        /// @param status HTTP status code
+        /// @param bytesSent Body bytes sent
+        /// @param latencyUs Time from the request line to the end of the response
+        void RecordRequest(MetricsRoute route, int status, uint64_t bytesSent, uint64_t latencyUs);
+
+        /// @brief Appends the request metrics in the Prometheus text format
+        /// @param out Destination
+        void AppendPrometheus(std::string& out) const;
+
+        /// @brief Appends a single sample metric in the Prometheus text format, with its HELP and TYPE lines
+        /// @param out Destination
+        /// @param name Metric name
+        /// @param type "counter" or "gauge"
+        /// @param help Description
+        /// @param value Value
+        static void AppendMetric(std::string& out, std::string_view name, std::string_view type, std::string_view help, uint64_t value);
+
+    private:
+        static constexpr size_t s_maxStatus = 600;
+        static constexpr size_t s_routeCount = static_cast<size_t>(MetricsRoute::Count);
+        static constexpr size_t s_bucketCount = s_latencyBoundsUs.size() + 1;
+
+        struct Histogram
+        {
+            std::array<std::atomic<uint64_t>, s_bucketCount> buckets{};
+            std::atomic<uint64_t> sumUs{ 0 };
+        };
+
+        struct alignas(64) Shard
+        {
+            std::array<std::atomic<uint64_t>, s_maxStatus> statusCounts{};
+            std::atomic<uint64_t> bytesSent{ 0 };
+            std::array<Histogram, s_routeCount> latency{};
+        };
+
+        Shard& GetLocalShard() const;
+
+    private:
+        std::unique_ptr<Shard[]> m_shards;
+        size_t m_shardCount;
+    };
+}
@@ -0,0 +1,114 @@
+#include "OriginClient.h"
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib/httplib.h"
+
+namespace MC
+{
+    OriginClient::OriginClient(const std::string& url, size_t maxConnections, std::chrono::seconds timeout)
+        : m_url{ url }
+        , m_maxConnections{ std::max<size_t>(maxConnections, 1) }
+        , m_timeout{ timeout }
+        , m_valid{ false }
+        , m_connectionCount{ 0 }
+        , m_requestCount{ 0 }
+        , m_errorCount{ 0 }
+    {
+        // The first client validates the URL, it is kept as the first connection of the pool
+        std::unique_ptr<httplib::Client> client = this->Acquire();
+        m_valid = client->is_valid();
+        this->Release(std::move(client));
+    }
+
+    OriginClient::~OriginClient()
+    {
+    }
+
+    bool OriginClient::Get(const std::string& target, const std::string& ifNoneMatch, const std::string& ifModifiedSince, Response& outResponse,
+        const BodyReceiver& receiver)
+    {
+        // The caches compress on their own, the body is stored as the origin has it
+        httplib::Headers headers = { { "Accept-Encoding", "identity" } };
+        if(!ifNoneMatch.empty())
+            headers.emplace("If-None-Match", ifNoneMatch);
+        if(!ifModifiedSince.empty())
+            headers.emplace("If-Modified-Since", ifModifiedSince);
+
+        // The headers are known before the body, so that the receiver can decide where to put it
+        auto onResponse = [&outResponse](const httplib::Response& res)
+        {
+            outResponse.status = res.status;
+            outResponse.contentType = res.get_header_value("Content-Type");
+            outResponse.etag = res.get_header_value("ETag");
+            outResponse.lastModified = res.get_header_value("Last-Modified");
+            outResponse.cacheControl = res.get_header_value("Cache-Control");
+            outResponse.expires = res.get_header_value("Expires");
+
+            std::string age = res.get_header_value("Age");
+            outResponse.age = 0;
+            std::from_chars(age.data(), age.data() + age.size(), outResponse.age);
+            return true;
+        };
+        auto onContent = [&outResponse, &receiver](const char* data, size_t length)
+        {
+            if(receiver)
+                return receiver(data, length);
+
+            outResponse.body.append(data, length);
+            return true;
+        };
+
+        std::unique_ptr<httplib::Client> client = this->Acquire();
+        m_requestCount.fetch_add(1, std::memory_order_relaxed);
+        httplib::Result result = client->Get(target, headers, onResponse, onContent);
+        this->Release(std::move(client));
+
+        if(!result)
+        {
+            m_errorCount.fetch_add(1, std::memory_order_relaxed);
+            outResponse.error = httplib::to_string(result.error());
+            return false;
+        }
+        return true;
+    }
+
+    size_t OriginClient::GetConnectionCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_connectionCount;
+    }
+
+    std::unique_ptr<httplib::Client> OriginClient::Acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv.wait(lock, [this]() { return !m_idle.empty() || m_connectionCount < m_maxConnections; });
+        if(!m_idle.empty())
+        {
+            std::unique_ptr<httplib::Client> client = std::move(m_idle.back());
+            m_idle.pop_back();
+            return client;
+        }
+
+        m_connectionCount++;
+        lock.unlock();
+
+        // A closed keep-alive connection is reopened by the client on its next request
+        auto client = std::make_unique<httplib::Client>(m_url);
+        client->set_keep_alive(true);
+        client->set_follow_location(false);
+        client->set_url_encode(false);  // The targets are encoded by the caller, the queries are sent as the clients wrote them
+        client->set_connection_timeout(m_timeout);
+        client->set_read_timeout(m_timeout);
+        client->set_write_timeout(m_timeout);
+        return client;
+    }
+
+    void OriginClient::Release(std::unique_ptr<httplib::Client> client)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_idle.push_back(std::move(client));
+        }
+        m_cv.notify_one();
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace httplib
+{
+    class Client;
+}
+
+namespace MC
+{
+    /// @brief Pool of keep-alive connections to the upstream origin of the reverse proxy mode.
+    /// Each request borrows an idle connection, or opens one while the pool is below its size, otherwise it waits for one to be returned;
+    /// a connection is only used by one request at a time and stays open for the next one, so the origin sees a few long lived connections.
+    class OriginClient
+    {
+    public:
+        /// @brief Response of the origin, reduced to what the caches keep
+        struct Response
+        {
+            int status = 0;
+            std::string body;
+            std::string contentType;
+            std::string etag;
+            std::string lastModified;
+            std::string cacheControl;
+            std::string expires;
+            long age = 0;               // Seconds the response already spent in upstream caches
+            std::string error;          // Reason of a failed request
+        };
+
+        /// @brief Receives the body as it arrives, after the headers were set in the response
+        /// @return False to abort the transfer
+        using BodyReceiver = std::function<bool(const char* data, size_t length)>;
+
+        /// @brief Creates the pool, connections are opened on demand
+        /// @param url Origin, as scheme://host:port
+        /// @param maxConnections Maximum number of connections, at least one
+        /// @param timeout Connection, read and write timeout
+        OriginClient(const std::string& url, size_t maxConnections, std::chrono::seconds timeout);
+        ~OriginClient();
+
+        OriginClient(const OriginClient&) = delete;
+        OriginClient& operator=(const OriginClient&) = delete;
+
+        /// @brief Checks if the origin URL could be parsed
+        /// @return Bool result
+        bool IsValid() const { return m_valid; }
+
+        /// @brief Sends a GET request, conditional when validators of a stored copy are given. The body is asked without content coding.
+        /// @param[in] target Path and query of the object, percent-encoded
+        /// @param[in] ifNoneMatch Entity tag of the stored copy, empty for none
+        /// @param[in] ifModifiedSince Modification date of the stored copy, empty for none
+        /// @param[out] outResponse Response
+        /// @param[in] receiver Receiver of the body, which is then not kept in the response; nullptr keeps it
+        /// @return False if no complete response was received
+        bool Get(const std::string& target, const std::string& ifNoneMatch, const std::string& ifModifiedSince, Response& outResponse,
+            const BodyReceiver& receiver = nullptr);
+
+        /// @brief Number of requests sent so far
+        uint64_t GetRequestCount() const { return m_requestCount.load(std::memory_order_relaxed); }
+
+        /// @brief Number of requests that got no response so far
+        uint64_t GetErrorCount() const { return m_errorCount.load(std::memory_order_relaxed); }
+
+        /// @brief Number of connections of the pool, idle or in use
+        size_t GetConnectionCount() const;
+
+    private:
+        std::unique_ptr<httplib::Client> Acquire();
+        void Release(std::unique_ptr<httplib::Client> client);
+
+    private:
+        std::string m_url;
+        size_t m_maxConnections;
+        std::chrono::seconds m_timeout;
+        bool m_valid;
+
+        mutable std::mutex m_mtx;
+        std::condition_variable m_cv;
+        std::vector<std::unique_ptr<httplib::Client>> m_idle;
+        size_t m_connectionCount;
+
+        std::atomic<uint64_t> m_requestCount;
+        std::atomic<uint64_t> m_errorCount;
+    };
+}
@@ -0,0 +1,190 @@
+#include "RateLimiter.h"
+
+namespace MC
+{
+    namespace
+    {
+        // Paced chunks last about 1/20 s of the lowest bandwidth, within these bounds
+        constexpr size_t s_minChunkSize = 1024;
+        constexpr size_t s_maxChunkSize = 256 * 1024;
+    }
+
+    RateLimiter::RateLimiter(const Settings& settings)
+        : m_clientRequests{ MakeRate(settings.clientRequestsPerSec, settings.clientRequestBurst) }
+        , m_clientBytes{ MakeRate(settings.clientBytesPerSec, settings.clientBytesBurst) }
+        , m_globalRequests{ MakeRate(settings.globalRequestsPerSec, settings.globalRequestBurst) }
+        , m_globalBytes{ MakeRate(settings.globalBytesPerSec, settings.globalBytesBurst) }
+        , m_idleTimeoutNs{ std::chrono::duration_cast<std::chrono::nanoseconds>(settings.idleTimeout).count() }
+        , m_chunkSize{ s_maxChunkSize }
+        , m_globalRequestTat{ 0 }
+        , m_globalBytesTat{ 0 }
+        , m_clientCount{ 0 }
+        , m_rejectedCount{ 0 }
+        , m_pacingDelayUs{ 0 }
+        , m_pacingStopped{ false }
+    {
+        for(double bytesPerSec : { settings.clientBytesPerSec, settings.globalBytesPerSec })
+        {
+            if(bytesPerSec > 0)
+                m_chunkSize = std::min(m_chunkSize, std::max(static_cast<size_t>(bytesPerSec / 20), s_minChunkSize));
+        }
+    }
+
+    bool RateLimiter::AdmitRequest(const std::string& address, std::shared_ptr<Client>& outClient, std::chrono::nanoseconds& outRetryAfter)
+    {
+        int64_t now = Now();
+        outClient.reset();
+        if(m_clientRequests.nsPerToken > 0 || m_clientBytes.nsPerToken > 0)
+            outClient = this->GetClient(address, now);
+
+        int64_t wait = 0;
+        if(m_clientRequests.nsPerToken > 0)
+            wait = Take(outClient->requestTat, m_clientRequests, 1, now);
+
+        if(wait == 0 && m_globalRequests.nsPerToken > 0)
+        {
+            // A request refused by the global rate must not count against the client
+            wait = Take(m_globalRequestTat, m_globalRequests, 1, now);
+            if(wait > 0 && m_clientRequests.nsPerToken > 0)
+                Refund(outClient->requestTat, m_clientRequests, 1);
+        }
+
+        if(wait > 0)
+        {
+            m_rejectedCount.fetch_add(1, std::memory_order_relaxed);
+            outRetryAfter = std::chrono::nanoseconds(wait);
+            return false;
+        }
+        return true;
+    }
+
+    void RateLimiter::Pace(Client* client, size_t bytes)
+    {
+        if(m_pacingStopped.load(std::memory_order_relaxed))
+            return;
+
+        // Both buckets are debited right away, the chunk then waits for the later of the two
+        int64_t now = Now();
+        int64_t wait = 0;
+        if(client && m_clientBytes.nsPerToken > 0)
+            wait = Reserve(client->bytesTat, m_clientBytes, static_cast<double>(bytes), now);
+        if(m_globalBytes.nsPerToken > 0)
+            wait = std::max(wait, Reserve(m_globalBytesTat, m_globalBytes, static_cast<double>(bytes), now));
+        if(wait <= 0)
+            return;
+
+        std::unique_lock<std::mutex> lock(m_pacingMtx);
+        m_pacingCv.wait_for(lock, std::chrono::nanoseconds(wait), [this]() { return m_pacingStopped.load(); });
+        m_pacingDelayUs.fetch_add(static_cast<uint64_t>(std::max<int64_t>(Now() - now, 0) / 1000), std::memory_order_relaxed);
+    }
+
+    void RateLimiter::StopPacing()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pacingMtx);
+            m_pacingStopped = true;
+        }
+        m_pacingCv.notify_all();
+    }
+
+    size_t RateLimiter::Sweep()
+    {
+        int64_t now = Now();
+        size_t removed = 0;
+        for(Shard& shard : m_shards)
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mtx);
+            for(auto it = shard.clients.begin(); it != shard.clients.end();)
+            {
+                // A client is only forgotten once its buckets are full again, otherwise coming back would reset its debt
+                const Client& client = *it->second;
+                bool idle = now - client.lastSeen.load(std::memory_order_relaxed) > m_idleTimeoutNs
+                    && client.requestTat.load(std::memory_order_relaxed) <= now
+                    && client.bytesTat.load(std::memory_order_relaxed) <= now
+                    && it->second.use_count() == 1;
+                if(idle)
+                {
+                    it = shard.clients.erase(it);
+                    removed++;
+                }
+                else
+                    ++it;
+            }
+        }
+        m_clientCount.fetch_sub(removed, std::memory_order_relaxed);
+        return removed;
+    }
+
+    RateLimiter::BucketRate RateLimiter::MakeRate(double perSec, double burst)
+    {
+        BucketRate rate;
+        if(perSec <= 0)
+            return rate;
+
+        rate.nsPerToken = 1e9 / perSec;
+        rate.toleranceNs = static_cast<int64_t>((burst > 0 ? std::max(burst, 1.0) : std::max(perSec, 1.0)) * rate.nsPerToken);
+        return rate;
+    }
+
+    int64_t RateLimiter::Take(std::atomic<int64_t>& tat, const BucketRate& rate, double tokens, int64_t now)
+    {
+        int64_t cost = static_cast<int64_t>(tokens * rate.nsPerToken);
+        int64_t current = tat.load(std::memory_order_relaxed);
+        while(true)
+        {
+            int64_t next = std::max(current, now) + cost;
+            int64_t excess = next - now - rate.toleranceNs;
+            if(excess > 0)
+                return excess;
+            if(tat.compare_exchange_weak(current, next, std::memory_order_relaxed))
+                return 0;
+        }
+    }
+
+    void RateLimiter::Refund(std::atomic<int64_t>& tat, const BucketRate& rate, double tokens)
+    {
+        tat.fetch_sub(static_cast<int64_t>(tokens * rate.nsPerToken), std::memory_order_relaxed);
+    }
+
+    int64_t RateLimiter::Reserve(std::atomic<int64_t>& tat, const BucketRate& rate, double tokens, int64_t now)
+    {
+        int64_t cost = static_cast<int64_t>(tokens * rate.nsPerToken);
+        int64_t current = tat.load(std::memory_order_relaxed);
+        int64_t next = 0;
+        do
+        {
+            next = std::max(current, now) + cost;
+        }
+        while(!tat.compare_exchange_weak(current, next, std::memory_order_relaxed));
+        return std::max<int64_t>(next - now - rate.toleranceNs, 0);
+    }
+
+    int64_t RateLimiter::Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::shared_ptr<RateLimiter::Client> RateLimiter::GetClient(const std::string& address, int64_t now)
+    {
+        Shard& shard = m_shards[std::hash<std::string>{}(address) % s_shardCount];
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mtx);
+            auto it = shard.clients.find(address);
+            if(it != shard.clients.end())
+            {
+                it->second->lastSeen.store(now, std::memory_order_relaxed);
+                return it->second;
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        auto [it, inserted] = shard.clients.try_emplace(address, nullptr);
+        if(inserted)
+        {
+            it->second = std::make_shared<Client>();
+            m_clientCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        it->second->lastSeen.store(now, std::memory_order_relaxed);
+        return it->second;
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Per client and global limits on the request rate and on the bandwidth.
+    /// Each limit is a token bucket kept as a single atomic "theoretical arrival time" (GCRA): taking tokens is one
+    /// compare-and-swap, without any lock. Clients are found by address in sharded maps, under a shared lock
+    /// that is only taken exclusively to add or sweep entries.
+    /// Requests over their rate are rejected, bytes over their rate are delayed so that transfers are paced instead.
+    class RateLimiter
+    {
+    public:
+        struct Settings
+        {
+            double clientRequestsPerSec = 0;    // 0 disables the limit
+            double clientRequestBurst = 0;      // Requests accepted at once, 0 allows one second worth
+            double clientBytesPerSec = 0;
+            double clientBytesBurst = 0;        // Bytes sent at full speed before the pacing starts, 0 allows one second worth
+            double globalRequestsPerSec = 0;
+            double globalRequestBurst = 0;
+            double globalBytesPerSec = 0;
+            double globalBytesBurst = 0;
+            std::chrono::seconds idleTimeout{ 60 }; // Clients are forgotten once idle for this long and back to a full bucket
+        };
+
+        /// @brief Buckets of one client address, kept alive by the transfers still using them after a sweep
+        struct Client
+        {
+            std::atomic<int64_t> requestTat{ 0 };
+            std::atomic<int64_t> bytesTat{ 0 };
+            std::atomic<int64_t> lastSeen{ 0 };
+        };
+
+        /// @brief Creates the limiter
+        /// @param settings Rates and bursts
+        RateLimiter(const Settings& settings);
+
+        RateLimiter(const RateLimiter&) = delete;
+        RateLimiter& operator=(const RateLimiter&) = delete;
+
+        /// @brief Tells whether any limit is set
+        bool IsEnabled() const { return LimitsRequests() || LimitsBandwidth(); }
+
+        /// @brief Tells whether a request rate is limited
+        bool LimitsRequests() const { return m_clientRequests.nsPerToken > 0 || m_globalRequests.nsPerToken > 0; }
+
+        /// @brief Tells whether a bandwidth is limited, the responses must then be written through Pace
+        bool LimitsBandwidth() const { return m_clientBytes.nsPerToken > 0 || m_globalBytes.nsPerToken > 0; }
+
+        /// @brief Takes a request token from the client and the global buckets
+        /// @param[in] address Client address
+        /// @param[out] outClient Buckets of the client, to pace its response with. Null when no client limit is set.
+        /// @param[out] outRetryAfter Time until a request would be accepted, when rejected
+        /// @return False if the request is over a rate
+        bool AdmitRequest(const std::string& address, std::shared_ptr<Client>& outClient, std::chrono::nanoseconds& outRetryAfter);
+
+        /// @brief Waits until a chunk of a response may be sent. Returns at once when the bandwidth is available.
+        /// @param client Buckets of the client, null to only apply the global bandwidth
+        /// @param bytes Size of the chunk
+        void Pace(Client* client, size_t bytes);
+
+        /// @brief Size of the chunks a paced response should be written in, about 50 ms of the lowest bandwidth
+        size_t GetChunkSize() const { return m_chunkSize; }
+
+        /// @brief Ends the pacing: waiting chunks are sent at once and no more delay is applied, for a quick shutdown
+        void StopPacing();
+
+        /// @brief Forgets the idle clients
+        /// @return Number of clients removed
+        size_t Sweep();
+
+        /// @brief Number of clients tracked
+        size_t GetClientCount() const { return m_clientCount.load(std::memory_order_relaxed); }
+
+        /// @brief Number of requests rejected so far
+        uint64_t GetRejectedCount() const { return m_rejectedCount.load(std::memory_order_relaxed); }
+
+        /// @brief Time spent waiting by the paced responses so far, in microseconds
+        uint64_t GetPacingDelayUs() const { return m_pacingDelayUs.load(std::memory_order_relaxed); }
+
+    private:
+        /// @brief Rate of a bucket, the state is the atomic passed to Take and Reserve
+        struct BucketRate
+        {
+            double nsPerToken = 0;      // 0 means unlimited
+            int64_t toleranceNs = 0;    // Burst, as the time it takes to refill
+        };
+
+        static BucketRate MakeRate(double perSec, double burst);
+
+        /// @brief Takes tokens if the bucket holds enough
+        /// @return 0 if taken, otherwise the time to wait before they would be available
+        static int64_t Take(std::atomic<int64_t>& tat, const BucketRate& rate, double tokens, int64_t now);
+
+        /// @brief Gives back tokens taken by Take
+        static void Refund(std::atomic<int64_t>& tat, const BucketRate& rate, double tokens);
+
+        /// @brief Takes tokens in advance, the bucket may go into debt
+        /// @return Time to wait before the tokens are actually available, 0 if they are
+        static int64_t Reserve(std::atomic<int64_t>& tat, const BucketRate& rate, double tokens, int64_t now);
+
+        static int64_t Now();
+
+        std::shared_ptr<Client> GetClient(const std::string& address, int64_t now);
+
+    private:
+        static constexpr size_t s_shardCount = 64;
+
+        struct alignas(64) Shard
+        {
+            std::shared_mutex mtx;
+            std::unordered_map<std::string, std::shared_ptr<Client>> clients;
+        };
+
+        BucketRate m_clientRequests;
+        BucketRate m_clientBytes;
+        BucketRate m_globalRequests;
+        BucketRate m_globalBytes;
+        int64_t m_idleTimeoutNs;
+        size_t m_chunkSize;
+
+        alignas(64) std::atomic<int64_t> m_globalRequestTat;
+        alignas(64) std::atomic<int64_t> m_globalBytesTat;
+        std::array<Shard, s_shardCount> m_shards;
+
+        std::atomic<size_t> m_clientCount;
+        std::atomic<uint64_t> m_rejectedCount;
+        std::atomic<uint64_t> m_pacingDelayUs;
+
+        // Waiting chunks sleep here, so that StopPacing can wake them
+        std::mutex m_pacingMtx;
+        std::condition_variable m_pacingCv;
+        std::atomic<bool> m_pacingStopped;
+    };
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Defines.h"
+#include "AccessLog.h"
+#include "Metrics.h"
+
+namespace MC
+{
+    /// @brief Per request data collected for the access log and the metrics, from the pre-routing handler up to the logger
+    struct RequestContext
+    {
+        std::chrono::steady_clock::time_point start{};
+        CacheStatus cacheStatus = CacheStatus::None;
+        MetricsRoute route = MetricsRoute::Other;
+    };
+}
@@ -2,6 +2,22 @@
 
 #include "Cache.h"
 #include "Logger.h"
+#include "HttpUtils.h"
+#include "Compression.h"
+#include "AccessLog.h"
+#include "WorkerPool.h"
+#include "DirectoryWatcher.h"
+#include "DirectoryListing.h"
+#include "MetadataIndex.h"
+#include "CacheSnapshot.h"
+#include "Metrics.h"
+#include "RequestContext.h"
+#include "EventLoopServer.h"
+#include "TlsContext.h"
+#include "RateLimiter.h"
+#include "SingleFlight.h"
+#include "OriginClient.h"
+#include "DiskCache.h"
 
 #include "INIreader/INIreader.hpp"
 
@@ -11,83 +27,546 @@
 
 namespace MC
 {
+    namespace
+    {
+        // Smaller files barely shrink, a compressed variant is not worth its memory
+        constexpr size_t s_minCompressSize = 256;
+
+        // Stale files are refreshed off the request path, a couple of threads keep up with the expiries of the hot files
+        constexpr size_t s_refreshThreads = 2;
+
+        //! With httplib a request is processed by a single worker thread, from the pre-routing handler up to the logger,
+        //! so a thread local slot is enough. The event loop interleaves connections and carries the context between the two.
+        thread_local RequestContext t_requestContext;
+
+        // Set while an event loop runs a handler: bodies are handed over there instead of through a content provider
+        thread_local ZeroCopyBody* t_zeroCopyBody = nullptr;
+
+        // Buckets of the client of the request, set by the rate limiting and taken along by the paced content providers
+        thread_local std::shared_ptr<RateLimiter::Client> t_rateClient;
+
+        /// @brief Hands the accepted connections of httplib to a WorkerPool
+        class PoolTaskQueue final : public httplib::TaskQueue
+        {
+        public:
+            PoolTaskQueue(std::shared_ptr<WorkerPool> pool)
+                : m_pool{ std::move(pool) }
+            {
+            }
+
+            bool enqueue(std::function<void()> fn) override { return m_pool->Enqueue(std::move(fn)); }
+
+            // The pool outlives the listener, CreateServer shuts it down once every listener has returned
+            void shutdown() override {}
+
+        private:
+            std::shared_ptr<WorkerPool> m_pool;     // Shared by the listeners and the metrics
+        };
+
+        // Forward secret AEAD ciphers only, ECDSA first since its handshakes are cheaper, AES-GCM before ChaCha20 for AES-NI hardware
+        constexpr const char* s_defaultTlsCiphers = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:"
+            "ECDHE-RSA-AES256-GCM-SHA384:ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+        constexpr const char* s_defaultTlsCipherSuites = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+
+        /// @brief Writes the next part of a body held in memory, in paced chunks when a bandwidth is limited
+        bool WriteBody(const char* data, size_t length, httplib::DataSink& sink, RateLimiter* limiter, RateLimiter::Client* client)
+        {
+            if(limiter)
+            {
+                length = std::min(length, limiter->GetChunkSize());
+                limiter->Pace(client, length);
+            }
+            return sink.write(data, length);
+        }
+
+        constexpr std::string_view s_overloadedBody = "<p>Error Status: <span style='color:red;'>503</span></p>";
+
+        /// @brief First handler of every request: starts the access log context and answers 503 on the shedding thread
+        httplib::Server::HandlerResponse PreRoute(const httplib::Request&, httplib::Response& res)
+        {
+            t_requestContext = { std::chrono::steady_clock::now(), CacheStatus::None, MetricsRoute::Other };
+            if(!WorkerPool::IsShedding())
+                return httplib::Server::HandlerResponse::Unhandled;
+
+            //! httplib keeps a connection open unless the request asks otherwise, failing the body write is the only way to close it.
+            //! The body is sent in full before the provider reports the failure.
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+            res.set_header("Connection", "close");
+            res.set_content_provider(s_overloadedBody.size(), "text/html",
+                [](size_t offset, size_t length, httplib::DataSink& sink)
+                {
+                    sink.write(s_overloadedBody.data() + offset, length);
+                    return false;
+                });
+            return httplib::Server::HandlerResponse::Handled;
+        }
+
+        /// @brief Freshness lifetime of an origin response (RFC 9111 4.2.1)
+        /// @return Seconds, 0 when the response must be revalidated before every use, -1 when it never expires
+        long GetFreshnessLifetime(const CacheControl& cacheControl, const std::string& expires, long age, long defaultTtl)
+        {
+            if(cacheControl.noCache)
+                return 0;
+            if(cacheControl.maxAge >= 0)
+                return std::max(cacheControl.maxAge - age, 0L);
+
+            // An invalid date means already expired
+            time_t expiresTime = 0;
+            if(!expires.empty())
+                return ParseHttpDate(expires, expiresTime) ? std::max(static_cast<long>(expiresTime - time(nullptr)), 0L) : 0;
+
+            // Without explicit freshness the origin objects live as long as the local files
+            return defaultTtl > 0 ? defaultTtl : -1;
+        }
+
+        /// @brief Target of an origin request, also the key of the object in the caches: the normalized path, percent-encoded,
+        /// followed by the query of the client as it was sent
+        /// @param relativePath Path of the request relative to the content directory
+        /// @param requestTarget Raw target of the request
+        std::string MakeOriginTarget(const fs::path& relativePath, std::string_view requestTarget)
+        {
+            std::string target = "/";
+            AppendUrlEncodedPath(target, relativePath.generic_string());
+
+            std::string_view query = requestTarget.substr(0, requestTarget.find('#'));
+            if(size_t start = query.find('?'); start != std::string_view::npos && start + 1 < query.size())
+                target.append(query.substr(start));
+            return target;
+        }
+
+        /// @brief Builds the metadata of an object of the origin
+        /// @param object Object, its headers are moved into the metadata
+        /// @param size Size of the body
+        /// @return The metadata
+        std::shared_ptr<FileMetadata> MakeOriginMetadata(DiskCache::Object& object, uint64_t size)
+        {
+            auto metadata = std::make_shared<FileMetadata>();
+            metadata->size = size;
+            metadata->contentType = std::move(object.contentType);
+            metadata->validators.etag = std::move(object.etag);
+            metadata->validators.lastModified = std::move(object.lastModified);
+            ParseHttpDate(metadata->validators.lastModified, metadata->validators.mtime);
+            metadata->cacheControl = std::move(object.cacheControl);
+            metadata->fetchTime = object.fetchTime;
+            if(metadata->validators.etag.empty())
+            {
+                // The variants derive their tags from this one, a missing tag is made from the content, or from the size and
+                // the download time of a body left on disk
+                char contentTag[40];
+                if(object.body.size() == size)
+                    snprintf(contentTag, sizeof(contentTag), "\"%zx\"", std::hash<std::string>{}(object.body));
+                else
+                    snprintf(contentTag, sizeof(contentTag), "\"%llx-%llx\"", static_cast<unsigned long long>(size), static_cast<unsigned long long>(object.fetchTime));
+                metadata->validators.etag = contentTag;
+            }
+            return metadata;
+        }
+
+        /// @brief Builds a cached file from an object of the origin, with its stored variants and its metadata attached
+        /// @param object Object, its bodies are moved into the file
+        /// @return The file
+        Cache::FilePtr MakeOriginFile(DiskCache::Object object)
+        {
+            std::shared_ptr<FileMetadata> metadata = MakeOriginMetadata(object, object.body.size());
+            auto file = std::make_shared<CachedFile>(std::move(object.body));
+            for(auto& [encoding, variant] : object.variants)
+                file->SetVariant(encoding, std::move(variant));
+            file->SetMetadata(std::move(metadata));
+            return file;
+        }
+
+        std::string_view FindHeader(const httplib::Headers& headers, const char* key)
+        {
+            auto it = headers.find(key);
+            return it != headers.end() ? std::string_view(it->second) : std::string_view{};
+        }
+    }
+
     Server::Server()
         : m_configLoaded{ false }
         , m_port{ 80 }
+        , m_httpsPort{ 0 }
         , m_contentDir{ "./content" }
         , m_cacheTtl{ 0 }
+        , m_cacheStaleSec{ 0 }
+        , m_cacheMaxBytes{ 0 }
+        , m_cacheMaxEntries{ 0 }
+        , m_streamThreshold{ 4 * 1024 * 1024 }
+        , m_compression{ true }
         , m_certificate{ "" }
         , m_certificateKey{ "" }
+        , m_certificatePollIntervalSec{ 5 }
+        , m_tlsMinVersion{ "1.2" }
+        , m_tlsCiphers{ "" }
+        , m_tlsCipherSuites{ "" }
+        , m_tlsCurves{ "" }
+        , m_tlsSessionCacheSize{ 20480 }
+        , m_tlsSessionTimeoutSec{ 3600 }
+        , m_tlsTicketRotationSec{ 3600 }
+        , m_tlsKtls{ false }
         , m_logPath{ "" }
-        , m_cache{ std::make_unique<Cache>() }
+        , m_accessLogPath{ "" }
+        , m_accessLogFormat{ AccessLogFormat::Combined }
+        , m_logRotateBytes{ 0 }
+        , m_logRotateIntervalSec{ 0 }
+        , m_logRotateKeep{ 5 }
+        , m_logLevel{ LogLevel::Info }
+        , m_logQueueSize{ 8192 }
+        , m_logBlockWhenFull{ false }
+        , m_logFlushBytes{ 64 * 1024 }
+        , m_logFlushIntervalMs{ 200 }
+        , m_eventLoopMode{ false }
+        , m_workerThreads{ 0 }
+        , m_maxQueuedConnections{ 1024 }
+        , m_workerAffinity{ false }
+        , m_keepAliveMaxCount{ 100 }
+        , m_keepAliveTimeoutSec{ 60 }
+        , m_readTimeoutSec{ 5 }
+        , m_writeTimeoutSec{ 5 }
+        , m_tcpNoDelay{ true }
+        , m_socketSendBuffer{ 0 }
+        , m_socketReceiveBuffer{ 0 }
+        , m_listingPageSize{ 1000 }
+        , m_watchPolling{ false }
+        , m_watchPollIntervalMs{ 2000 }
+        , m_snapshotPath{ "" }
+        , m_snapshotIntervalSec{ 300 }
+        , m_warmupFiles{ 1000 }
+        , m_warmupThreads{ 4 }
+        , m_adminAddress{ "127.0.0.1" }
+        , m_adminPort{ 0 }
+        , m_rateLimitRequests{ 0 }
+        , m_rateLimitRequestBurst{ 0 }
+        , m_rateLimitBytes{ 0 }
+        , m_rateLimitBytesBurst{ 0 }
+        , m_globalRateLimitRequests{ 0 }
+        , m_globalRateLimitRequestBurst{ 0 }
+        , m_globalRateLimitBytes{ 0 }
+        , m_globalRateLimitBytesBurst{ 0 }
+        , m_rateLimitIdleSec{ 60 }
+        , m_originUrl{ "" }
+        , m_originConnections{ 8 }
+        , m_originTimeoutSec{ 10 }
+        , m_diskCacheDir{ "" }
+        , m_diskCacheMaxBytes{ 1024ull * 1024 * 1024 }
         , m_logger{ std::make_unique<Logger>() }
+        , m_cache{ std::make_unique<Cache>() }
+        , m_fileLoads{ std::make_unique<SingleFlight<fs::path, Cache::FilePtr>>() }
+        , m_originLoads{ std::make_unique<SingleFlight<fs::path, OriginObject>>() }
+        , m_metrics{ std::make_unique<Metrics>() }
+        , m_backgroundStop{ false }
+        , m_rateLimiter{ std::make_shared<RateLimiter>(RateLimiter::Settings{}) }
+        , m_certificates{ std::make_unique<TlsCertificateStore>() }
+        , m_certificateReloads{ 0 }
+        , m_certificateReloadFailures{ 0 }
     {
+        m_cache->SetLogger(m_logger.get());
+
         // Custom handlers definition
 
         m_fileRequestHandler = [this](const httplib::Request& req, httplib::Response& res)
             {
-                std::cout << "File request: " << req.path << std::endl;
-                // Send the file as download
-                fs::path filePath = m_contentDir / req.path.substr(1); // Remove leading '/'
-                if(fs::exists(filePath) && fs::is_regular_file(filePath))
+                t_requestContext.route = MetricsRoute::File;
+                MC_LOG_DEBUG(*m_logger, "File request: ", req.path);
+
+                // Reject paths escaping the content directory
+                if(!httplib::detail::is_valid_path(req.path))
+                {
+                    res.status = 400;
+                    res.set_content("Invalid path", "text/plain");
+                    return;
+                }
+
+                // Send the file as download, everything about it is known by the index without touching the disk
+                fs::path filePath = (m_contentDir / req.path.substr(1)).lexically_normal(); // Remove leading '/'
+                if(!filePath.has_filename())
+                    filePath = filePath.parent_path();
+
+                MetadataIndex::MetadataPtr metadata = m_index->FindFile(filePath);
+                Cache::FilePtr file;
+                OriginObject origin;
+                if(!metadata && m_origin && !m_index->IsDirectory(filePath))
                 {
-                    std::string fileData;
+                    // Not a local file: pulled from the origin through the memory and disk caches, with its own metadata.
+                    // Queries are part of the object, the origin may answer each one differently.
+                    origin = this->GetOriginFile(MakeOriginTarget(filePath.lexically_relative(m_contentDir), req.target));
+                    if(origin.status != 200)
+                    {
+                        res.status = origin.status;
+                        return;
+                    }
+                    file = origin.file;
+                    metadata = origin.metadata;
+                }
 
-                    // Check if the file is not cached
-                    if(!m_cache->GetCachedFile(filePath, fileData))
+                if(metadata)
+                {
+                    uintmax_t fileSize = metadata->size;
+                    FileValidators validators = metadata->validators;
+                    const bool fromOrigin = origin.status == 200;
+                    const std::string contentType = metadata->contentType.empty() ? "application/octet-stream" : metadata->contentType;
+
+                    // Check if the file is not cached. An expired file within the stale window is still served, the first request to find it
+                    // has it reloaded in the background.
+                    bool stale = false;
+                    bool refresh = false;
+                    if(fromOrigin)
+                    {
+                        MC_LOG_TRACE(*m_logger, "File pulled from origin: ", filePath);
+                    }
+                    else if(m_cache->GetCachedFile(filePath, file, stale, refresh))
                     {
-                        // Then try to read the file from disk
-                        std::cout << "File not in cache, reading from disk..." << std::endl;
-                        std::ifstream fileStream(filePath, std::ios::binary);
-                        if(!fileStream)
+                        t_requestContext.cacheStatus = stale ? CacheStatus::Stale : CacheStatus::Hit;
+                        MC_LOG_TRACE(*m_logger, stale ? "Stale file found in cache: " : "File found in cache: ", filePath);
+                        if(refresh)
+                            this->RefreshCachedFile(filePath);
+                    }
+                    else if(fileSize < m_streamThreshold)
+                    {
+                        // Then try to read the file from disk, unless another request is already reading it
+                        bool shared = false;
+                        file = this->LoadCachedFile(filePath, metadata, shared);
+                        t_requestContext.cacheStatus = shared ? CacheStatus::Coalesced : CacheStatus::Miss;
+                        MC_LOG_DEBUG(*m_logger, shared ? "File not in cache, read by a concurrent request: " : "File not in cache, read from disk: ", filePath);
+                        if(!file)
                         {
                             res.status = 500;
                             res.set_content("Failed to open file", "text/plain");
-                            std::cerr << "Failed to open file: " << filePath.string() << std::endl;
+                            MC_LOG_ERROR(*m_logger, "Failed to open file: ", filePath);
                             return;
                         }
-                        std::ostringstream buffer;
-                        buffer << fileStream.rdbuf();
-                        fileData = buffer.str();
+                    }
+
+                    // Range requests always get the identity, so that the byte offsets refer to the file on disk
+                    ContentEncoding encoding = ContentEncoding::Identity;
+                    if(file && file->HasEncodedVariants())
+                    {
+                        res.set_header("Vary", "Accept-Encoding");
+                        if(req.ranges.empty())
+                            encoding = SelectEncoding(req.get_header_value("Accept-Encoding"), *file);
+                    }
+
+                    if(encoding != ContentEncoding::Identity)
+                    {
+                        // Each variant is a different representation, it needs its own entity tag
+                        validators.etag.insert(validators.etag.size() - 1, std::string("-") + GetEncodingToken(encoding));
+                        res.set_header("Content-Encoding", GetEncodingToken(encoding));
+                    }
+
+                    res.set_header("ETag", validators.etag);
+                    if(!validators.lastModified.empty())
+                        res.set_header("Last-Modified", validators.lastModified);
+
+                    // Downstream caches follow the directives of the origin, the age includes the time spent in this cache
+                    if(fromOrigin)
+                    {
+                        if(!metadata->cacheControl.empty())
+                            res.set_header("Cache-Control", metadata->cacheControl);
+                        res.set_header("Age", std::to_string(std::max<time_t>(time(nullptr) - metadata->fetchTime, 0)));
+                    }
+
+                    // The client copy is still valid, nothing to send
+                    if(IsNotModified(req, validators))
+                    {
+                        res.status = 304;
+                        MC_LOG_DEBUG(*m_logger, "File not modified: ", filePath);
+                        return;
+                    }
 
-                        // Add the data to the cache
-                        m_cache->AddCachedFile(filePath, fileData);
+                    if(file)
+                    {
+                        // Aliasing pointer: the provider keeps the whole cached file alive while pointing to the selected variant
+                        this->SetBufferContent(res, std::shared_ptr<const std::string>(file, file->GetVariant(encoding)), contentType);
+                    }
+                    else if(fromOrigin)
+                    {
+                        // Large objects of the origin are streamed from their file in the disk cache
+                        this->SetMappedContent(res, origin.mapping, origin.bodyOffset, fileSize, contentType);
                     }
                     else
-                        std::cout << "File found in cache!" << std::endl;
+                    {
+                        // Large files are never materialized in memory, they are streamed from a memory mapping.
+                        // With kTLS the mapped pages are encrypted by the kernel on their way to the socket, OpenSSL never copies them.
+                        t_requestContext.cacheStatus = CacheStatus::Stream;
+                        MC_LOG_DEBUG(*m_logger, "File not in cache, streaming from disk", IsKtlsSendActive(req.ssl) ? " over kTLS: " : ": ", filePath);
+                        if(!this->SetMappedContent(res, filePath, contentType))
+                        {
+                            res.status = 500;
+                            res.set_content("Failed to open file", "text/plain");
+                            MC_LOG_ERROR(*m_logger, "Failed to open file: ", filePath);
+                            return;
+                        }
+                    }
+
+                    // Local files are sent as downloads, a proxy keeps the representation of the origin
+                    if(!fromOrigin)
+                    {
+                        res.set_header("Content-Disposition", "attachment; filename=\"" + filePath.filename().string() + "\"");
+                        res.set_header("File-Size", FormatFileSize(fileSize));
+                    }
+                    res.set_header("Accept-Ranges", "bytes");
 
-                    res.set_content(fileData, "application/octet-stream");
-                    res.set_header("Content-Disposition", "attachment; filename=\"" + filePath.filename().string() + "\"");
-                    res.set_header("File-Size", this->FormatFileSize(fs::file_size(filePath)));
-                    res.status = 200;
+                    //! The status is left unset on purpose: httplib then answers 206 and slices the content provider
+                    //! for single and multipart ranges, reading straight from the cached buffer or the memory mapping.
+                    if(!req.ranges.empty() && !IsRangeApplicable(req, validators))
+                        res.status = 200;
 
-                    std::cout << "Serving file: " << filePath.string() << std::endl;
+                    MC_LOG_TRACE(*m_logger, "Serving file: ", filePath);
+                }
+                else if(m_index->IsDirectory(filePath))
+                {
+                    this->SetListingContent(req, res, filePath.lexically_relative(m_contentDir));
                 }
                 else
                 {
                     res.status = 404;
                     res.set_content("File not found", "text/plain");
-                    std::cout << "File not found: " << filePath.string() << std::endl;
+                    MC_LOG_DEBUG(*m_logger, "File not found: ", filePath);
                 }
             };
 
-        m_errorHandler = [](const httplib::Request& req, httplib::Response& res)
+        m_errorHandler = [](const httplib::Request&, httplib::Response& res)
             {
+                // The overload response is already complete, see CreateServer
+                if(WorkerPool::IsShedding())
+                    return;
+
                 auto fmt = "<p>Error Status: <span style='color:red;'>%d</span></p>";
                 char buf[BUFSIZ];
                 snprintf(buf, sizeof(buf), fmt, res.status);
                 res.set_content(buf, "text/html");
             };
 
+        m_metricsHandler = [this](const httplib::Request&, httplib::Response& res)
+            {
+                t_requestContext.route = MetricsRoute::Metrics;
+
+                std::string body;
+                body.reserve(16 * 1024);
+                m_metrics->AppendPrometheus(body);
+
+                Cache::Stats cacheStats = m_cache->GetStats();
+                Metrics::AppendMetric(body, "mc_cache_hits_total", "counter", "Cache lookups that found the file", cacheStats.hits);
+                Metrics::AppendMetric(body, "mc_cache_misses_total", "counter", "Cache lookups that did not find the file", cacheStats.misses);
+                Metrics::AppendMetric(body, "mc_cache_stale_hits_total", "counter", "Cache hits on expired files served while being refreshed", cacheStats.staleHits);
+                Metrics::AppendMetric(body, "mc_cache_coalesced_misses_total", "counter", "Cache misses served by the read of a concurrent request", m_fileLoads->GetSharedCount());
+                Metrics::AppendMetric(body, "mc_cache_loads_in_progress", "gauge", "Files being read from disk to be cached", m_fileLoads->GetPendingCount());
+                Metrics::AppendMetric(body, "mc_cache_insertions_total", "counter", "Files added to the cache", cacheStats.insertions);
+                Metrics::AppendMetric(body, "mc_cache_rejections_total", "counter", "Files refused by the admission filter", cacheStats.rejections);
+                Metrics::AppendMetric(body, "mc_cache_evictions_total", "counter", "Files evicted to make room", cacheStats.evictions);
+                Metrics::AppendMetric(body, "mc_cache_expirations_total", "counter", "Files dropped by the TTL", cacheStats.expirations);
+                Metrics::AppendMetric(body, "mc_cache_invalidations_total", "counter", "Files dropped because they changed on disk", cacheStats.invalidations);
+                Metrics::AppendMetric(body, "mc_cache_entries", "gauge", "Files in the cache", cacheStats.entries);
+                Metrics::AppendMetric(body, "mc_cache_resident_bytes", "gauge", "Bytes held by the cache, all variants included", cacheStats.bytes);
+
+                if(m_origin)
+                {
+                    Metrics::AppendMetric(body, "mc_origin_requests_total", "counter", "Requests sent to the origin", m_origin->GetRequestCount());
+                    Metrics::AppendMetric(body, "mc_origin_errors_total", "counter", "Requests to the origin that got no response", m_origin->GetErrorCount());
+                    Metrics::AppendMetric(body, "mc_origin_connections", "gauge", "Pooled keep-alive connections to the origin", m_origin->GetConnectionCount());
+                    Metrics::AppendMetric(body, "mc_origin_coalesced_pulls_total", "counter", "Pulls from the origin shared with a concurrent request", m_originLoads->GetSharedCount());
+                }
+                if(m_diskCache)
+                {
+                    DiskCache::Stats diskStats = m_diskCache->GetStats();
+                    Metrics::AppendMetric(body, "mc_disk_cache_hits_total", "counter", "Disk cache lookups that found the object", diskStats.hits);
+                    Metrics::AppendMetric(body, "mc_disk_cache_misses_total", "counter", "Disk cache lookups that did not find the object", diskStats.misses);
+                    Metrics::AppendMetric(body, "mc_disk_cache_writes_total", "counter", "Objects written to the disk cache", diskStats.writes);
+                    Metrics::AppendMetric(body, "mc_disk_cache_evictions_total", "counter", "Objects evicted from the disk cache to make room", diskStats.evictions);
+                    Metrics::AppendMetric(body, "mc_disk_cache_entries", "gauge", "Objects in the disk cache", diskStats.entries);
+                    Metrics::AppendMetric(body, "mc_disk_cache_bytes", "gauge", "Bytes used by the disk cache", diskStats.bytes);
+                }
+
+                for(const auto& [name, logger] : { std::pair{ "app", m_logger.get() }, std::pair{ "access", m_accessLogger.get() } })
+                {
+                    if(!logger)
+                        continue;
+                    std::string prefix = std::string("mc_log_") + name;
+                    Metrics::AppendMetric(body, prefix + "_queue_depth", "gauge", "Log lines waiting for the writer thread", logger->GetQueueDepth());
+                    Metrics::AppendMetric(body, prefix + "_dropped_total", "counter", "Log lines dropped because the queue was full", logger->GetDroppedCount());
+                }
+
+                std::shared_ptr<WorkerPool> pool;
+                std::shared_ptr<EventLoopServer> eventLoop;
+                std::shared_ptr<RateLimiter> rateLimiter;
+                SSL_CTX* tlsContext = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(m_serverMtx);
+                    pool = m_workerPool;
+                    rateLimiter = m_rateLimiter;
+                    for(const Listener& listener : m_listeners)
+                    {
+                        if(listener.eventLoop)
+                            eventLoop = listener.eventLoop;
+                        if(auto* sslServer = dynamic_cast<httplib::SSLServer*>(listener.httpServer.get()))
+                            tlsContext = sslServer->ssl_context();
+                    }
+                }
+                if(pool)
+                {
+                    Metrics::AppendMetric(body, "mc_connections_active", "gauge", "Connections being served", pool->GetActiveCount());
+                    Metrics::AppendMetric(body, "mc_connections_queued", "gauge", "Connections waiting for a worker", pool->GetQueueDepth());
+                    Metrics::AppendMetric(body, "mc_connections_shed_total", "counter", "Connections answered with 503 because the queue was full", pool->GetShedCount());
+                }
+                if(eventLoop)
+                    Metrics::AppendMetric(body, "mc_connections_open", "gauge", "Client connections open on the event loops", eventLoop->GetConnectionCount());
+
+                if(rateLimiter && rateLimiter->IsEnabled())
+                {
+                    Metrics::AppendMetric(body, "mc_rate_limit_rejected_total", "counter", "Requests answered with 429 because a request rate was exceeded", rateLimiter->GetRejectedCount());
+                    Metrics::AppendMetric(body, "mc_rate_limit_clients", "gauge", "Client addresses tracked by the rate limiter", rateLimiter->GetClientCount());
+                    Metrics::AppendMetric(body, "mc_rate_limit_pacing_delay_us_total", "counter", "Time paced responses spent waiting for bandwidth, in microseconds", rateLimiter->GetPacingDelayUs());
+                }
+
+                if(tlsContext)
+                {
+                    Metrics::AppendMetric(body, "mc_tls_handshakes_total", "counter", "Completed TLS handshakes", SSL_CTX_sess_accept_good(tlsContext));
+                    Metrics::AppendMetric(body, "mc_tls_resumed_total", "counter", "Handshakes that resumed a session from the cache or a ticket", SSL_CTX_sess_hits(tlsContext));
+                    Metrics::AppendMetric(body, "mc_tls_session_misses_total", "counter", "Session IDs not found in the cache", SSL_CTX_sess_misses(tlsContext));
+                    Metrics::AppendMetric(body, "mc_tls_session_cache_entries", "gauge", "Sessions in the server cache", SSL_CTX_sess_number(tlsContext));
+                    Metrics::AppendMetric(body, "mc_tls_session_cache_full_total", "counter", "Sessions dropped because the cache was full", SSL_CTX_sess_cache_full(tlsContext));
+                    Metrics::AppendMetric(body, "mc_tls_certificate_reloads_total", "counter", "Certificates reloaded while running", m_certificateReloads.load());
+                    Metrics::AppendMetric(body, "mc_tls_certificate_reload_failures_total", "counter", "Rejected certificate reloads, the previous certificate was kept", m_certificateReloadFailures.load());
+                }
+
+                res.set_content(body, "text/plain; version=0.0.4");
+            };
+
         m_loggerHandler = [this](const httplib::Request& req, const httplib::Response& res)
             {
-                std::stringstream ssMsg;
-                ssMsg << req.remote_addr << " " << req.path;
+                // The response is sent, its client must not be kept from a sweep by this thread
+                t_rateClient.reset();
+
+                AccessLogEntry entry;
+                entry.remoteAddr = req.remote_addr;
+                entry.method = req.method;
+                entry.target = req.target;
+                entry.version = req.version;
+                entry.referer = FindHeader(req.headers, "Referer");
+                entry.userAgent = FindHeader(req.headers, "User-Agent");
+                entry.status = res.status;
+                entry.cacheStatus = t_requestContext.cacheStatus;
+                entry.tls = req.ssl != nullptr;
+
+                // Bodies are not sent for HEAD and 304, otherwise Content-Length holds the size after ranges were applied
+                if(req.method != "HEAD" && res.status != 304)
+                {
+                    std::string_view contentLength = FindHeader(res.headers, "Content-Length");
+                    if(contentLength.empty() || std::from_chars(contentLength.data(), contentLength.data() + contentLength.size(), entry.bytesSent).ec != std::errc{})
+                        entry.bytesSent = res.body.size();
+                }
+
+                // Requests rejected before routing never got a start time
+                if(t_requestContext.start != std::chrono::steady_clock::time_point{})
+                    entry.latencyUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_requestContext.start).count());
 
-                if(res.has_header("File-Size"))
-                    ssMsg << " " << res.get_header_value("File-Size");
+                m_metrics->RecordRequest(t_requestContext.route, res.status, entry.bytesSent, entry.latencyUs);
 
-                m_logger->LogRequest(ssMsg.str());
+                Logger& accessLogger = m_accessLogger ? *m_accessLogger : *m_logger;
+                accessLogger.LogRequest(FormatAccessLog(m_accessLogFormat, entry));
+
+                t_requestContext = {};
             };
     }
 
@@ -100,7 +579,18 @@ namespace MC
         {
             this->DisplayConfiguration();
             m_cache->SetTTL(m_cacheTtl);
-            m_logger->SetLogFilePath(m_logPath);
+            m_cache->SetStaleWindow(m_cacheStaleSec);
+            m_cache->SetCapacity(m_cacheMaxBytes, m_cacheMaxEntries);
+
+            // The queue capacity is fixed at construction, replace the default logger
+            m_cache->SetLogger(nullptr);
+            m_logger = this->MakeLogger(m_logPath);
+            m_logger->SetLevel(m_logLevel);
+
+            // Access lines get their own file when requested, otherwise they are mixed with the application messages
+            if(!m_accessLogPath.empty())
+                m_accessLogger = this->MakeLogger(m_accessLogPath);
+            m_cache->SetLogger(m_logger.get());
         }
     }
 
@@ -122,10 +612,81 @@ namespace MC
         // Read configuration values
         m_port = config.GetInteger("server", "listening_port", 80);
         m_contentDir = config.Get("server", "content_directory", "./content");
+        m_contentDir = m_contentDir.lexically_normal();
+        if(!m_contentDir.has_filename())
+            m_contentDir = m_contentDir.parent_path(); // The index keys and the request paths are built the same way
         m_cacheTtl = config.GetInteger("server", "cache_ttl", 0);
+        m_cacheStaleSec = static_cast<int>(std::max(config.GetInteger("server", "cache_stale_while_revalidate_s", 0), 0L));
+        m_cacheMaxBytes = static_cast<size_t>(std::max(config.GetInteger("server", "cache_max_bytes", 0), 0L));
+        m_cacheMaxEntries = static_cast<size_t>(std::max(config.GetInteger("server", "cache_max_entries", 0), 0L));
+        m_streamThreshold = static_cast<uintmax_t>(std::max(config.GetInteger("server", "stream_threshold_bytes", 4 * 1024 * 1024), 0L));
+        m_compression = config.GetBoolean("server", "compression", true);
         m_certificate = config.Get("server", "certificate", "");
         m_certificateKey = config.Get("server", "certificate_key", "");
+        m_httpsPort = static_cast<int>(std::max(config.GetInteger("server", "https_port", 0), 0L));
+        m_certificatePollIntervalSec = std::max(config.GetInteger("server", "certificate_poll_interval_s", 5), 0L);
+        m_tlsMinVersion = config.Get("server", "tls_min_version", "1.2");
+        m_tlsCiphers = config.Get("server", "tls_ciphers", s_defaultTlsCiphers);
+        m_tlsCipherSuites = config.Get("server", "tls_ciphersuites", s_defaultTlsCipherSuites);
+        m_tlsCurves = config.Get("server", "tls_curves", "X25519:P-256:P-384");
+        m_tlsSessionCacheSize = static_cast<size_t>(std::max(config.GetInteger("server", "tls_session_cache_size", 20480), 0L));
+        m_tlsSessionTimeoutSec = std::max(config.GetInteger("server", "tls_session_timeout_s", 3600), 1L);
+        m_tlsTicketRotationSec = std::max(config.GetInteger("server", "tls_ticket_key_rotation_s", 3600), 0L);
+        m_tlsKtls = config.GetBoolean("server", "tls_ktls", false);
         m_logPath = config.Get("server", "log_path", "");
+        m_accessLogPath = config.Get("server", "access_log_path", "");
+        if(!ParseAccessLogFormat(config.Get("server", "access_log_format", "combined"), m_accessLogFormat))
+            std::cerr << "Unknown access_log_format, using combined" << std::endl;
+        m_logRotateBytes = static_cast<uint64_t>(std::max(config.GetInteger("server", "log_rotate_bytes", 0), 0L));
+        m_logRotateIntervalSec = std::max(config.GetInteger("server", "log_rotate_interval_s", 0), 0L);
+        m_logRotateKeep = static_cast<size_t>(std::max(config.GetInteger("server", "log_rotate_keep", 5), 0L));
+        if(!ParseLogLevel(config.Get("server", "log_level", "info"), m_logLevel))
+            std::cerr << "Unknown log_level, using info" << std::endl;
+        m_logQueueSize = static_cast<size_t>(std::max(config.GetInteger("server", "log_queue_size", 8192), 1L));
+        m_logBlockWhenFull = config.Get("server", "log_overflow_policy", "drop") == "block";
+        m_logFlushBytes = static_cast<size_t>(std::max(config.GetInteger("server", "log_flush_bytes", 64 * 1024), 0L));
+        m_logFlushIntervalMs = static_cast<int>(std::max(config.GetInteger("server", "log_flush_interval_ms", 200), 1L));
+        m_eventLoopMode = config.Get("server", "io_model", "threads") == "epoll";
+        m_workerThreads = static_cast<size_t>(std::max(config.GetInteger("server", "worker_threads", 0), 0L));
+        m_maxQueuedConnections = static_cast<size_t>(std::max(config.GetInteger("server", "max_queued_connections", 1024), 0L));
+        m_workerAffinity = config.GetBoolean("server", "worker_cpu_affinity", false);
+        m_keepAliveMaxCount = static_cast<size_t>(std::max(config.GetInteger("server", "keep_alive_max_count", 100), 1L));
+        m_keepAliveTimeoutSec = std::max(config.GetInteger("server", "keep_alive_timeout_s", 60), 0L);
+        m_readTimeoutSec = std::max(config.GetInteger("server", "read_timeout_s", 5), 0L);
+        m_writeTimeoutSec = std::max(config.GetInteger("server", "write_timeout_s", 5), 0L);
+        m_tcpNoDelay = config.GetBoolean("server", "tcp_nodelay", true);
+        m_socketSendBuffer = static_cast<int>(std::max(config.GetInteger("server", "socket_send_buffer", 0), 0L));
+        m_socketReceiveBuffer = static_cast<int>(std::max(config.GetInteger("server", "socket_receive_buffer", 0), 0L));
+        m_listingPageSize = static_cast<size_t>(std::max(config.GetInteger("server", "listing_page_size", 1000), 1L));
+        m_watchPolling = config.Get("server", "watch_mode", "inotify") == "poll";
+        m_watchPollIntervalMs = std::max(config.GetInteger("server", "watch_poll_interval_ms", 2000), 10L);
+        m_snapshotPath = config.Get("server", "cache_snapshot_path", "");
+        m_snapshotIntervalSec = std::max(config.GetInteger("server", "cache_snapshot_interval_s", 300), 1L);
+        m_warmupFiles = static_cast<size_t>(std::max(config.GetInteger("server", "cache_warmup_files", 1000), 0L));
+        m_warmupThreads = static_cast<size_t>(std::max(config.GetInteger("server", "cache_warmup_threads", 4), 1L));
+        m_adminAddress = config.Get("server", "admin_address", "127.0.0.1");
+        m_adminPort = static_cast<int>(std::max(config.GetInteger("server", "admin_port", 0), 0L));
+        m_rateLimitRequests = std::max(config.GetReal("server", "rate_limit_requests_per_s", 0), 0.0);
+        m_rateLimitRequestBurst = std::max(config.GetReal("server", "rate_limit_request_burst", 0), 0.0);
+        m_rateLimitBytes = std::max(config.GetReal("server", "rate_limit_bytes_per_s", 0), 0.0);
+        m_rateLimitBytesBurst = std::max(config.GetReal("server", "rate_limit_bytes_burst", 0), 0.0);
+        m_globalRateLimitRequests = std::max(config.GetReal("server", "global_rate_limit_requests_per_s", 0), 0.0);
+        m_globalRateLimitRequestBurst = std::max(config.GetReal("server", "global_rate_limit_request_burst", 0), 0.0);
+        m_globalRateLimitBytes = std::max(config.GetReal("server", "global_rate_limit_bytes_per_s", 0), 0.0);
+        m_globalRateLimitBytesBurst = std::max(config.GetReal("server", "global_rate_limit_bytes_burst", 0), 0.0);
+        m_rateLimitIdleSec = std::max(config.GetInteger("server", "rate_limit_idle_s", 60), 1L);
+        m_originUrl = config.Get("server", "origin_url", "");
+        m_originConnections = static_cast<size_t>(std::max(config.GetInteger("server", "origin_connections", 8), 1L));
+        m_originTimeoutSec = std::max(config.GetInteger("server", "origin_timeout_s", 10), 1L);
+        m_diskCacheDir = config.Get("server", "disk_cache_directory", "");
+        m_diskCacheMaxBytes = static_cast<uint64_t>(std::max(config.GetInteger("server", "disk_cache_max_bytes", 1024L * 1024 * 1024), 0L));
+
+        // An origin pull waits on the network for up to origin_timeout_s, on an event loop it would stall every connection of the loop
+        if(m_eventLoopMode && !m_originUrl.empty())
+        {
+            std::cerr << "io_model=epoll cannot be combined with origin_url, using threads" << std::endl;
+            m_eventLoopMode = false;
+        }
 
         // Mark configuration as loaded
         m_configLoaded = true;
@@ -137,11 +698,58 @@ namespace MC
     {
         std::cout << "Server Configuration:" << std::endl;
         std::cout << "  Port: " << m_port << std::endl;
+        std::cout << "  HTTPS Port: " << (m_certificate.empty() ? "off" : m_httpsPort > 0 ? std::to_string(m_httpsPort) : "main port") << std::endl;
         std::cout << "  Content Directory: " << m_contentDir << std::endl;
-        std::cout << "  Cache TTL: " << m_cacheTtl << " seconds" << std::endl;
+        std::cout << "  Cache TTL: " << (m_cacheTtl > 0 ? std::to_string(m_cacheTtl) + " seconds" : "off") << std::endl;
+        std::cout << "  Cache Stale-While-Revalidate: " << ((m_cacheTtl > 0 || !m_originUrl.empty()) && m_cacheStaleSec > 0 ? std::to_string(m_cacheStaleSec) + " seconds" : "off") << std::endl;
+        std::cout << "  Cache Max Bytes: " << (m_cacheMaxBytes > 0 ? FormatFileSize(m_cacheMaxBytes) : "unlimited") << std::endl;
+        std::cout << "  Cache Max Entries: " << (m_cacheMaxEntries > 0 ? std::to_string(m_cacheMaxEntries) : "unlimited") << std::endl;
+        std::cout << "  Stream Threshold: " << FormatFileSize(m_streamThreshold) << std::endl;
+        std::cout << "  Compression: " << (m_compression ? "on" : "off") << std::endl;
         std::cout << "  Certificate: " << m_certificate << std::endl;
         std::cout << "  Certificate Key: " << m_certificateKey << std::endl;
+        std::cout << "  Certificate Reload: on SIGHUP" << (m_certificatePollIntervalSec > 0 ? ", on change checked every " + std::to_string(m_certificatePollIntervalSec) + " s" : "") << std::endl;
+        std::cout << "  TLS: min " << m_tlsMinVersion << ", curves " << m_tlsCurves
+            << ", session cache " << (m_tlsSessionCacheSize > 0 ? std::to_string(m_tlsSessionCacheSize) + " entries" : "off")
+            << ", tickets " << (m_tlsTicketRotationSec > 0 ? "rotated every " + std::to_string(m_tlsTicketRotationSec) + " s" : "off")
+            << ", kTLS " << (m_tlsKtls ? "on" : "off") << std::endl;
         std::cout << "  Log Path: " << m_logPath << std::endl;
+        std::cout << "  Access Log Path: " << (m_accessLogPath.empty() ? m_logPath : m_accessLogPath) << std::endl;
+        std::cout << "  Access Log Format: " << (m_accessLogFormat == AccessLogFormat::Json ? "json" : "combined") << std::endl;
+        std::cout << "  Log Rotation: " << (m_logRotateBytes > 0 ? FormatFileSize(m_logRotateBytes) : "no size limit") << ", "
+            << (m_logRotateIntervalSec > 0 ? std::to_string(m_logRotateIntervalSec) + " s" : "no age limit") << ", keep " << m_logRotateKeep << std::endl;
+        std::cout << "  Log Level: " << GetLogLevelName(m_logLevel) << std::endl;
+        std::cout << "  Log Queue: " << m_logQueueSize << " messages, " << (m_logBlockWhenFull ? "block" : "drop") << " when full" << std::endl;
+        std::cout << "  Log Flush: every " << FormatFileSize(m_logFlushBytes) << " or " << m_logFlushIntervalMs << " ms" << std::endl;
+        std::cout << "  I/O Model: " << (m_eventLoopMode ? "epoll, one event loop per worker thread" : "threads, one worker per connection") << std::endl;
+        std::cout << "  Worker Threads: " << (m_workerThreads > 0 ? m_workerThreads : m_eventLoopMode ? std::max(std::thread::hardware_concurrency(), 1u) : CPPHTTPLIB_THREAD_POOL_COUNT)
+            << (m_workerAffinity ? ", pinned" : "") << std::endl;
+        std::cout << "  Max Queued Connections: " << (m_maxQueuedConnections > 0 ? std::to_string(m_maxQueuedConnections) : "unlimited") << std::endl;
+        std::cout << "  Keep-Alive: " << m_keepAliveMaxCount << " requests, " << m_keepAliveTimeoutSec << " s" << std::endl;
+        std::cout << "  Timeouts: read " << m_readTimeoutSec << " s, write " << m_writeTimeoutSec << " s" << std::endl;
+        std::cout << "  TCP_NODELAY: " << (m_tcpNoDelay ? "on" : "off") << std::endl;
+        std::cout << "  Socket Buffers: send " << (m_socketSendBuffer > 0 ? FormatFileSize(m_socketSendBuffer) : "default")
+            << ", receive " << (m_socketReceiveBuffer > 0 ? FormatFileSize(m_socketReceiveBuffer) : "default") << std::endl;
+        std::cout << "  Listing Page Size: " << m_listingPageSize << " entries" << std::endl;
+        std::cout << "  Cache Snapshot: " << (m_snapshotPath.empty() ? "off" : m_snapshotPath.string() + ", every " + std::to_string(m_snapshotIntervalSec) + " s") << std::endl;
+        std::cout << "  Cache Warm-up: " << (m_snapshotPath.empty() || m_warmupFiles == 0 ? "off" : std::to_string(m_warmupFiles) + " files, " + std::to_string(m_warmupThreads) + " threads") << std::endl;
+        auto formatRate = [](double perSec, double burst, bool bytes)
+            {
+                if(perSec <= 0)
+                    return std::string("off");
+                auto format = [bytes](double value) { return bytes ? FormatFileSize(static_cast<uintmax_t>(value)) : std::to_string(static_cast<uint64_t>(value)); };
+                return format(perSec) + "/s, burst " + format(burst > 0 ? burst : perSec);
+            };
+        std::cout << "  Rate Limit Per Client: requests " << formatRate(m_rateLimitRequests, m_rateLimitRequestBurst, false)
+            << ", bytes " << formatRate(m_rateLimitBytes, m_rateLimitBytesBurst, true) << ", forgotten after " << m_rateLimitIdleSec << " s idle" << std::endl;
+        std::cout << "  Rate Limit Global: requests " << formatRate(m_globalRateLimitRequests, m_globalRateLimitRequestBurst, false)
+            << ", bytes " << formatRate(m_globalRateLimitBytes, m_globalRateLimitBytesBurst, true) << std::endl;
+        std::cout << "  Origin: " << (m_originUrl.empty() ? "off" : m_originUrl + ", " + std::to_string(m_originConnections) + " connections, timeout "
+            + std::to_string(m_originTimeoutSec) + " s") << std::endl;
+        std::cout << "  Disk Cache: " << (m_originUrl.empty() || m_diskCacheDir.empty() ? "off" : m_diskCacheDir.string() + ", "
+            + (m_diskCacheMaxBytes > 0 ? FormatFileSize(m_diskCacheMaxBytes) : "unlimited")) << std::endl;
+        std::cout << "  Metrics: " << (m_adminPort > 0 ? "/metrics on " + m_adminAddress + ":" + std::to_string(m_adminPort) : "/metrics on the main port") << std::endl;
+        std::cout << "  Watch Mode: " << (m_watchPolling ? "poll every " + std::to_string(m_watchPollIntervalMs) + " ms" : "inotify") << std::endl;
     }
 
     bool Server::CreateServer()
@@ -152,110 +760,969 @@ namespace MC
             return false;
         }
 
-        //! We don't need SSLServer specific methods, so it's ok to just use a pointer to the base class.
-        //! This allows for both implementations with cleaner code.
-        std::unique_ptr<httplib::Server> server;
-
-        // Try to create the HTTPS server
-        server = std::make_unique<httplib::SSLServer>(m_certificate.c_str(), m_certificateKey.c_str());
-        if(!server->is_valid())
+        auto startupStart = std::chrono::steady_clock::now();
         {
-            std::cout << "[SERVER] Certificate or key not found, falling back to HTTP" << std::endl;
+            // A previous run may still own its listeners
+            std::lock_guard<std::mutex> lock(m_serverMtx);
+            m_listeners.clear();
+            m_workerPool.reset();
+            m_refreshPool.reset();
+
+            RateLimiter::Settings rateSettings;
+            rateSettings.clientRequestsPerSec = m_rateLimitRequests;
+            rateSettings.clientRequestBurst = m_rateLimitRequestBurst;
+            rateSettings.clientBytesPerSec = m_rateLimitBytes;
+            rateSettings.clientBytesBurst = m_rateLimitBytesBurst;
+            rateSettings.globalRequestsPerSec = m_globalRateLimitRequests;
+            rateSettings.globalRequestBurst = m_globalRateLimitRequestBurst;
+            rateSettings.globalBytesPerSec = m_globalRateLimitBytes;
+            rateSettings.globalBytesBurst = m_globalRateLimitBytesBurst;
+            rateSettings.idleTimeout = std::chrono::seconds(m_rateLimitIdleSec);
+            m_rateLimiter = std::make_shared<RateLimiter>(rateSettings);
+        }
 
-            // fallback to HTTP
-            server = std::make_unique<httplib::Server>();
-            if(!server->is_valid())
+        // Initializing OpenSSL and parsing the certificate take a few ms, done while the content directory is indexed
+        std::unique_ptr<httplib::Server> httpsServer;
+        std::thread httpsThread;
+        if(!m_certificate.empty())
+            httpsThread = std::thread([this, &httpsServer]() { httpsServer = this->CreateHttpsServer(); });
+
+        // Listings are rendered once and kept current by the watcher
+        m_watcher.reset();
+        m_listing = std::make_unique<DirectoryListing>(m_contentDir, m_listingPageSize, m_compression);
+        m_watcher = std::make_unique<DirectoryWatcher>(m_contentDir, std::chrono::milliseconds(m_watchPollIntervalMs));
+        m_watcher->SetLogger(m_logger.get());
+        m_watcher->AddListener([listing = m_listing.get()](const WatchEvent& event) { listing->OnWatchEvent(event); });
+
+        // The index is filled after the watches are in place, so that no change can be missed in between
+        m_index = std::make_unique<MetadataIndex>(m_contentDir);
+        m_index->SetStaleListener([this](const fs::path& filePath)
             {
-                std::cerr << "[ERROR] Server could not be created with or without SSL" << std::endl;
-                return false;
+                MC_LOG_DEBUG(*m_logger, "File changed on disk: ", filePath);
+                m_cache->RemoveCachedFile(filePath);
+
+                // A precompressed sibling is part of the cached file it belongs to
+                if(std::string_view extension = filePath.extension().native(); extension == ".gz" || extension == ".br" || extension == ".zst")
+                    m_cache->RemoveCachedFile(fs::path(filePath).replace_extension());
+            });
+        m_watcher->AddListener([index = m_index.get()](const WatchEvent& event) { index->OnWatchEvent(event); });
+        m_watcher->Start(m_watchPolling);
+
+        auto indexStart = std::chrono::steady_clock::now();
+        m_index->Build();
+        std::cout << "[SERVER] Indexed " << m_index->GetFileCount() << " files in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - indexStart).count() << " ms" << std::endl;
+
+        // Origin mode: the requests for files missing from the content directory are pulled from the origin
+        m_origin.reset();
+        m_diskCache.reset();
+        if(!m_originUrl.empty())
+        {
+            m_origin = std::make_unique<OriginClient>(m_originUrl, m_originConnections, std::chrono::seconds(m_originTimeoutSec));
+            if(!m_origin->IsValid())
+            {
+                std::cerr << "[ERROR] Invalid origin_url " << m_originUrl << ", serving the content directory only" << std::endl;
+                m_origin.reset();
             }
+        }
+
+        if(m_origin && !m_diskCacheDir.empty())
+        {
+            std::string error;
+            m_diskCache = std::make_unique<DiskCache>(m_diskCacheDir, m_diskCacheMaxBytes);
+            if(m_diskCache->Open(error))
+                std::cout << "[SERVER] Disk cache opened with " << m_diskCache->GetStats().entries << " objects" << std::endl;
             else
             {
-                std::cout << "[SERVER] HTTP server created" << std::endl;
+                std::cerr << "[ERROR] Disk cache disabled, " << error << std::endl;
+                m_diskCache.reset();
             }
         }
-        else
+
+        std::vector<Listener> listeners;
+
+        // Without an HTTPS port, HTTPS replaces HTTP on the main port
+        bool httpsOnMainPort = m_httpsPort == 0;
+        if(httpsThread.joinable())
+        {
+            httpsThread.join();
+            if(httpsServer)
+                listeners.push_back({ "https", "0.0.0.0", httpsOnMainPort ? m_port : m_httpsPort, std::move(httpsServer), nullptr, {} });
+            else if(httpsOnMainPort)
+                std::cout << "[SERVER] Falling back to HTTP on port " << m_port << std::endl;
+        }
+
+        if(listeners.empty() || !httpsOnMainPort)
         {
-            std::cout << "[SERVER] HTTPS server created" << std::endl;
+            // TLS is only terminated by httplib, the event loops serve the plain HTTP port
+            bool useEventLoop = m_eventLoopMode;
+            if(useEventLoop && !EventLoopServer::IsSupported())
+            {
+                std::cout << "[SERVER] The epoll backend is not supported on this platform, using threads" << std::endl;
+                useEventLoop = false;
+            }
+
+            if(useEventLoop)
+            {
+                listeners.push_back({ "http", "0.0.0.0", m_port, nullptr, this->CreateEventLoopServer(), {} });
+                std::cout << "[SERVER] HTTP event loop server created" << std::endl;
+            }
+            else if(auto httpServer = this->CreateHttpServer())
+                listeners.push_back({ "http", "0.0.0.0", m_port, std::move(httpServer), nullptr, {} });
+        }
+
+        if(listeners.empty())
+        {
+            std::cerr << "[ERROR] Server could not be created with or without SSL" << std::endl;
+            return false;
         }
 
+        if(m_adminPort > 0)
+            listeners.push_back({ "admin", m_adminAddress, m_adminPort, this->CreateAdminServer(), nullptr, {} });
+
+        // Every port is bound before any listener runs, so that a port in use is reported at once
+        bool bound = true;
+        for(Listener& listener : listeners)
+        {
+            if(listener.eventLoop ? !listener.eventLoop->Bind(listener.address, listener.port) : !listener.httpServer->bind_to_port(listener.address, listener.port))
+            {
+                std::cerr << "Failed to start " << listener.name << " server on port " << listener.port << std::endl;
+                bound = false;
+            }
+        }
+        if(!bound)
+            return false;
+
+        {
+            // The HTTP and HTTPS listeners share the workers, so that a burst on one port can use the threads idle on the other
+            std::lock_guard<std::mutex> lock(m_serverMtx);
+            m_workerPool = std::make_shared<WorkerPool>(m_workerThreads > 0 ? m_workerThreads : CPPHTTPLIB_THREAD_POOL_COUNT,
+                m_maxQueuedConnections, m_workerAffinity);
+            if((m_cacheTtl > 0 || m_origin) && m_cacheStaleSec > 0)
+                m_refreshPool = std::make_unique<WorkerPool>(s_refreshThreads, 0, false);
+
+            // Each listener accepts on its own thread, kept reachable from Stop while listening
+            m_listeners = std::move(listeners);
+            for(Listener& listener : m_listeners)
+            {
+                listener.thread = std::thread([&listener]()
+                    {
+                        if(listener.eventLoop)
+                            listener.eventLoop->Run();
+                        else
+                            listener.httpServer->listen_after_bind();
+                    });
+            }
+
+            std::cout << "Listening on";
+            for(const Listener& listener : m_listeners)
+                std::cout << " " << listener.name << " " << listener.address << ":" << listener.port;
+            std::cout << ", started in " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startupStart).count() / 1000.0
+                << " ms" << std::endl;
+        }
+
+        // Warm-up runs while the server already accepts requests
+        this->StartBackgroundTasks();
+
+        // Stop ends every listener, the workers finish the pending requests once none is left to feed them
+        for(Listener& listener : m_listeners)
+            listener.thread.join();
+        m_workerPool->Shutdown();
+        if(m_refreshPool)
+            m_refreshPool->Shutdown();
+
+        this->StopBackgroundTasks();
+        std::cout << "Server stopped!" << std::endl;
+
+        return true;
+    }
+
+    std::unique_ptr<httplib::Server> Server::CreateHttpServer()
+    {
+        auto server = std::make_unique<httplib::Server>();
+        if(!server->is_valid())
+            return nullptr;
+
+        std::cout << "[SERVER] HTTP server created" << std::endl;
+        this->SetupHttpServer(*server);
+        return server;
+    }
+
+    std::unique_ptr<httplib::Server> Server::CreateHttpsServer()
+    {
+        std::string error;
+        if(!m_certificates->Load(m_certificate, m_certificateKey, error))
+        {
+            std::cerr << "[ERROR] HTTPS disabled, " << error << std::endl;
+            return nullptr;
+        }
+
+        // Protocol, cipher and session resumption settings on top of the certificate
+        m_ticketKeys = std::make_unique<TlsTicketKeys>(std::chrono::seconds(std::max(m_tlsTicketRotationSec, 1L)));
+        auto server = std::make_unique<httplib::SSLServer>([this, &error](SSL_CTX& ctx)
+            {
+                // Same base options as the httplib constructors
+                SSL_CTX_set_options(&ctx, SSL_OP_NO_COMPRESSION | SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION);
+
+                // Each handshake takes the current certificate from the store, a reload never modifies a context in use
+                m_certificates->Attach(&ctx);
+
+                TlsSettings settings;
+                settings.minVersion = m_tlsMinVersion;
+                settings.ciphers = m_tlsCiphers;
+                settings.cipherSuites = m_tlsCipherSuites;
+                settings.curves = m_tlsCurves;
+                settings.sessionCacheSize = m_tlsSessionCacheSize;
+                settings.sessionTimeoutSec = m_tlsSessionTimeoutSec;
+                settings.ticketKeyRotationSec = m_tlsTicketRotationSec;
+                settings.ktls = m_tlsKtls;
+                return ConfigureTlsContext(&ctx, settings, m_ticketKeys.get(), error);
+            });
+        if(!server->is_valid())
+        {
+            std::cerr << "[ERROR] HTTPS disabled, invalid TLS setting " << error << std::endl;
+            return nullptr;
+        }
+
+        std::cout << "[SERVER] HTTPS server created, certificate " << m_certificates->GetDescription() << std::endl;
+        this->SetupHttpServer(*server);
+        return server;
+    }
+
+    std::unique_ptr<httplib::Server> Server::CreateAdminServer()
+    {
+        auto server = std::make_unique<httplib::Server>();
+        server->new_task_queue = []() { return new httplib::ThreadPool(2); };
+        server->Get("/metrics", m_metricsHandler);
+        server->set_pre_routing_handler(PreRoute);
+        server->set_logger(m_loggerHandler);
+        return server;
+    }
+
+    void Server::SetupHttpServer(httplib::Server& server)
+    {
         // Setup the server with the loaded configuration
-        server->set_base_dir(m_contentDir.string());
-        server->set_mount_point("/", m_contentDir.string());
-        server->set_keep_alive_max_count(100);
-        server->set_keep_alive_timeout(60);
+        //! Files are served by our own route instead of a mount point, otherwise httplib would map every file before our handler runs
+        server.set_keep_alive_max_count(m_keepAliveMaxCount);
+        server.set_keep_alive_timeout(m_keepAliveTimeoutSec);
+        server.set_read_timeout(m_readTimeoutSec);
+        server.set_write_timeout(m_writeTimeoutSec);
+
+        //! Headers and body are written separately, with Nagle's algorithm the body waits for the delayed ACK of the client (~40 ms)
+        server.set_tcp_nodelay(m_tcpNoDelay);
+
+        // Buffer sizes set on the listening socket are inherited by the accepted connections
+        server.set_socket_options([sendBuffer = m_socketSendBuffer, receiveBuffer = m_socketReceiveBuffer](socket_t sock)
+            {
+                httplib::default_socket_options(sock);
+                if(sendBuffer > 0)
+                    httplib::detail::set_socket_opt(sock, SOL_SOCKET, SO_SNDBUF, sendBuffer);
+                if(receiveBuffer > 0)
+                    httplib::detail::set_socket_opt(sock, SOL_SOCKET, SO_RCVBUF, receiveBuffer);
+            });
+
+        // Connections beyond the queue limit are answered with 503 by a dedicated thread instead of waiting in line
+        server.new_task_queue = [this]()
+            {
+                std::lock_guard<std::mutex> lock(m_serverMtx);
+                return new PoolTaskQueue(m_workerPool);
+            };
 
         // Setup routes 
-        server->Get("/", [this](const httplib::Request& req, httplib::Response& res)
+        server.Get("/", [this](const httplib::Request& req, httplib::Response& res)
             {
-                std::string html = GetHTML(m_contentDir);
-                res.set_content(html, "text/html");
+                this->SetListingContent(req, res, fs::path());
             });
 
+        // Metrics stay off the public port when an admin port is configured
+        if(m_adminPort == 0)
+            server.Get("/metrics", m_metricsHandler);
+
+        server.Get(R"(/(.+))", m_fileRequestHandler);
+
         // Setup custom handlers
-        server->set_file_request_handler(m_fileRequestHandler);
-        server->set_error_handler(m_errorHandler);
-        server->set_logger(m_loggerHandler);
+        server.set_pre_routing_handler([this](const httplib::Request& req, httplib::Response& res)
+            {
+                if(PreRoute(req, res) == httplib::Server::HandlerResponse::Handled || !this->AdmitRequest(req, res))
+                    return httplib::Server::HandlerResponse::Handled;
+                return httplib::Server::HandlerResponse::Unhandled;
+            });
+        server.set_error_handler(m_errorHandler);
+        server.set_logger(m_loggerHandler);
+    }
 
-        // Bind and listen
-        std::cout << "Starting server on port " << m_port << "..." << std::endl;
+    std::shared_ptr<EventLoopServer> Server::CreateEventLoopServer()
+    {
+        EventLoopServer::Settings settings;
+        settings.threadCount = m_workerThreads > 0 ? m_workerThreads : std::max(std::thread::hardware_concurrency(), 1u);
+        settings.pinThreads = m_workerAffinity;
+        settings.keepAliveMaxCount = m_keepAliveMaxCount;
+        settings.keepAliveTimeout = std::chrono::seconds(m_keepAliveTimeoutSec);
+        settings.readTimeout = std::chrono::seconds(m_readTimeoutSec);
+        settings.writeTimeout = std::chrono::seconds(m_writeTimeoutSec);
+        settings.tcpNoDelay = m_tcpNoDelay;
+        settings.sendBuffer = m_socketSendBuffer;
+        settings.receiveBuffer = m_socketReceiveBuffer;
+        settings.logger = m_logger.get();
 
-        // Listen starts the server (blocking call)
-        if(!server->listen("0.0.0.0", m_port))
-            std::cerr << "Failed to start server on port " << m_port << std::endl;
+        // Same handlers as the httplib server, only the bodies take the zero copy path
+        return std::make_shared<EventLoopServer>(settings,
+            [this](const httplib::Request& req, httplib::Response& res, ZeroCopyBody& body, RequestContext& context)
+            {
+                // Also run when a handler throws: the event loop answers 500 and logs the request with its context
+                struct Cleanup
+                {
+                    RequestContext& context;
+                    ~Cleanup()
+                    {
+                        t_zeroCopyBody = nullptr;
+                        t_rateClient.reset();
+                        context = t_requestContext;
+                    }
+                } cleanup{ context };
 
-        std::cout << "Server stopped!" << std::endl;
+                t_zeroCopyBody = &body;
+                PreRoute(req, res);
+                if(this->AdmitRequest(req, res))
+                    this->RouteRequest(req, res);
+                if(res.status >= 400)
+                    m_errorHandler(req, res);
+            },
+            [this](const httplib::Request& req, const httplib::Response& res, const RequestContext& context)
+            {
+                t_requestContext = context;
+                m_loggerHandler(req, res);
+            });
+    }
 
+    void Server::RouteRequest(const httplib::Request& req, httplib::Response& res)
+    {
+        // The routes registered on the httplib server, which also answers HEAD with the GET handlers
+        if(req.method != "GET" && req.method != "HEAD")
+            res.status = 404;
+        else if(req.path == "/")
+            this->SetListingContent(req, res, fs::path());
+        else if(m_adminPort == 0 && req.path == "/metrics")
+            m_metricsHandler(req, res);
+        else if(req.path.size() > 1 && req.path.front() == '/')
+            m_fileRequestHandler(req, res);
+        else
+            res.status = 404;
+    }
+
+    void Server::SetBufferContent(httplib::Response& res, const std::shared_ptr<const std::string>& data, const std::string& contentType)
+    {
+        // The event loop writes the shared buffer straight to the socket
+        if(t_zeroCopyBody)
+        {
+            t_zeroCopyBody->buffer = data;
+            res.set_header("Content-Type", contentType);
+            return;
+        }
+
+        // An empty content provider is never marked as done by httplib, send an empty body instead
+        if(data->empty())
+        {
+            res.set_content("", contentType);
+            return;
+        }
+
+        // The provider keeps the shared buffer alive until the response is fully sent, the data itself is never copied.
+        // A paced response also keeps the buckets of its client, which a sweep cannot drop while they are in use.
+        RateLimiter* limiter = m_rateLimiter->LimitsBandwidth() ? m_rateLimiter.get() : nullptr;
+        res.set_content_provider(data->size(), contentType,
+            [data, limiter, client = t_rateClient](size_t offset, size_t length, httplib::DataSink& sink)
+            {
+                return WriteBody(data->data() + offset, length, sink, limiter, client.get());
+            });
+    }
+
+    bool Server::SetMappedContent(httplib::Response& res, const fs::path& filePath, const std::string& contentType)
+    {
+        // The event loop sends the file with sendfile, it is opened when the response is written
+        if(t_zeroCopyBody)
+        {
+            std::error_code ec;
+            uintmax_t fileSize = fs::file_size(filePath, ec);
+            if(ec)
+                return false;
+
+            t_zeroCopyBody->filePath = filePath;
+            t_zeroCopyBody->fileSize = fileSize;
+            res.set_header("Content-Type", contentType);
+            return true;
+        }
+
+        auto mm = std::make_shared<httplib::detail::mmap>(filePath.string().c_str());
+        if(!mm->is_open())
+            return false;
+
+        this->SetMappedContent(res, mm, 0, mm->size(), contentType);
         return true;
     }
 
-    std::string Server::FormatFileSize(uintmax_t bytes)
+    void Server::SetMappedContent(httplib::Response& res, const std::shared_ptr<httplib::detail::mmap>& mapping, uint64_t offset, uint64_t length,
+        const std::string& contentType)
     {
-        const char* suffix[] = { "B", "KB", "MB", "GB", "TB" };
-        double size = static_cast<double>(bytes);
-        int i = 0;
-        while(size >= 1024 && i < 4)
+        if(length == 0)
         {
-            size /= 1024;
-            i++;
+            res.set_content("", contentType);
+            return;
         }
 
-        std::stringstream ss;
-        ss << std::fixed << std::setprecision(2) << size << " " << suffix[i];
-        return ss.str();
+        // The provider keeps the mapping alive until the response is fully sent, the pages are read on demand by the kernel
+        RateLimiter* limiter = m_rateLimiter->LimitsBandwidth() ? m_rateLimiter.get() : nullptr;
+        const char* data = mapping->data() + offset;
+        res.set_content_provider(static_cast<size_t>(length), contentType,
+            [mapping, data, limiter, client = t_rateClient](size_t offset, size_t length, httplib::DataSink& sink)
+            {
+                return WriteBody(data + offset, length, sink, limiter, client.get());
+            });
     }
 
-    std::vector<fs::path> Server::GetFilesInDirectory(const fs::path& dir)
+    bool Server::ReadFile(const fs::path& filePath, uintmax_t fileSize, std::string& outData) const
     {
-        std::vector<fs::path> files;
-        if(fs::exists(dir) && fs::is_directory(dir))
-            for(const auto& entry : fs::directory_iterator(dir))
-                if(fs::is_regular_file(entry.status()))
-                    files.push_back(entry.path());
-        return files;
+        std::ifstream fileStream(filePath, std::ios::binary);
+        if(!fileStream)
+            return false;
+
+        // The size is known in advance, read everything with a single call instead of growing a stream buffer
+        outData.assign(static_cast<size_t>(fileSize), '\0');
+        fileStream.read(outData.data(), static_cast<std::streamsize>(outData.size()));
+        outData.resize(static_cast<size_t>(fileStream.gcount()));
+
+        return true;
     }
 
-    std::string Server::GetHTML(const fs::path& dir)
+    std::shared_ptr<const CachedFile> Server::LoadFile(const fs::path& filePath, const FileMetadata& metadata) const
     {
-        std::vector<fs::path> files = this->GetFilesInDirectory(dir);
-        std::stringstream html;
+        std::string data;
+        if(!this->ReadFile(filePath, metadata.size, data))
+            return nullptr;
+
+        auto file = std::make_shared<CachedFile>(std::move(data));
+        const std::string& identity = *file->GetVariant(ContentEncoding::Identity);
+        bool compress = m_compression && identity.size() >= s_minCompressSize && IsCompressibleType(metadata.contentType);
+
+        for(size_t i = static_cast<size_t>(ContentEncoding::Identity) + 1; i < static_cast<size_t>(ContentEncoding::Count); i++)
+        {
+            ContentEncoding encoding = static_cast<ContentEncoding>(i);
 
-        html << "<html><head><title>Content Directory</title></head><body style=\"background-color:#248779\">";
-        html << "<h1>Content Directory: " << dir.string() << "</h1>";
-        html << "<ul>";
+            // Precompressed siblings on disk (e.g. "style.css.gz") win over compressing on our own
+            fs::path siblingPath = filePath;
+            siblingPath += GetEncodingExtension(encoding);
 
-        for(const auto& file : files) {
-            if(fs::is_regular_file(file)) {
-                auto size = fs::file_size(file);
-                html << "<li><a href=\"" << file.filename().string() << "\">"
-                    << file.filename().string() << "</a> ("
-                    << this->FormatFileSize(size) << ")</li>";
+            std::string variant;
+            if(MetadataIndex::MetadataPtr sibling = m_index->FindFile(siblingPath))
+            {
+                if(this->ReadFile(siblingPath, sibling->size, variant))
+                    file->SetVariant(encoding, std::move(variant));
             }
+            else if(compress && IsEncodingSupported(encoding) && Compress(encoding, identity, variant) && variant.size() < identity.size())
+                file->SetVariant(encoding, std::move(variant));
+        }
+
+        return file;
+    }
+
+    void Server::SetListingContent(const httplib::Request& req, httplib::Response& res, const fs::path& relativeDir)
+    {
+        t_requestContext.route = MetricsRoute::Listing;
+
+        size_t page = 0;
+        std::string pageParam = req.get_param_value("page");
+        std::from_chars(pageParam.data(), pageParam.data() + pageParam.size(), page);
+
+        // API clients ask for JSON explicitly or through content negotiation
+        bool json = req.get_param_value("format") == "json" || FindHeader(req.headers, "Accept").find("application/json") != std::string_view::npos;
+        DirectoryListing::Format format = json ? DirectoryListing::Format::Json : DirectoryListing::Format::Html;
+
+        DirectoryListing::FilePtr listing;
+        if(!m_listing->GetPage(relativeDir, page, format, listing))
+        {
+            res.status = 404;
+            res.set_content("Directory not found", "text/plain");
+            MC_LOG_DEBUG(*m_logger, "Listing not found: ", relativeDir, " page ", page);
+            return;
+        }
+
+        res.set_header("Vary", "Accept, Accept-Encoding");
+        ContentEncoding encoding = ContentEncoding::Identity;
+        if(listing->HasEncodedVariants())
+            encoding = SelectEncoding(req.get_header_value("Accept-Encoding"), *listing);
+        if(encoding != ContentEncoding::Identity)
+            res.set_header("Content-Encoding", GetEncodingToken(encoding));
+
+        // Listings change at any time, ranges are not offered
+        res.status = 200;
+        this->SetBufferContent(res, std::shared_ptr<const std::string>(listing, listing->GetVariant(encoding)), json ? "application/json" : "text/html");
+    }
+
+    void Server::StartBackgroundTasks()
+    {
+        m_backgroundStop = false;
+        if(m_rateLimiter->IsEnabled())
+        {
+            // Idle clients are forgotten, so that the memory used follows the active clients and not every address ever seen
+            m_rateLimitThread = std::thread([this]()
+                {
+                    auto interval = std::chrono::seconds(std::max(m_rateLimitIdleSec / 2, 1L));
+                    std::unique_lock<std::mutex> lock(m_backgroundMtx);
+                    while(!m_backgroundCv.wait_for(lock, interval, [this]() { return m_backgroundStop.load(); }))
+                    {
+                        lock.unlock();
+                        size_t removed = m_rateLimiter->Sweep();
+                        MC_LOG_DEBUG(*m_logger, "Rate limiter forgot ", removed, " idle clients, ", m_rateLimiter->GetClientCount(), " left");
+                        lock.lock();
+                    }
+                });
+        }
+        if(m_certificates->IsLoaded() && m_certificatePollIntervalSec > 0)
+            m_certificateThread = std::thread(&Server::WatchCertificate, this);
+
+        if(m_snapshotPath.empty())
+            return;
+
+        if(m_warmupFiles > 0)
+            m_warmupThread = std::thread(&Server::WarmUpCache, this);
+
+        m_snapshotThread = std::thread([this]()
+            {
+                std::unique_lock<std::mutex> lock(m_backgroundMtx);
+                while(!m_backgroundCv.wait_for(lock, std::chrono::seconds(m_snapshotIntervalSec), [this]() { return m_backgroundStop.load(); }))
+                {
+                    lock.unlock();
+                    this->SaveCacheSnapshot();
+                    lock.lock();
+                }
+            });
+    }
+
+    void Server::StopBackgroundTasks()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_backgroundMtx);
+            m_backgroundStop = true;
         }
-        html << "</ul>";
-        html << "</body></html>";
+        m_backgroundCv.notify_all();
 
-        return html.str();
+        if(m_certificateThread.joinable())
+            m_certificateThread.join();
+        if(m_rateLimitThread.joinable())
+            m_rateLimitThread.join();
+        if(m_warmupThread.joinable())
+            m_warmupThread.join();
+        if(m_snapshotThread.joinable())
+        {
+            m_snapshotThread.join();
+            this->SaveCacheSnapshot();
+        }
+    }
+
+    void Server::WatchCertificate()
+    {
+        // Files replaced in two steps (certificate, then key) fail the first reload on the mismatch and succeed on the next change
+        auto getWriteTimes = [this]()
+            {
+                std::error_code error;
+                return std::pair{ fs::last_write_time(m_certificate, error), fs::last_write_time(m_certificateKey, error) };
+            };
+
+        auto writeTimes = getWriteTimes();
+        std::unique_lock<std::mutex> lock(m_backgroundMtx);
+        while(!m_backgroundCv.wait_for(lock, std::chrono::seconds(m_certificatePollIntervalSec), [this]() { return m_backgroundStop.load(); }))
+        {
+            auto currentWriteTimes = getWriteTimes();
+            if(currentWriteTimes == writeTimes)
+                continue;
+
+            writeTimes = currentWriteTimes;
+            lock.unlock();
+            this->ReloadCertificate();
+            lock.lock();
+        }
+    }
+
+    Cache::FilePtr Server::LoadCachedFile(const fs::path& filePath, const std::shared_ptr<const FileMetadata>& metadata, bool& outShared)
+    {
+        return m_fileLoads->Do(filePath, [&]()
+            {
+                Cache::FilePtr file = this->LoadFile(filePath, *metadata);
+                if(!file)
+                    return file;
+
+                // Add the data to the cache. The watcher updates the index before invalidating the cache,
+                // so if the file changed while it was read, either the invalidation comes after this or the check below sees it.
+                m_cache->AddCachedFile(filePath, file);
+                if(m_index->FindFile(filePath) != metadata)
+                    m_cache->RemoveCachedFile(filePath);
+                return file;
+            }, outShared);
+    }
+
+    void Server::RefreshCachedFile(const fs::path& filePath)
+    {
+        if(!m_refreshPool)
+            return;
+
+        m_refreshPool->Enqueue([this, filePath]()
+            {
+                // A file removed or grown past the stream threshold was already invalidated by the watcher
+                MetadataIndex::MetadataPtr metadata = m_index->FindFile(filePath);
+                bool refreshed = false;
+                if(metadata && metadata->size < m_streamThreshold)
+                {
+                    bool shared = false;
+                    refreshed = this->LoadCachedFile(filePath, metadata, shared) != nullptr;
+                }
+                else if(!metadata && m_origin)
+                {
+                    bool shared = false;
+                    refreshed = this->PullOriginFile(filePath, shared).status == 200;
+                }
+                else
+                    return;
+
+                if(refreshed)
+                    MC_LOG_DEBUG(*m_logger, "Stale file refreshed in cache: ", filePath);
+                else
+                    MC_LOG_WARN(*m_logger, "Failed to refresh stale file: ", filePath);
+            });
+    }
+
+    Server::OriginObject Server::GetOriginFile(const fs::path& filePath)
+    {
+        OriginObject object;
+        bool stale = false;
+        bool refresh = false;
+        if(m_cache->GetCachedFile(filePath, object.file, stale, refresh))
+        {
+            t_requestContext.cacheStatus = stale ? CacheStatus::Stale : CacheStatus::Hit;
+            if(refresh)
+                this->RefreshCachedFile(filePath);
+            object.status = 200;
+            object.metadata = object.file->GetMetadata();
+            return object;
+        }
+
+        bool shared = false;
+        object = this->PullOriginFile(filePath, shared);
+        if(shared)
+            t_requestContext.cacheStatus = CacheStatus::Coalesced;
+        return object;
+    }
+
+    Server::OriginObject Server::PullOriginFile(const fs::path& filePath, bool& outShared)
+    {
+        return m_originLoads->Do(filePath, [&]() -> OriginObject
+            {
+                // The cache status is set for the request doing the pull, the refresh threads ignore it
+                std::string target = filePath.generic_string();
+                time_t now = time(nullptr);
+                OriginObject result;
+
+                // A body past the stream threshold stays on disk and is served from a mapping of its file, taken before the file
+                // can be replaced or removed
+                auto mapBody = [&result](const fs::path& path, uint64_t offset)
+                    {
+                        result.mapping = std::make_shared<httplib::detail::mmap>(path.string().c_str());
+                        result.bodyOffset = offset;
+                        return result.mapping->is_open();
+                    };
+
+                DiskCache::Object object;
+                bool stored = m_diskCache && m_diskCache->Get(target, object, m_streamThreshold);
+                bool onDisk = stored && object.body.size() != object.bodySize;
+                if(onDisk && !mapBody(object.path, object.bodyOffset))
+                    stored = onDisk = false;   // Evicted since it was read
+
+                std::unique_ptr<DiskCache::Writer> writer;
+                if(stored && (object.expires == 0 || now < object.expires))
+                {
+                    t_requestContext.cacheStatus = CacheStatus::Disk;
+                    MC_LOG_DEBUG(*m_logger, "File found in disk cache: ", target);
+                }
+                else
+                {
+                    OriginClient::Response response;
+                    auto setFreshness = [&](DiskCache::Object& fetched)
+                        {
+                            long lifetime = GetFreshnessLifetime(ParseCacheControl(fetched.cacheControl), response.expires, response.age, m_cacheTtl);
+                            fetched.expires = lifetime < 0 ? 0 : now + lifetime;
+                            fetched.fetchTime = now - response.age;
+                        };
+                    auto takeResponse = [&response]()
+                        {
+                            DiskCache::Object fetched;
+                            fetched.contentType = response.contentType;
+                            fetched.etag = response.etag;
+                            fetched.lastModified = response.lastModified;
+                            fetched.cacheControl = response.cacheControl;
+                            fetched.body = std::move(response.body);
+                            response.body.clear();
+                            return fetched;
+                        };
+
+                    // The body is buffered up to the stream threshold, a larger one continues into a disk cache file, which is
+                    // only committed if the response may be stored
+                    auto receiveBody = [&](const char* data, size_t length)
+                        {
+                            // Error pages are not served, their status is enough
+                            if(response.status != 200)
+                                return true;
+
+                            if(!writer && m_diskCache && response.body.size() + length > m_streamThreshold)
+                            {
+                                DiskCache::Object head = takeResponse();
+                                setFreshness(head);
+                                writer = m_diskCache->BeginPut(target, head);
+                                if(!writer)
+                                    return false;
+                            }
+
+                            if(writer)
+                                return writer->Write(std::string_view(data, length));
+
+                            response.body.append(data, length);
+                            return true;
+                        };
+
+                    // An expired copy is revalidated rather than downloaded again
+                    if(!m_origin->Get(target, stored ? object.etag : "", stored ? object.lastModified : "", response, receiveBody))
+                    {
+                        MC_LOG_ERROR(*m_logger, "Origin request failed for ", target, ": ", response.error);
+                        result.status = 502;
+                        return result;
+                    }
+
+                    if(response.status == 304 && stored)
+                    {
+                        t_requestContext.cacheStatus = CacheStatus::Revalidated;
+                        MC_LOG_DEBUG(*m_logger, "File revalidated by origin: ", target);
+                        if(!response.cacheControl.empty())
+                            object.cacheControl = response.cacheControl;
+                    }
+                    else if(response.status == 200)
+                    {
+                        t_requestContext.cacheStatus = CacheStatus::Miss;
+                        MC_LOG_DEBUG(*m_logger, "File pulled from origin: ", target);
+                        object = takeResponse();
+                        onDisk = writer != nullptr;
+                        if(onDisk)
+                        {
+                            object.bodySize = writer->GetBodySize();
+                            if(!writer->Close() || !mapBody(writer->GetPath(), writer->GetBodyOffset()))
+                            {
+                                MC_LOG_ERROR(*m_logger, "Failed to write the disk cache file of ", target);
+                                result.status = 502;
+                                return result;
+                            }
+                        }
+
+                        // Compressed once per download, the variants are stored with the object so that a disk hit or a revalidation
+                        // never compresses it again. A response that is not stored anywhere is sent as it came, so is a body
+                        // streamed through the disk.
+                        const std::string& identity = object.body;
+                        if(m_compression && !onDisk && !ParseCacheControl(object.cacheControl).noStore && identity.size() >= s_minCompressSize && IsCompressibleType(object.contentType))
+                        {
+                            for(size_t i = static_cast<size_t>(ContentEncoding::Identity) + 1; i < static_cast<size_t>(ContentEncoding::Count); i++)
+                            {
+                                ContentEncoding encoding = static_cast<ContentEncoding>(i);
+                                std::string variant;
+                                if(IsEncodingSupported(encoding) && Compress(encoding, identity, variant) && variant.size() < identity.size())
+                                    object.variants.emplace_back(encoding, std::move(variant));
+                            }
+                        }
+                    }
+                    else
+                    {
+                        MC_LOG_DEBUG(*m_logger, "Origin answered ", response.status, " for ", target);
+                        result.status = response.status;
+                        return result;
+                    }
+
+                    setFreshness(object);
+                    if(ParseCacheControl(object.cacheControl).noStore)
+                    {
+                        if(stored)
+                            m_diskCache->Remove(target);
+                    }
+                    else if(writer)
+                        writer->Commit();
+                    else if(m_diskCache)
+                    {
+                        // A revalidated body left on disk is copied into the new file, the mapping still reads the replaced one
+                        m_diskCache->Put(target, object);
+                    }
+                }
+
+                // The memory tier only keeps what is still fresh, a response to revalidate on every use stays on disk.
+                // Objects past the stream threshold are never held in memory, like the local files.
+                result.status = 200;
+                if(onDisk)
+                {
+                    result.metadata = MakeOriginMetadata(object, object.bodySize);
+                    return result;
+                }
+
+                CacheControl cacheControl = ParseCacheControl(object.cacheControl);
+                time_t expires = object.expires;
+                long ttl = expires == 0 ? 0 : static_cast<long>(expires - now);
+                result.file = MakeOriginFile(std::move(object));
+                result.metadata = result.file->GetMetadata();
+                if(!cacheControl.noStore && (expires == 0 || ttl > 0))
+                    m_cache->AddCachedFile(filePath, result.file, static_cast<int>(std::min<long>(ttl, std::numeric_limits<int>::max())), !cacheControl.mustRevalidate);
+                return result;
+            }, outShared);
+    }
+
+    void Server::WarmUpCache()
+    {
+        std::vector<SnapshotEntry> entries;
+        if(!LoadCacheSnapshot(m_snapshotPath, entries))
+        {
+            MC_LOG_INFO(*m_logger, "No cache snapshot at ", m_snapshotPath, ", skipping warm-up");
+            return;
+        }
+        if(entries.size() > m_warmupFiles)
+            entries.resize(m_warmupFiles);
+
+        auto start = std::chrono::steady_clock::now();
+        const size_t progressStep = std::max<size_t>(entries.size() / 10, 1);
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> loadedFiles{ 0 };
+        std::atomic<uint64_t> loadedBytes{ 0 };
+
+        auto warmUp = [&]()
+            {
+                for(size_t i = next++; i < entries.size() && !m_backgroundStop; i = next++)
+                {
+                    fs::path filePath = m_contentDir / fs::path(entries[i].path);
+                    m_cache->RecordAccesses(filePath, entries[i].frequency);
+
+                    MetadataIndex::MetadataPtr metadata = m_index->FindFile(filePath);
+                    if(metadata && metadata->size < m_streamThreshold)
+                    {
+                        Cache::FilePtr file = this->LoadFile(filePath, *metadata);
+                        if(file && m_cache->AddCachedFile(filePath, file))
+                        {
+                            // Same check as the request path, the file may have changed while it was read
+                            if(m_index->FindFile(filePath) != metadata)
+                                m_cache->RemoveCachedFile(filePath);
+                            loadedFiles++;
+                            loadedBytes += file->GetTotalSize();
+                        }
+                    }
+
+                    if((i + 1) % progressStep == 0)
+                        MC_LOG_INFO(*m_logger, "Cache warm-up: ", i + 1, " / ", entries.size(), " files");
+                }
+            };
+
+        std::vector<std::thread> workers;
+        for(size_t i = 0; i < std::min(m_warmupThreads, entries.size()); i++)
+            workers.emplace_back(warmUp);
+        for(std::thread& worker : workers)
+            worker.join();
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        MC_LOG_INFO(*m_logger, "Cache warm-up done: ", loadedFiles.load(), " of ", entries.size(), " files, ",
+            FormatFileSize(loadedBytes.load()), " in ", elapsed.count(), " ms");
+    }
+
+    void Server::SaveCacheSnapshot() const
+    {
+        std::vector<SnapshotEntry> entries;
+        for(auto& [filePath, frequency] : m_cache->GetHotFiles(m_warmupFiles))
+        {
+            // Objects of the origin are keyed by their target, outside of the content directory, the warm-up only reads local files
+            fs::path relativePath = filePath.lexically_relative(m_contentDir);
+            if(relativePath.empty() || *relativePath.begin() == "..")
+                continue;
+
+            entries.push_back({ relativePath.generic_string(), frequency });
+        }
+
+        if(!MC::SaveCacheSnapshot(m_snapshotPath, entries))
+            MC_LOG_WARN(*m_logger, "Failed to save the cache snapshot to ", m_snapshotPath);
+        else
+            MC_LOG_DEBUG(*m_logger, "Saved ", entries.size(), " files to the cache snapshot");
+    }
+
+    std::unique_ptr<Logger> Server::MakeLogger(const fs::path& logPath) const
+    {
+        auto logger = std::make_unique<Logger>(m_logQueueSize);
+        logger->SetOverflowPolicy(m_logBlockWhenFull ? Logger::OverflowPolicy::Block : Logger::OverflowPolicy::Drop);
+        logger->SetFlushThresholds(m_logFlushBytes, std::chrono::milliseconds(m_logFlushIntervalMs));
+        logger->SetRotation(m_logRotateBytes, std::chrono::seconds(m_logRotateIntervalSec), m_logRotateKeep);
+        logger->SetLogFilePath(logPath);
+        return logger;
+    }
+
+    bool Server::AdmitRequest(const httplib::Request& req, httplib::Response& res)
+    {
+        t_rateClient.reset();
+        if(!m_rateLimiter->IsEnabled())
+            return true;
+
+        std::chrono::nanoseconds retryAfter{};
+        if(m_rateLimiter->AdmitRequest(req.remote_addr, t_rateClient, retryAfter))
+            return true;
+
+        MC_LOG_DEBUG(*m_logger, "Request rate exceeded by ", req.remote_addr);
+        res.status = 429;
+        res.set_header("Retry-After", std::to_string(std::chrono::ceil<std::chrono::seconds>(retryAfter).count()));
+        return false;
+    }
+
+    bool Server::ReloadCertificate()
+    {
+        if(!m_certificates->IsLoaded())
+        {
+            MC_LOG_WARN(*m_logger, "No certificate in use, nothing to reload");
+            return false;
+        }
+
+        std::string error;
+        if(!m_certificates->Load(m_certificate, m_certificateKey, error))
+        {
+            m_certificateReloadFailures++;
+            MC_LOG_ERROR(*m_logger, "Certificate not reloaded, the current one is kept: ", error);
+            return false;
+        }
+
+        m_certificateReloads++;
+        MC_LOG_INFO(*m_logger, "Certificate reloaded: ", m_certificates->GetDescription());
+        return true;
+    }
+
+    void Server::Stop()
+    {
+        std::lock_guard<std::mutex> lock(m_serverMtx);
+
+        // Paced transfers finish at full speed instead of holding the shutdown
+        m_rateLimiter->StopPacing();
+        for(Listener& listener : m_listeners)
+        {
+            if(listener.eventLoop)
+                listener.eventLoop->Stop();
+            else
+            {
+                //! httplib ignores stop before its listen loop runs, the listener is then told not to start it
+                listener.httpServer->stop();
+                if(!listener.httpServer->is_running())
+                    listener.httpServer->decommission();
+            }
+        }
+    }
+
+    bool Server::IsRunning() const
+    {
+        std::lock_guard<std::mutex> lock(m_serverMtx);
+        return !m_listeners.empty() && std::all_of(m_listeners.begin(), m_listeners.end(), [](const Listener& listener)
+            {
+                return listener.eventLoop ? listener.eventLoop->IsRunning() : listener.httpServer->is_running();
+            });
     }
 
-} // namespace MC
\ No newline at end of file
+} // namespace MC
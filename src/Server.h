@@ -6,15 +6,38 @@ namespace httplib
 {
     struct Request;
     struct Response;
+    class Server;
+
+    namespace detail
+    {
+        class mmap;
+    }
 }
 
 namespace MC
 {
     class Cache;
+    class CachedFile;
     class Logger;
+    class DirectoryWatcher;
+    class DirectoryListing;
+    class MetadataIndex;
+    class Metrics;
+    class WorkerPool;
+    class EventLoopServer;
+    class TlsTicketKeys;
+    class TlsCertificateStore;
+    class RateLimiter;
+    class OriginClient;
+    class DiskCache;
+    struct FileMetadata;
+    enum class LogLevel;
+    enum class AccessLogFormat;
+    template<typename Key, typename Value> class SingleFlight;
 
     /// @brief Main server class that allows for server setup and creation.
-    /// It supports both HTTP and HTTPS and reads the setup configuration from a specified configuration INI file.
+    /// It serves HTTP, HTTPS and the admin endpoints on concurrent listeners sharing one cache and logger,
+    /// and reads the setup configuration from a specified configuration INI file.
     class Server
     {
     public:
@@ -34,48 +57,284 @@ namespace MC
         /// @return Bool result
         bool IsConfigLoaded() const { return m_configLoaded; }
 
-        /// @brief Creates and runs the server using the pre-setted configuration.
-        /// This method automatically creates an HTTPS server if the necessary certificate and key are provided in the config file,
-        /// otherwise it will fallback to HTTP.
-        /// @return False if a configuration was not set before calling this function. True otherwise.
+        /// @brief Creates and runs the server using the pre-setted configuration (blocking call).
+        /// An HTTPS listener is created if the certificate and key in the config file can be loaded: on https_port next to
+        /// the HTTP listener, or instead of it on the main port. Without a valid certificate the server falls back to HTTP.
+        /// @return False if a configuration was not set before calling this function, no listener could be created
+        /// or one of the ports (HTTP, HTTPS or admin) could not be bound. True once the listeners have stopped.
         bool CreateServer();
 
+        /// @brief Stops every listener of a server started with CreateServer, safe to call from any thread.
+        /// CreateServer returns once the pending requests have been served.
+        void Stop();
+
+        /// @brief Checks if every listener is accepting connections
+        /// @return Bool result
+        bool IsRunning() const;
+
+        /// @brief Reloads the certificate and key from their files, safe to call from any thread.
+        /// The next handshakes use the new pair, established connections are not affected. The current pair is kept if the new one is invalid.
+        /// @return False if nothing was reloaded
+        bool ReloadCertificate();
+
     private:
-        /// @brief Obtain a more readable string that represents the file size 
-        /// @param bytes File size in bytes count 
-        /// @return Formatted string
-        std::string FormatFileSize(uintmax_t bytes);
+        /// @brief Sets a shared buffer as response body without copying it
+        /// @param res Response to fill
+        /// @param data Shared buffer, kept alive by the response until it has been sent
+        /// @param contentType MIME type of the content
+        void SetBufferContent(httplib::Response& res, const std::shared_ptr<const std::string>& data, const std::string& contentType);
+
+        /// @brief Streams a file from a memory mapping, without reading it in memory
+        /// @param res Response to fill
+        /// @param filePath Path of the file on disk
+        /// @param contentType MIME type of the content
+        /// @return False if the file could not be mapped
+        bool SetMappedContent(httplib::Response& res, const fs::path& filePath, const std::string& contentType);
+
+        /// @brief Streams a part of a mapped file
+        /// @param res Response to fill
+        /// @param mapping Open mapping, kept alive by the response until it has been sent
+        /// @param offset Position of the content in the mapping
+        /// @param length Size of the content
+        /// @param contentType MIME type of the content
+        void SetMappedContent(httplib::Response& res, const std::shared_ptr<httplib::detail::mmap>& mapping, uint64_t offset, uint64_t length,
+            const std::string& contentType);
+
+        /// @brief Reads a whole file in memory
+        /// @param[in] filePath Path of the file on disk
+        /// @param[in] fileSize Size of the file in bytes
+        /// @param[out] outData File content
+        /// @return Success
+        bool ReadFile(const fs::path& filePath, uintmax_t fileSize, std::string& outData) const;
+
+        /// @brief Reads a file and prepares its encoded variants, ready to be cached.
+        /// Variants come from precompressed sibling files on disk or, for compressible types, are compressed once here.
+        /// @param filePath Path of the file on disk
+        /// @param metadata Indexed metadata of the file
+        /// @return The file, nullptr if the file could not be opened
+        std::shared_ptr<const CachedFile> LoadFile(const fs::path& filePath, const FileMetadata& metadata) const;
+
+        /// @brief Loads a file and adds it to the cache. Concurrent calls for the same file share a single read.
+        /// @param[in] filePath Path of the file on disk
+        /// @param[in] metadata Indexed metadata of the file
+        /// @param[out] outShared Set when the file was read by a concurrent call
+        /// @return The file, nullptr if the file could not be opened
+        std::shared_ptr<const CachedFile> LoadCachedFile(const fs::path& filePath, const std::shared_ptr<const FileMetadata>& metadata, bool& outShared);
+
+        /// @brief Reloads a stale cached file on the refresh threads, the stale copy is served meanwhile
+        /// @param filePath Path of the file on disk, or key of a file of the origin
+        void RefreshCachedFile(const fs::path& filePath);
+
+        /// @brief File of the origin, held in memory or, past the stream threshold, left in a file of the disk cache
+        struct OriginObject
+        {
+            int status = 0;                                     // 200 with the file, otherwise the error status of the origin, or 502 if it could not be reached
+            std::shared_ptr<const FileMetadata> metadata;
+            std::shared_ptr<const CachedFile> file;             // In memory, with the metadata attached
+            std::shared_ptr<httplib::detail::mmap> mapping;     // Otherwise mapping of the file holding the body
+            uint64_t bodyOffset = 0;                            // Position of the body in the mapping
+        };
+
+        /// @brief Gets a file that is not in the content directory from the memory cache, the disk cache or the origin, in this order
+        /// @param filePath Target of the file on the origin, percent-encoded path and query, also its key in both caches
+        /// @return The file
+        OriginObject GetOriginFile(const fs::path& filePath);
+
+        /// @brief Reads a file from the disk cache, or from the origin when the disk copy is missing or expired, and fills both caches
+        /// as allowed by the Cache-Control header of the origin. Concurrent calls for the same file share a single pull.
+        /// A body larger than the stream threshold is written to the disk cache as it arrives and never held in memory.
+        /// @param[in] filePath Target of the file on the origin, see GetOriginFile
+        /// @param[out] outShared Set when the file was pulled by a concurrent call
+        /// @return The file
+        OriginObject PullOriginFile(const fs::path& filePath, bool& outShared);
+
+        /// @brief Creates the plain HTTP httplib server, with its routes and handlers
+        /// @return The server, nullptr if it could not be created
+        std::unique_ptr<httplib::Server> CreateHttpServer();
+
+        /// @brief Creates the HTTPS httplib server, with its routes and handlers
+        /// @return The server, nullptr if the certificate, the key or a TLS setting is invalid
+        std::unique_ptr<httplib::Server> CreateHttpsServer();
+
+        /// @brief Creates the admin server, only serving the metrics
+        /// @return The server
+        std::unique_ptr<httplib::Server> CreateAdminServer();
+
+        /// @brief Applies the connection settings, routes and handlers shared by the HTTP and HTTPS servers
+        /// @param server Server to set up
+        void SetupHttpServer(httplib::Server& server);
 
-        /// @brief Obtain a list of the files inside the given directory path
-        /// @param dir Path to the desired directory
-        /// @return List of file paths 
-        std::vector<fs::path> GetFilesInDirectory(const fs::path& dir);
+        /// @brief Creates the epoll server, running the same handlers as the httplib server
+        /// @return The server
+        std::shared_ptr<EventLoopServer> CreateEventLoopServer();
 
-        /// @brief Obtain the HTML code necessary to render the page that serves the static files in the requested directory
-        /// @param dir Path to the desired directory
-        /// @return String containing the HTML code
-        std::string GetHTML(const fs::path& dir);
+        /// @brief Dispatches a request of the epoll server to the handler of its route
+        /// @param req Request
+        /// @param res Response to fill
+        void RouteRequest(const httplib::Request& req, httplib::Response& res);
+
+        /// @brief Applies the request rate limits and remembers the client of the request for the pacing of its response
+        /// @param req Request
+        /// @param res Response, answered with 429 when a rate is exceeded
+        /// @return False if the request was rejected
+        bool AdmitRequest(const httplib::Request& req, httplib::Response& res);
+
+        /// @brief Answers with a page of a directory listing, in HTML or, if the client asks for it, in JSON
+        /// @param req Request, the page index is read from the "page" parameter
+        /// @param res Response to fill
+        /// @param relativeDir Directory relative to the content directory, empty for the root
+        void SetListingContent(const httplib::Request& req, httplib::Response& res, const fs::path& relativeDir);
+
+        /// @brief Starts the cache warm-up and the periodic snapshot, when a snapshot path is configured
+        void StartBackgroundTasks();
+
+        /// @brief Stops the background tasks and saves a last snapshot
+        void StopBackgroundTasks();
+
+        /// @brief Reloads the certificate whenever its files change, until the background tasks stop
+        void WatchCertificate();
+
+        /// @brief Preloads the hottest files of the last snapshot in parallel, reporting progress in the log
+        void WarmUpCache();
+
+        /// @brief Saves the access frequencies of the cached files
+        void SaveCacheSnapshot() const;
+
+        /// @brief Creates a logger with the configured queue, flush and rotation settings
+        /// @param logPath Log file, the console is used when empty
+        /// @return The logger
+        std::unique_ptr<Logger> MakeLogger(const fs::path& logPath) const;
 
     private:
 
         // Server Configuration
         bool m_configLoaded;
         int m_port;
+        int m_httpsPort;
         fs::path m_contentDir;
         int m_cacheTtl;
+        int m_cacheStaleSec;
+        size_t m_cacheMaxBytes;
+        size_t m_cacheMaxEntries;
+        uintmax_t m_streamThreshold;
+        bool m_compression;
         std::string m_certificate;
         std::string m_certificateKey;
+        long m_certificatePollIntervalSec;
+        std::string m_tlsMinVersion;
+        std::string m_tlsCiphers;
+        std::string m_tlsCipherSuites;
+        std::string m_tlsCurves;
+        size_t m_tlsSessionCacheSize;
+        long m_tlsSessionTimeoutSec;
+        long m_tlsTicketRotationSec;
+        bool m_tlsKtls;
         fs::path m_logPath;
+        fs::path m_accessLogPath;
+        AccessLogFormat m_accessLogFormat;
+        uint64_t m_logRotateBytes;
+        long m_logRotateIntervalSec;
+        size_t m_logRotateKeep;
+        LogLevel m_logLevel;
+        size_t m_logQueueSize;
+        bool m_logBlockWhenFull;
+        size_t m_logFlushBytes;
+        int m_logFlushIntervalMs;
+        bool m_eventLoopMode;
+        size_t m_workerThreads;
+        size_t m_maxQueuedConnections;
+        bool m_workerAffinity;
+        size_t m_keepAliveMaxCount;
+        long m_keepAliveTimeoutSec;
+        long m_readTimeoutSec;
+        long m_writeTimeoutSec;
+        bool m_tcpNoDelay;
+        int m_socketSendBuffer;
+        int m_socketReceiveBuffer;
+        size_t m_listingPageSize;
+        bool m_watchPolling;
+        long m_watchPollIntervalMs;
+        fs::path m_snapshotPath;
+        long m_snapshotIntervalSec;
+        size_t m_warmupFiles;
+        size_t m_warmupThreads;
+        std::string m_adminAddress;
+        int m_adminPort;
+        double m_rateLimitRequests;
+        double m_rateLimitRequestBurst;
+        double m_rateLimitBytes;
+        double m_rateLimitBytesBurst;
+        double m_globalRateLimitRequests;
+        double m_globalRateLimitRequestBurst;
+        double m_globalRateLimitBytes;
+        double m_globalRateLimitBytesBurst;
+        long m_rateLimitIdleSec;
+        std::string m_originUrl;
+        size_t m_originConnections;
+        long m_originTimeoutSec;
+        fs::path m_diskCacheDir;
+        uint64_t m_diskCacheMaxBytes;
+
+        // Loggers, declared before their users so that they are destroyed last
+        std::unique_ptr<Logger> m_logger;
+        std::unique_ptr<Logger> m_accessLogger;
 
-        // Cache
+        // Cache, with the file reads in progress so that concurrent misses of a file share one
         std::unique_ptr<Cache> m_cache;
+        std::unique_ptr<SingleFlight<fs::path, std::shared_ptr<const CachedFile>>> m_fileLoads;
 
-        // Logger
-        std::unique_ptr<Logger> m_logger;
+        // Origin mode: pooled connections to the upstream, the disk cache tier and the pulls in progress with their status
+        std::unique_ptr<OriginClient> m_origin;
+        std::unique_ptr<DiskCache> m_diskCache;
+        std::unique_ptr<SingleFlight<fs::path, OriginObject>> m_originLoads;
+
+        // Content tree state, the watcher feeds the listings and the index and must be destroyed first
+        std::unique_ptr<DirectoryListing> m_listing;
+        std::unique_ptr<MetadataIndex> m_index;
+        std::unique_ptr<DirectoryWatcher> m_watcher;
+
+        // Request metrics
+        std::unique_ptr<Metrics> m_metrics;
+
+        // Cache warm-up and periodic snapshot, only running while the server listens
+        std::mutex m_backgroundMtx;
+        std::condition_variable m_backgroundCv;
+        std::atomic<bool> m_backgroundStop;
+        std::thread m_warmupThread;
+        std::thread m_snapshotThread;
+        std::thread m_certificateThread;
+        std::thread m_rateLimitThread;
+
+        // Request rate and bandwidth limits, replaced on every CreateServer and shared with the metrics
+        std::shared_ptr<RateLimiter> m_rateLimiter;
+
+        // Certificate and session ticket keys, referenced by the TLS context of the HTTPS listener which must be destroyed first
+        std::unique_ptr<TlsCertificateStore> m_certificates;
+        std::unique_ptr<TlsTicketKeys> m_ticketKeys;
+        std::atomic<uint64_t> m_certificateReloads;
+        std::atomic<uint64_t> m_certificateReloadFailures;
+
+        /// @brief Listening socket with its own accept thread
+        struct Listener
+        {
+            std::string name;                               // "http", "https" or "admin"
+            std::string address;
+            int port = 0;
+            std::unique_ptr<httplib::Server> httpServer;
+            std::shared_ptr<EventLoopServer> eventLoop;     // Instead of httpServer for HTTP with io_model=epoll, shared with the metrics
+            std::thread thread;
+        };
+
+        // Listeners, owned here so that they can be stopped from another thread
+        mutable std::mutex m_serverMtx;
+        std::vector<Listener> m_listeners;
+        std::shared_ptr<WorkerPool> m_workerPool;       // Shared by the HTTP and HTTPS listeners and the metrics
+        std::unique_ptr<WorkerPool> m_refreshPool;      // Reloads the stale cached files, only with a stale window
 
         // Custom handlers
         std::function<void(const httplib::Request& req, httplib::Response& res)> m_fileRequestHandler;
         std::function<void(const httplib::Request& req, httplib::Response& res)> m_errorHandler;
+        std::function<void(const httplib::Request& req, httplib::Response& res)> m_metricsHandler;
         std::function<void(const httplib::Request& req, const httplib::Response& res)> m_loggerHandler;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Collapses concurrent loads of the same key into one: the first caller runs the loader, the callers arriving
+    /// while it runs wait for its result instead of repeating the work. Nothing is kept once a load is done,
+    /// remembering the result (e.g. in the cache) is up to the loader.
+    /// @tparam Key Key of a load, hashed with std::hash
+    /// @tparam Value Result of a load, copied to every waiting caller
+    template<typename Key, typename Value>
+    class SingleFlight
+    {
+    public:
+        SingleFlight()
+            : m_sharedCount{ 0 }
+        {
+        }
+
+        SingleFlight(const SingleFlight&) = delete;
+        SingleFlight& operator=(const SingleFlight&) = delete;
+
+        /// @brief Runs the loader, or waits for the result of the load of the same key already running
+        /// @param[in] key Key of the load
+        /// @param[in] loader Callable returning the value, run on the calling thread. An exception is rethrown to every waiting caller.
+        /// @param[out] outShared Set when the value comes from the load of another caller
+        /// @return Loaded value
+        template<typename Loader>
+        Value Do(const Key& key, Loader&& loader, bool& outShared)
+        {
+            std::promise<Value> promise;
+            {
+                std::unique_lock<std::mutex> lock(m_mtx);
+                auto [it, inserted] = m_loads.try_emplace(key);
+                if(!inserted)
+                {
+                    std::shared_future<Value> pending = it->second;
+                    lock.unlock();
+                    m_sharedCount.fetch_add(1, std::memory_order_relaxed);
+                    outShared = true;
+                    return pending.get();
+                }
+                it->second = promise.get_future().share();
+            }
+
+            // Later callers start a new load once this one is forgotten, they should find its result where the loader put it
+            outShared = false;
+            try
+            {
+                Value value = loader();
+                this->Forget(key);
+                promise.set_value(value);
+                return value;
+            }
+            catch(...)
+            {
+                this->Forget(key);
+                promise.set_exception(std::current_exception());
+                throw;
+            }
+        }
+
+        /// @brief Number of loads running
+        size_t GetPendingCount() const
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_loads.size();
+        }
+
+        /// @brief Number of callers that got the result of another load so far
+        uint64_t GetSharedCount() const { return m_sharedCount.load(std::memory_order_relaxed); }
+
+    private:
+        void Forget(const Key& key)
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_loads.erase(key);
+        }
+
+    private:
+        mutable std::mutex m_mtx;
+        std::unordered_map<Key, std::shared_future<Value>> m_loads;
+        std::atomic<uint64_t> m_sharedCount;
+    };
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Hashed timing wheel: timers are bucketed by their expiry tick into a fixed ring of slots,
+    /// deadlines further than one revolution away keep a count of the remaining rounds.
+    /// Scheduling and cancelling are O(1), advancing the wheel only visits the slots of the elapsed ticks.
+    /// This class is not thread safe, the owner is expected to serialize the access.
+    /// @tparam T Value handed back to the expiry callback
+    template<typename T>
+    class TimingWheel
+    {
+        struct Timer
+        {
+            T value;
+            uint64_t rounds;
+        };
+
+        using Slot = std::list<Timer>;
+
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// @brief Identifies a scheduled timer, used to cancel it
+        class Handle
+        {
+        public:
+            bool IsValid() const { return m_slot != s_invalidSlot; }
+
+        private:
+            friend class TimingWheel;
+            static constexpr size_t s_invalidSlot = std::numeric_limits<size_t>::max();
+
+            size_t m_slot = s_invalidSlot;
+            typename Slot::iterator m_position{};
+        };
+
+        /// @brief Creates the wheel
+        /// @param tick Resolution of the wheel, deadlines are rounded up to the next tick
+        /// @param slotCount Number of slots in one revolution, rounded up to a power of two
+        /// @param start Time point of tick zero
+        TimingWheel(Clock::duration tick = std::chrono::seconds(1), size_t slotCount = 256, Clock::time_point start = Clock::now())
+            : m_slots(std::bit_ceil(std::max<size_t>(slotCount, 1)))
+            , m_tick{ tick }
+            , m_start{ start }
+            , m_currentTick{ 0 }
+            , m_size{ 0 }
+        {
+        }
+
+        /// @brief Schedules a timer
+        /// @param value Value handed to the expiry callback
+        /// @param deadline Expiry time point, deadlines in the past expire on the next advance
+        /// @return Handle to cancel the timer
+        Handle Schedule(T value, Clock::time_point deadline)
+        {
+            uint64_t tick = m_currentTick + 1;
+            if(deadline > m_start)
+                tick = std::max<uint64_t>(tick, static_cast<uint64_t>((deadline - m_start + m_tick - Clock::duration(1)) / m_tick));
+
+            Handle handle;
+            handle.m_slot = static_cast<size_t>(tick & (m_slots.size() - 1));
+
+            Slot& slot = m_slots[handle.m_slot];
+            slot.push_front(Timer{ std::move(value), (tick - m_currentTick - 1) / m_slots.size() });
+            handle.m_position = slot.begin();
+
+            m_size++;
+            return handle;
+        }
+
+        /// @brief Cancels a timer that has not expired yet, the handle is invalidated
+        /// @param handle Handle returned by Schedule
+        void Cancel(Handle& handle)
+        {
+            if(!handle.IsValid())
+                return;
+
+            m_slots[handle.m_slot].erase(handle.m_position);
+            handle.m_slot = Handle::s_invalidSlot;
+            m_size--;
+        }
+
+        /// @brief Expires every timer whose deadline tick has elapsed. The expired timers are removed before the callback
+        /// is invoked, so their handles must not be cancelled anymore.
+        /// @param now Current time
+        /// @param onExpire Callback invoked with the value of each expired timer
+        template<typename F>
+        void Advance(Clock::time_point now, F&& onExpire)
+        {
+            if(now <= m_start)
+                return;
+
+            uint64_t targetTick = static_cast<uint64_t>((now - m_start) / m_tick);
+            while(m_currentTick < targetTick)
+            {
+                m_currentTick++;
+                Slot& slot = m_slots[m_currentTick & (m_slots.size() - 1)];
+                for(auto it = slot.begin(); it != slot.end();)
+                {
+                    if(it->rounds > 0)
+                    {
+                        it->rounds--;
+                        ++it;
+                        continue;
+                    }
+
+                    T value = std::move(it->value);
+                    it = slot.erase(it);
+                    m_size--;
+                    onExpire(value);
+                }
+            }
+        }
+
+        /// @brief Number of scheduled timers
+        size_t Size() const { return m_size; }
+
+    private:
+        std::vector<Slot> m_slots;
+        Clock::duration m_tick;
+        Clock::time_point m_start;
+        uint64_t m_currentTick;
+        size_t m_size;
+    };
+}
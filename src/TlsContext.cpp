@@ -0,0 +1,307 @@
+#include "TlsContext.h"
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+namespace MC
+{
+    namespace
+    {
+        // Slot of the ticket keys in the SSL_CTX, allocated once per process
+        int GetTicketKeysIndex()
+        {
+            static const int s_index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+            return s_index;
+        }
+
+        std::string GetOpenSslError()
+        {
+            unsigned long error = ERR_get_error();
+            if(error == 0)
+                return "unknown error";
+
+            char buffer[256];
+            ERR_error_string_n(error, buffer, sizeof(buffer));
+            ERR_clear_error();
+            return buffer;
+        }
+
+        /// @brief Ticket encryption callback of OpenSSL (RFC 5077 layout: key name, IV, AES-256-CBC, HMAC-SHA256)
+        int TicketKeyCallback(SSL* ssl, unsigned char* keyName, unsigned char* iv, EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* macCtx, int encrypt)
+        {
+            auto* keys = static_cast<TlsTicketKeys*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), GetTicketKeysIndex()));
+            if(!keys)
+                return -1;
+
+            TlsTicketKeys::Key key;
+            bool isCurrent = true;
+            if(encrypt)
+            {
+                key = keys->GetCurrentKey();
+                std::copy(key.name.begin(), key.name.end(), keyName);
+                if(RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1
+                    || EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key.aesKey.data(), iv) != 1)
+                    return -1;
+            }
+            else
+            {
+                // Unknown key: not an error, the client simply gets a full handshake
+                if(!keys->FindKey(keyName, key, isCurrent))
+                    return 0;
+                if(EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key.aesKey.data(), iv) != 1)
+                    return -1;
+            }
+
+            char digest[] = "SHA256";
+            OSSL_PARAM params[] = {
+                OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey.data(), key.hmacKey.size()),
+                OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+                OSSL_PARAM_construct_end()
+            };
+            if(EVP_MAC_CTX_set_params(macCtx, params) != 1)
+                return -1;
+
+            // 2 asks OpenSSL to issue a new ticket with the current key
+            return isCurrent ? 1 : 2;
+        }
+    }
+
+    TlsTicketKeys::TlsTicketKeys(std::chrono::seconds rotation)
+        : m_rotation{ rotation }
+        , m_current{}
+        , m_valid{ false }
+    {
+        m_valid = MakeKey(m_current);
+    }
+
+    TlsTicketKeys::Key TlsTicketKeys::GetCurrentKey()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        Key next;
+        if(std::chrono::steady_clock::now() - m_current.created >= m_rotation && MakeKey(next))
+        {
+            m_previous = m_current;
+            m_current = next;
+        }
+        return m_current;
+    }
+
+    bool TlsTicketKeys::FindKey(const unsigned char* name, Key& outKey, bool& outIsCurrent)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto now = std::chrono::steady_clock::now();
+
+        if(std::equal(m_current.name.begin(), m_current.name.end(), name) && now - m_current.created < 2 * m_rotation)
+        {
+            outKey = m_current;
+            outIsCurrent = now - m_current.created < m_rotation;
+            return true;
+        }
+
+        // The previous key stops being accepted one rotation after it was replaced
+        if(m_previous && std::equal(m_previous->name.begin(), m_previous->name.end(), name) && now - m_previous->created < 2 * m_rotation)
+        {
+            outKey = *m_previous;
+            outIsCurrent = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool TlsTicketKeys::MakeKey(Key& outKey)
+    {
+        outKey.created = std::chrono::steady_clock::now();
+        return RAND_bytes(outKey.name.data(), static_cast<int>(outKey.name.size())) == 1
+            && RAND_bytes(outKey.aesKey.data(), static_cast<int>(outKey.aesKey.size())) == 1
+            && RAND_bytes(outKey.hmacKey.data(), static_cast<int>(outKey.hmacKey.size())) == 1;
+    }
+
+    struct TlsCertificateStore::Pair
+    {
+        X509* cert = nullptr;
+        EVP_PKEY* key = nullptr;
+        STACK_OF(X509)* chain = nullptr;
+
+        ~Pair()
+        {
+            X509_free(cert);
+            EVP_PKEY_free(key);
+            sk_X509_pop_free(chain, X509_free);
+        }
+    };
+
+    bool TlsCertificateStore::Load(const fs::path& certPath, const fs::path& keyPath, std::string& outError)
+    {
+        auto pair = std::make_shared<Pair>();
+        ERR_clear_error();
+
+        BIO* certBio = BIO_new_file(certPath.string().c_str(), "r");
+        if(!certBio)
+        {
+            outError = "certificate " + certPath.string() + " cannot be opened";
+            return false;
+        }
+        pair->cert = PEM_read_bio_X509_AUX(certBio, nullptr, nullptr, nullptr);
+        pair->chain = sk_X509_new_null();
+        while(pair->cert && pair->chain)
+        {
+            X509* intermediate = PEM_read_bio_X509(certBio, nullptr, nullptr, nullptr);
+            if(!intermediate)
+                break;
+            sk_X509_push(pair->chain, intermediate);
+        }
+        BIO_free(certBio);
+        ERR_clear_error(); // The end of the chain is reported as an error
+        if(!pair->cert)
+        {
+            outError = "certificate " + certPath.string() + " holds no PEM certificate";
+            return false;
+        }
+
+        BIO* keyBio = BIO_new_file(keyPath.string().c_str(), "r");
+        if(!keyBio)
+        {
+            outError = "certificate key " + keyPath.string() + " cannot be opened";
+            return false;
+        }
+        pair->key = PEM_read_bio_PrivateKey(keyBio, nullptr, nullptr, nullptr);
+        BIO_free(keyBio);
+        if(!pair->key)
+        {
+            outError = "certificate key " + keyPath.string() + " holds no unencrypted PEM private key: " + GetOpenSslError();
+            return false;
+        }
+
+        if(X509_check_private_key(pair->cert, pair->key) != 1)
+        {
+            ERR_clear_error();
+            outError = "certificate key " + keyPath.string() + " does not match the certificate " + certPath.string();
+            return false;
+        }
+        if(X509_cmp_current_time(X509_get0_notAfter(pair->cert)) < 0)
+        {
+            outError = "certificate " + certPath.string() + " has expired";
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_pair = std::move(pair);
+        return true;
+    }
+
+    bool TlsCertificateStore::IsLoaded() const
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_pair != nullptr;
+    }
+
+    std::string TlsCertificateStore::GetDescription() const
+    {
+        std::shared_ptr<const Pair> pair;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            pair = m_pair;
+        }
+        if(!pair)
+            return "none";
+
+        std::string description;
+        BIO* bio = BIO_new(BIO_s_mem());
+        X509_NAME_print_ex(bio, X509_get_subject_name(pair->cert), 0, XN_FLAG_ONELINE & ~ASN1_STRFLGS_ESC_MSB);
+        BIO_puts(bio, ", expires ");
+        ASN1_TIME_print(bio, X509_get0_notAfter(pair->cert));
+        char* data = nullptr;
+        long size = BIO_get_mem_data(bio, &data);
+        if(data && size > 0)
+            description.assign(data, static_cast<size_t>(size));
+        BIO_free(bio);
+        return description;
+    }
+
+    void TlsCertificateStore::Attach(SSL_CTX* ctx)
+    {
+        SSL_CTX_set_cert_cb(ctx, CertificateCallback, this);
+    }
+
+    int TlsCertificateStore::CertificateCallback(SSL* ssl, void* arg)
+    {
+        // Runs on the ClientHello, before the cipher is chosen: the connection gets its own reference to the pair
+        std::shared_ptr<const Pair> pair;
+        {
+            auto* store = static_cast<TlsCertificateStore*>(arg);
+            std::lock_guard<std::mutex> lock(store->m_mtx);
+            pair = store->m_pair;
+        }
+        if(!pair)
+            return 0;
+        return SSL_use_cert_and_key(ssl, pair->cert, pair->key, pair->chain, 1) == 1 ? 1 : 0;
+    }
+
+    bool ConfigureTlsContext(SSL_CTX* ctx, const TlsSettings& settings, TlsTicketKeys* ticketKeys, std::string& outError)
+    {
+        SSL_CTX_set_min_proto_version(ctx, settings.minVersion == "1.3" ? TLS1_3_VERSION : TLS1_2_VERSION);
+
+        // Our preference order wins: the lists are ordered by security first, then by speed
+        SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+        if(!settings.ciphers.empty() && SSL_CTX_set_cipher_list(ctx, settings.ciphers.c_str()) != 1)
+        {
+            outError = "tls_ciphers: " + GetOpenSslError();
+            return false;
+        }
+        if(!settings.cipherSuites.empty() && SSL_CTX_set_ciphersuites(ctx, settings.cipherSuites.c_str()) != 1)
+        {
+            outError = "tls_ciphersuites: " + GetOpenSslError();
+            return false;
+        }
+        if(!settings.curves.empty() && SSL_CTX_set1_groups_list(ctx, settings.curves.c_str()) != 1)
+        {
+            outError = "tls_curves: " + GetOpenSslError();
+            return false;
+        }
+
+        // Stateful resumption: sessions are kept by the server and found back by their ID (TLS 1.2) or by a ticket referencing them (TLS 1.3)
+        static const unsigned char s_sessionIdContext[] = "MC";
+        SSL_CTX_set_session_id_context(ctx, s_sessionIdContext, sizeof(s_sessionIdContext) - 1);
+        SSL_CTX_set_timeout(ctx, settings.sessionTimeoutSec);
+        if(settings.sessionCacheSize > 0)
+        {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(settings.sessionCacheSize));
+        }
+        else
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+        // Stateless resumption: the session travels in a ticket encrypted with our rotating keys
+        if(settings.ticketKeyRotationSec > 0 && ticketKeys && ticketKeys->IsValid())
+        {
+            SSL_CTX_set_ex_data(ctx, GetTicketKeysIndex(), ticketKeys);
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, TicketKeyCallback);
+        }
+        else
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+#ifdef SSL_OP_ENABLE_KTLS
+        // Only used when the kernel has the tls module and the negotiated cipher is supported, OpenSSL falls back silently otherwise
+        if(settings.ktls)
+            SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+        return true;
+    }
+
+    bool IsKtlsSendActive(const SSL* ssl)
+    {
+#ifdef SSL_OP_ENABLE_KTLS
+        return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+#else
+        (void)ssl;
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Defines.h"
+
+#include <openssl/types.h>
+
+namespace MC
+{
+    /// @brief TLS settings applied to the server context on top of the certificate and key
+    struct TlsSettings
+    {
+        std::string minVersion = "1.2";             // "1.2" or "1.3"
+        std::string ciphers;                        // TLS 1.2 cipher list, OpenSSL syntax, empty keeps the OpenSSL default
+        std::string cipherSuites;                   // TLS 1.3 cipher suites, empty keeps the OpenSSL default
+        std::string curves;                         // Key exchange groups in preference order, empty keeps the OpenSSL default
+        size_t sessionCacheSize = 20480;            // Server side session cache entries, 0 disables the cache
+        long sessionTimeoutSec = 3600;              // Lifetime of cached sessions and tickets
+        long ticketKeyRotationSec = 3600;           // Session ticket key lifetime, 0 disables tickets
+        bool ktls = false;                          // Let OpenSSL hand the record layer to the kernel when it can
+    };
+
+    /// @brief Session ticket keys of a TLS context, rotated over time.
+    /// Tickets are issued with the current key, tickets of the previous key are still accepted and then renewed,
+    /// so a ticket stays valid between one and two rotation periods. Keys only live in memory.
+    class TlsTicketKeys
+    {
+    public:
+        /// @brief Creates the first key
+        /// @param rotation Lifetime of a key as the current one
+        TlsTicketKeys(std::chrono::seconds rotation);
+
+        TlsTicketKeys(const TlsTicketKeys&) = delete;
+        TlsTicketKeys& operator=(const TlsTicketKeys&) = delete;
+
+        struct Key
+        {
+            std::array<unsigned char, 16> name;
+            std::array<unsigned char, 32> aesKey;
+            std::array<unsigned char, 32> hmacKey;
+            std::chrono::steady_clock::time_point created;
+        };
+
+        /// @brief Tells whether the first key could be generated, tickets must not be enabled otherwise
+        bool IsValid() const { return m_valid; }
+
+        /// @brief Gets the key to issue tickets with, rotating the keys when the current one is too old
+        Key GetCurrentKey();
+
+        /// @brief Finds the key a ticket was issued with
+        /// @param[in] name Key name stored in the ticket
+        /// @param[out] outKey Key
+        /// @param[out] outIsCurrent False if the key was rotated out, the ticket should then be renewed
+        /// @return False if the key is unknown or expired
+        bool FindKey(const unsigned char* name, Key& outKey, bool& outIsCurrent);
+
+    private:
+        static bool MakeKey(Key& outKey);
+
+    private:
+        std::chrono::seconds m_rotation;
+        std::mutex m_mtx;
+        Key m_current;
+        std::optional<Key> m_previous;
+        bool m_valid;
+    };
+
+    /// @brief Certificate chain and private key of a TLS context, replaced as a whole while the server runs.
+    /// Every handshake takes the pair that is current when it starts, established connections keep theirs.
+    class TlsCertificateStore
+    {
+    public:
+        TlsCertificateStore() = default;
+
+        TlsCertificateStore(const TlsCertificateStore&) = delete;
+        TlsCertificateStore& operator=(const TlsCertificateStore&) = delete;
+
+        /// @brief Loads a PEM certificate chain, leaf first, and its PEM private key. The current pair is kept on failure.
+        /// @param[in] certPath Certificate chain file
+        /// @param[in] keyPath Private key file
+        /// @param[out] outError Which file was rejected and why
+        /// @return False if the pair could not be loaded
+        bool Load(const fs::path& certPath, const fs::path& keyPath, std::string& outError);
+
+        /// @brief Tells whether a pair was loaded
+        bool IsLoaded() const;
+
+        /// @brief Subject and expiry date of the current certificate, for the logs
+        std::string GetDescription() const;
+
+        /// @brief Makes the handshakes of a context take their certificate from this store, which must outlive the context
+        /// @param ctx Context
+        void Attach(SSL_CTX* ctx);
+
+    private:
+        struct Pair;
+
+        static int CertificateCallback(SSL* ssl, void* arg);
+
+    private:
+        mutable std::mutex m_mtx;
+        std::shared_ptr<const Pair> m_pair;
+    };
+
+    /// @brief Applies the protocol, cipher, session resumption and kTLS settings to a server context
+    /// @param[in] ctx Context, with its certificate already loaded or a certificate store attached
+    /// @param[in] settings Settings
+    /// @param[in] ticketKeys Ticket keys, must outlive the context, tickets are disabled when null or invalid
+    /// @param[out] outError Description of the first invalid setting
+    /// @return False if a setting was rejected by OpenSSL
+    bool ConfigureTlsContext(SSL_CTX* ctx, const TlsSettings& settings, TlsTicketKeys* ticketKeys, std::string& outError);
+
+    /// @brief Tells whether the records sent on a connection are encrypted by the kernel
+    /// @param ssl Connection
+    bool IsKtlsSendActive(const SSL* ssl);
+}
@@ -0,0 +1,157 @@
+#include "WorkerPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace MC
+{
+    namespace
+    {
+        thread_local bool t_shedding = false;
+    }
+
+    void PinCurrentThread(size_t index)
+    {
+#ifdef __linux__
+        unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            std::cerr << "Failed to pin thread " << index << " to a CPU core" << std::endl;
+#else
+        (void)index;
+#endif
+    }
+
+    WorkerPool::WorkerPool(size_t threadCount, size_t maxQueued, bool pinThreads)
+        : m_maxQueued{ maxQueued }
+        , m_stopping{ false }
+        , m_shedCount{ 0 }
+        , m_activeCount{ 0 }
+    {
+        threadCount = std::max<size_t>(threadCount, 1);
+        m_workers.reserve(threadCount);
+        for(size_t i = 0; i < threadCount; i++)
+        {
+            m_workers.emplace_back([this, i, pinThreads]()
+                {
+                    if(pinThreads)
+                        PinCurrentThread(i);
+                    WorkerLoop();
+                });
+        }
+
+        if(m_maxQueued > 0)
+            m_shedThread = std::thread(&WorkerPool::ShedLoop, this);
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        Shutdown();
+    }
+
+    bool WorkerPool::Enqueue(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if(m_stopping)
+                return false;
+
+            if(m_maxQueued == 0 || m_tasks.size() < m_maxQueued)
+            {
+                m_tasks.push_back(std::move(task));
+                m_cv.notify_one();
+                return true;
+            }
+
+            // Overloaded, answering late is worse than answering "busy" right away
+            if(m_shedTasks.size() >= s_maxShedQueued)
+                return false;
+
+            m_shedTasks.push_back(std::move(task));
+        }
+
+        m_shedCount.fetch_add(1, std::memory_order_relaxed);
+        m_shedCv.notify_one();
+        return true;
+    }
+
+    void WorkerPool::Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        m_shedCv.notify_all();
+
+        for(std::thread& worker : m_workers)
+        {
+            if(worker.joinable())
+                worker.join();
+        }
+        if(m_shedThread.joinable())
+            m_shedThread.join();
+    }
+
+    size_t WorkerPool::GetQueueDepth() const
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_tasks.size();
+    }
+
+    bool WorkerPool::IsShedding()
+    {
+        return t_shedding;
+    }
+
+    void WorkerPool::WorkerLoop()
+    {
+        for(;;)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_cv.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+                // Queued tasks are still run on stop, they own accepted sockets
+                if(m_tasks.empty())
+                    break;
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            m_activeCount.fetch_add(1, std::memory_order_relaxed);
+            task();
+            m_activeCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void WorkerPool::ShedLoop()
+    {
+        t_shedding = true;
+
+        for(;;)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_shedCv.wait(lock, [this]() { return m_stopping || !m_shedTasks.empty(); });
+
+                if(m_shedTasks.empty())
+                    break;
+
+                task = std::move(m_shedTasks.front());
+                m_shedTasks.pop_front();
+            }
+
+            m_activeCount.fetch_add(1, std::memory_order_relaxed);
+            task();
+            m_activeCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
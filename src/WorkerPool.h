@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Defines.h"
+
+namespace MC
+{
+    /// @brief Pins the calling thread to a CPU core
+    /// @param index Thread index, mapped round robin over the available cores
+    void PinCurrentThread(size_t index);
+
+    /// @brief Fixed size pool of worker threads fed by a bounded queue.
+    /// When the queue is full a task is not queued behind the others, it is handed to a single shedding thread instead.
+    /// Tasks running there see IsShedding() return true and are expected to answer quickly (e.g. with a 503).
+    class WorkerPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        /// @brief Starts the worker threads
+        /// @param threadCount Number of workers, at least one
+        /// @param maxQueued Maximum tasks waiting for a worker, 0 means unbounded (nothing is ever shed)
+        /// @param pinThreads Pin each worker to a CPU core, round robin over the available cores
+        WorkerPool(size_t threadCount, size_t maxQueued, bool pinThreads);
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        /// @brief Queues a task for the workers, or for the shedding thread when the queue is full
+        /// @param task Task to run
+        /// @return False if the task was dropped because both queues were full
+        bool Enqueue(Task task);
+
+        /// @brief Runs the remaining tasks and joins all threads
+        void Shutdown();
+
+        /// @brief Number of tasks handed to the shedding thread so far
+        uint64_t GetShedCount() const { return m_shedCount.load(std::memory_order_relaxed); }
+
+        /// @brief Number of tasks waiting for a worker
+        size_t GetQueueDepth() const;
+
+        /// @brief Number of tasks being run by the workers and the shedding thread
+        size_t GetActiveCount() const { return m_activeCount.load(std::memory_order_relaxed); }
+
+        /// @brief Tells whether the calling thread is running a shed task
+        static bool IsShedding();
+
+    private:
+        void WorkerLoop();
+        void ShedLoop();
+
+    private:
+        // Shed tasks only produce a short error response, a small queue is enough to absorb a burst
+        static constexpr size_t s_maxShedQueued = 64;
+
+        size_t m_maxQueued;
+
+        mutable std::mutex m_mtx;
+        std::condition_variable m_cv;
+        std::deque<Task> m_tasks;
+        std::deque<Task> m_shedTasks;
+        bool m_stopping;
+
+        std::condition_variable m_shedCv;
+        std::atomic<uint64_t> m_shedCount;
+        std::atomic<size_t> m_activeCount;
+
+        std::vector<std::thread> m_workers;
+        std::thread m_shedThread;
+    };
+}
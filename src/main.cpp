@@ -1,5 +1,10 @@
 #include "Server.h"
 
+#ifndef _WIN32
+#include <csignal>
+#include <pthread.h>
+#endif
+
 int main(int argc, char* argv[])
 {
     if(argc < 2)
@@ -9,10 +14,37 @@ int main(int argc, char* argv[])
     }
     fs::path configPath(argv[1]);
 
+#ifndef _WIN32
+    // Termination signals are taken by a dedicated thread, so that the server shuts down cleanly (e.g. saves its cache snapshot).
+    // SIGHUP reloads the certificate. They are blocked before any other thread exists, every thread inherits the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+
     MC::Server server(configPath);
 
-    if(server.IsConfigLoaded())
-        server.CreateServer();
+#ifndef _WIN32
+    std::thread signalThread([&server, signals]()
+        {
+            int signal = 0;
+            while(sigwait(&signals, &signal) == 0 && signal == SIGHUP)
+                server.ReloadCertificate();
+            server.Stop();
+        });
+#endif
+
+    // A port that cannot be bound is reported through the exit code, for service managers and scripts
+    bool failed = server.IsConfigLoaded() && !server.CreateServer();
+
+#ifndef _WIN32
+    // Wake the signal thread if the server stopped on its own
+    pthread_kill(signalThread.native_handle(), SIGTERM);
+    signalThread.join();
+#endif
 
-    return 0;
-}
\ No newline at end of file
+    return failed ? 1 : 0;
+}